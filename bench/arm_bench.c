@@ -0,0 +1,222 @@
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arm.h"
+#include "arm_isa.h"
+#include "asm/parser.h"
+#include "mmu.h"
+
+/* Unrolled block of identical instructions, run from IWRAM. */
+#define BENCH_BLOCK 1024
+#define BENCH_BASE 0x03000000
+#define BENCH_DEFAULT_COUNT (4 * 1024 * 1024)
+
+typedef enum {
+    OPER_RD_RN, /* op Rd, Rn, <oper2> */
+    OPER_RD,    /* op Rd, <oper2> */
+    OPER_RN,    /* op Rn, <oper2> */
+} oper_t;
+
+static const struct dp_op {
+    const char *name;
+    oper_t oper;
+} dp_ops[] = {
+    {"and", OPER_RD_RN}, {"eor", OPER_RD_RN}, {"sub", OPER_RD_RN},
+    {"rsb", OPER_RD_RN}, {"add", OPER_RD_RN}, {"adc", OPER_RD_RN},
+    {"sbc", OPER_RD_RN}, {"rsc", OPER_RD_RN}, {"tst", OPER_RN},
+    {"teq", OPER_RN},    {"cmp", OPER_RN},    {"cmn", OPER_RN},
+    {"orr", OPER_RD_RN}, {"mov", OPER_RD},    {"bic", OPER_RD_RN},
+    {"mvn", OPER_RD},
+};
+
+static const struct shifter {
+    const char *name;
+    const char *oper2;
+} shifters[] = {
+    {"lsl_imm", "r2, lsl #3"}, {"lsr_imm", "r2, lsr #3"},
+    {"asr_imm", "r2, asr #3"}, {"ror_imm", "r2, ror #3"},
+    {"lsl_reg", "r2, lsl r3"}, {"lsr_reg", "r2, lsr r3"},
+    {"asr_reg", "r2, asr r3"}, {"ror_reg", "r2, ror r3"},
+    {"imm", "#0x3f0"},
+};
+
+typedef struct {
+    char name[16];
+    char src[32];
+    uint32_t opcode;
+    uint32_t code;
+    double ns_per_instr;
+    double mips;
+} result_t;
+
+static int assemble(const char *src, uint32_t *opcode)
+{
+    parser_t p;
+    /* Leave room for the terminating null byte written by fmemopen. */
+    uint32_t buf[2] = {0};
+    FILE *in = fmemopen((void *)src, strlen(src) + 1, "r");
+    FILE *out = fmemopen(buf, sizeof(buf), "w");
+    if (in == NULL || out == NULL)
+        return -1;
+    parser_init(&p, in, out);
+    int ret = parser_exec(&p);
+    parser_print_error(&p, ret);
+    fclose(in);
+    fclose(out);
+    *opcode = buf[0];
+    return ret;
+}
+
+static void bench_reset_regs(void)
+{
+    arm_init();
+    for (int i = 0; i < 13; ++i)
+        arm.r[i] = 0x12345678u * (uint32_t)(i + 1);
+    arm.r[3] = 5;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int bench_run(result_t *r, unsigned long count)
+{
+    uint32_t opcode;
+    if (assemble(r->src, &opcode) != PARSER_OK)
+        return -1;
+    r->opcode = opcode;
+    r->code = ((opcode >> 16) & 0xff0) | ((opcode >> 4) & 0x0f);
+    for (int i = 0; i < BENCH_BLOCK; ++i)
+        mmu_write_word(BENCH_BASE + (uint32_t)i * 4, opcode);
+
+    bench_reset_regs();
+    arm.r[PC] = BENCH_BASE;
+    for (int i = 0; i < BENCH_BLOCK; ++i)
+        arm_step();
+
+    unsigned long blocks = (count + BENCH_BLOCK - 1) / BENCH_BLOCK;
+    double start = now_ns();
+    for (unsigned long b = 0; b < blocks; ++b) {
+        arm.r[PC] = BENCH_BASE;
+        for (int i = 0; i < BENCH_BLOCK; ++i)
+            arm_step();
+    }
+    double elapsed = now_ns() - start;
+    double instrs = (double)blocks * BENCH_BLOCK;
+    r->ns_per_instr = elapsed / instrs;
+    r->mips = instrs / elapsed * 1e3;
+    return 0;
+}
+
+static void print_text(result_t *res, int n)
+{
+    printf("%-14s %-26s %-6s %10s %10s\n", "handler", "instruction", "code",
+           "ns/instr", "MIPS");
+    for (int i = 0; i < n; ++i) {
+        printf("%-14s %-26s 0x%.3x %10.3f %10.2f\n", res[i].name, res[i].src,
+               res[i].code, res[i].ns_per_instr, res[i].mips);
+    }
+}
+
+static void print_json(result_t *res, int n, unsigned long count)
+{
+    printf("{\n  \"benchmark\": \"arm\",\n  \"instructions\": %lu,\n", count);
+    printf("  \"results\": [\n");
+    for (int i = 0; i < n; ++i) {
+        printf("    {\"name\": \"%s\", \"asm\": \"%s\", \"opcode\": "
+               "\"0x%.8x\", \"code\": \"0x%.3x\", \"ns_per_instr\": %.4f, "
+               "\"mips\": %.3f}%s\n",
+               res[i].name, res[i].src, res[i].opcode, res[i].code,
+               res[i].ns_per_instr, res[i].mips, i + 1 < n ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-j] [-n count] [-f filter]\n"
+            "  -j         print results as JSON\n"
+            "  -n count   instructions executed per handler\n"
+            "  -f filter  only run handlers whose name contains filter\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static result_t res[sizeof(dp_ops) / sizeof(dp_ops[0]) * 2 *
+                        sizeof(shifters) / sizeof(shifters[0])];
+    unsigned long count = BENCH_DEFAULT_COUNT;
+    const char *filter = NULL;
+    bool json = false;
+    int n = 0, opt;
+
+    mmu_init();
+    while ((opt = getopt(argc, argv, "jn:f:h")) != -1) {
+        switch (opt) {
+            case 'j':
+                json = true;
+                break;
+            case 'n':
+                count = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    for (size_t op = 0; op < sizeof(dp_ops) / sizeof(dp_ops[0]); ++op) {
+        const struct dp_op *d = &dp_ops[op];
+        for (int s = 0; s < 2; ++s) {
+            /* Compare operations only exist with the S bit set. */
+            if (d->oper == OPER_RN && !s)
+                continue;
+            const char *suffix = s && d->oper != OPER_RN ? "s" : "";
+            for (size_t sh = 0; sh < sizeof(shifters) / sizeof(shifters[0]);
+                 ++sh) {
+                result_t *r = &res[n];
+                snprintf(r->name, sizeof(r->name), "%s%s_%s", d->name, suffix,
+                         shifters[sh].name);
+                if (filter && strstr(r->name, filter) == NULL)
+                    continue;
+                switch (d->oper) {
+                    case OPER_RD_RN:
+                        snprintf(r->src, sizeof(r->src), "%s%s r0, r1, %s",
+                                 d->name, suffix, shifters[sh].oper2);
+                        break;
+                    case OPER_RD:
+                        snprintf(r->src, sizeof(r->src), "%s%s r0, %s",
+                                 d->name, suffix, shifters[sh].oper2);
+                        break;
+                    case OPER_RN:
+                        snprintf(r->src, sizeof(r->src), "%s r1, %s", d->name,
+                                 shifters[sh].oper2);
+                        break;
+                }
+                if (bench_run(r, count) != 0) {
+                    fprintf(stderr, "failed to assemble '%s'\n", r->src);
+                    return 1;
+                }
+                n++;
+            }
+        }
+    }
+
+    if (json)
+        print_json(res, n, count);
+    else
+        print_text(res, n);
+    return 0;
+}
@@ -0,0 +1,26 @@
+@ alu.s - data processing loop, mostly immediate and register operands.
+@ Public domain, part of the gusgba benchmark ROMs.
+
+start:
+    mov r0, #0
+    mov r1, #1
+    mov r2, #0x3f0
+    mov r3, #5
+loop:
+    add r0, r0, r1
+    adds r4, r0, r2
+    adc r5, r4, #0x10
+    sub r6, r5, r1
+    rsbs r7, r6, #0xff00
+    sbc r8, r7, r0
+    and r9, r8, r2
+    eor r10, r9, r0
+    orr r11, r10, #0xf000000f
+    bic r12, r11, r1
+    mvn r4, r12
+    cmp r4, r0
+    tst r5, #0x80
+    teq r6, r7
+    cmn r8, r9
+    movs r1, r1
+    b loop
@@ -0,0 +1,32 @@
+@ call.s - nested calls and returns through BL and BX LR.
+@ Public domain, part of the gusgba benchmark ROMs.
+
+start:
+    mov r0, #0
+    mov r1, #1
+loop:
+    bl outer
+    bl leaf
+    b loop
+
+outer:
+    mov r12, lr
+    add r0, r0, r1
+    bl middle
+    bl leaf
+    mov lr, r12
+    bx lr
+
+middle:
+    mov r11, lr
+    eor r2, r0, r1, lsl #4
+    bl leaf
+    bl leaf
+    mov lr, r11
+    bx lr
+
+leaf:
+    add r3, r2, r0
+    sub r4, r3, r1
+    orr r5, r4, r3
+    bx lr
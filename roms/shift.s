@@ -0,0 +1,23 @@
+@ shift.s - barrel shifter loop, immediate and register shift amounts.
+@ Public domain, part of the gusgba benchmark ROMs.
+
+start:
+    mov r0, #0x12
+    orr r0, r0, #0x3400
+    orr r0, r0, #0x560000
+    orr r0, r0, #0x78000000
+    mov r1, #3
+loop:
+    add r2, r0, r0, lsl #3
+    eor r3, r2, r0, lsr #7
+    subs r4, r3, r2, asr #2
+    orr r5, r4, r3, ror #11
+    movs r6, r5, ror #1
+    add r7, r6, r5, lsl r1
+    eors r8, r7, r6, lsr r1
+    sub r9, r8, r7, asr r1
+    mov r10, r9, ror r1
+    add r1, r1, #1
+    and r1, r1, #0x1f
+    add r0, r0, r10
+    b loop
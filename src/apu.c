@@ -0,0 +1,366 @@
+#include "apu.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "arm.h"
+#include "dma.h"
+#include "gba.h"
+#include "io.h"
+#include "mmu.h"
+#include "stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define APU_X86 1
+#endif
+
+apu_t apu;
+apu_resample_fn apu_resample = apu_resample_scalar;
+static apu_ring_t *apu_output;
+
+/* One row of taps per fractional position between native samples, the
+ * top 8 bits of the fraction. */
+static float apu_filter[APU_PHASES][APU_TAPS] __attribute__((aligned(32)));
+static int32_t apu_blep[APU_BLEP_PHASES][APU_BLEP_TAPS];
+
+
+static int16_t apu_clip(float v)
+{
+    long s = lrintf(v);
+    return (int16_t)(s < INT16_MIN ? INT16_MIN : s > INT16_MAX ? INT16_MAX : s);
+}
+
+/* Host samples from native ones until max are written or the input runs
+ * out. pos is where the next one falls in the input, the taps of a phase
+ * are centered between its 8th and 9th input sample. */
+size_t apu_resample_scalar(int16_t *dst, size_t max, const float *left,
+                           const float *right, size_t n, uint64_t *pos,
+                           uint64_t step)
+{
+    size_t k = 0;
+    uint64_t p = *pos;
+    for (; k < max && (p >> 32) + APU_TAPS <= n; ++k, p += step) {
+        size_t i = (size_t)(p >> 32);
+        const float *h = apu_filter[(uint32_t)p >> 24];
+        float l = 0, r = 0;
+        for (uint32_t t = 0; t < APU_TAPS; ++t) {
+            l += left[i + t] * h[t];
+            r += right[i + t] * h[t];
+        }
+        dst[k * 2] = apu_clip(l);
+        dst[k * 2 + 1] = apu_clip(r);
+    }
+    *pos = p;
+    return k;
+}
+
+#if defined(APU_X86) && defined(__SSE2__)
+/* Sum the lanes of l and r and store them as a rounded, saturated pair. */
+static inline void apu_store_sse2(int16_t *dst, __m128 l, __m128 r)
+{
+    __m128 s = _mm_add_ps(_mm_unpacklo_ps(l, r), _mm_unpackhi_ps(l, r));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    __m128i v = _mm_packs_epi32(_mm_cvtps_epi32(s), _mm_setzero_si128());
+    int32_t pair = _mm_cvtsi128_si32(v);
+    memcpy(dst, &pair, sizeof(pair));
+}
+
+static size_t apu_resample_sse2(int16_t *dst, size_t max, const float *left,
+                                const float *right, size_t n, uint64_t *pos,
+                                uint64_t step)
+{
+    size_t k = 0;
+    uint64_t p = *pos;
+    for (; k < max && (p >> 32) + APU_TAPS <= n; ++k, p += step) {
+        size_t i = (size_t)(p >> 32);
+        const float *h = apu_filter[(uint32_t)p >> 24];
+        __m128 l = _mm_setzero_ps(), r = _mm_setzero_ps();
+        for (uint32_t t = 0; t < APU_TAPS; t += 4) {
+            __m128 c = _mm_load_ps(&h[t]);
+            l = _mm_add_ps(l, _mm_mul_ps(_mm_loadu_ps(&left[i + t]), c));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(&right[i + t]), c));
+        }
+        apu_store_sse2(&dst[k * 2], l, r);
+    }
+    *pos = p;
+    return k;
+}
+
+#if defined(__GNUC__)
+#define APU_AVX2 __attribute__((target("avx2")))
+
+APU_AVX2 static size_t apu_resample_avx2(int16_t *dst, size_t max,
+                                         const float *left, const float *right,
+                                         size_t n, uint64_t *pos, uint64_t step)
+{
+    size_t k = 0;
+    uint64_t p = *pos;
+    for (; k < max && (p >> 32) + APU_TAPS <= n; ++k, p += step) {
+        size_t i = (size_t)(p >> 32);
+        const float *h = apu_filter[(uint32_t)p >> 24];
+        __m256 l = _mm256_setzero_ps(), r = _mm256_setzero_ps();
+        for (uint32_t t = 0; t < APU_TAPS; t += 8) {
+            __m256 c = _mm256_load_ps(&h[t]);
+            l = _mm256_add_ps(l,
+                              _mm256_mul_ps(_mm256_loadu_ps(&left[i + t]), c));
+            r = _mm256_add_ps(r,
+                              _mm256_mul_ps(_mm256_loadu_ps(&right[i + t]), c));
+        }
+        apu_store_sse2(&dst[k * 2],
+                       _mm_add_ps(_mm256_castps256_ps128(l),
+                                  _mm256_extractf128_ps(l, 1)),
+                       _mm_add_ps(_mm256_castps256_ps128(r),
+                                  _mm256_extractf128_ps(r, 1)));
+    }
+    *pos = p;
+    return k;
+}
+#endif
+#endif
+
+/* Tap t of n of a Blackman windowed sinc, for phase p of phases. The
+ * center is between taps n / 2 - 1 and n / 2. */
+static double apu_sinc(uint32_t t, uint32_t n, uint32_t p, uint32_t phases,
+                       double cutoff)
+{
+    double d = (double)t - (double)(n / 2 - 1) - (double)p / phases;
+    double x = M_PI * cutoff * d;
+    double w = (d + n / 2) / n;
+    return (d == 0 ? 1 : sin(x) / x) *
+           (0.42 - 0.5 * cos(2 * M_PI * w) + 0.08 * cos(4 * M_PI * w));
+}
+
+/* Cut off below the Nyquist frequency of the lower of the two rates. Each
+ * phase has unity gain at DC. */
+static void apu_build_filter(double cutoff)
+{
+    for (uint32_t p = 0; p < APU_PHASES; ++p) {
+        double taps[APU_TAPS], total = 0;
+        for (uint32_t t = 0; t < APU_TAPS; ++t)
+            total += taps[t] = apu_sinc(t, APU_TAPS, p, APU_PHASES, cutoff);
+        for (uint32_t t = 0; t < APU_TAPS; ++t)
+            apu_filter[p][t] = (float)(taps[t] / total);
+    }
+}
+
+/* A step is added to the mix as a band-limited impulse, which the mix
+ * integrates. Each phase sums to exactly 1 << APU_FRAC so that levels
+ * come back exact once the step is over. */
+static void apu_build_blep(void)
+{
+    for (uint32_t p = 0; p < APU_BLEP_PHASES; ++p) {
+        double taps[APU_BLEP_TAPS], total = 0;
+        int32_t sum = 0;
+        for (uint32_t t = 0; t < APU_BLEP_TAPS; ++t)
+            total += taps[t] =
+                apu_sinc(t, APU_BLEP_TAPS, p, APU_BLEP_PHASES, 0.9);
+        for (uint32_t t = 0; t < APU_BLEP_TAPS; ++t) {
+            apu_blep[p][t] = (int32_t)lround(taps[t] / total * (1 << APU_FRAC));
+            sum += apu_blep[p][t];
+        }
+        apu_blep[p][APU_BLEP_TAPS / 2 - 1] += (1 << APU_FRAC) - sum;
+    }
+}
+
+/* Mix the native samples before the one now falls in, and resample them
+ * to the host rate. With audio off only the running output is kept. */
+static void apu_mix(uint64_t now)
+{
+    STATS_SCOPE(STATS_APU);
+    uint64_t n = now > apu.time ? (now - apu.time) / APU_SAMPLE_CYCLES : 0;
+
+    while (n > 0) {
+        uint32_t chunk = n < APU_MIX_MAX ? (uint32_t)n : APU_MIX_MAX;
+        for (int c = 0; c < 2; ++c) {
+            int32_t sum = apu.sum[c];
+            float *in = &apu.in[c][apu.in_len];
+            for (uint32_t i = 0; i < chunk; ++i) {
+                sum += apu.delta[c][i];
+                /* SOUNDBIAS clips the output. */
+                int32_t v = sum < -(APU_LEVEL_MAX << APU_FRAC)
+                                ? -(APU_LEVEL_MAX << APU_FRAC)
+                            : sum > (APU_LEVEL_MAX << APU_FRAC) - 1
+                                ? (APU_LEVEL_MAX << APU_FRAC) - 1
+                                : sum;
+                in[i] = (float)v * (32768.0f / (APU_LEVEL_MAX << APU_FRAC));
+            }
+            apu.sum[c] = sum;
+            /* Steps still under way move to the front. */
+            memmove(apu.delta[c], &apu.delta[c][chunk],
+                    APU_BLEP_TAPS * sizeof(apu.delta[c][0]));
+            memset(&apu.delta[c][APU_BLEP_TAPS], 0,
+                   chunk * sizeof(apu.delta[c][0]));
+        }
+        apu.time += (uint64_t)chunk * APU_SAMPLE_CYCLES;
+        n -= chunk;
+        if (!gba.audio)
+            continue;
+
+        apu.in_len += chunk;
+        apu.out_len += (uint32_t)apu_resample(
+            &apu.out[apu.out_len * 2], APU_OUT_MAX - apu.out_len, apu.in[0],
+            apu.in[1], apu.in_len, &apu.pos, apu.step);
+        /* Drop what the output has no room for. */
+        if ((apu.pos >> 32) + APU_TAPS <= apu.in_len)
+            apu.pos = (uint64_t)(apu.in_len - APU_TAPS + 1) << 32;
+        uint32_t used = (uint32_t)(apu.pos >> 32);
+        for (int c = 0; c < 2; ++c)
+            memmove(apu.in[c], &apu.in[c][used],
+                    (apu.in_len - used) * sizeof(apu.in[c][0]));
+        apu.in_len -= used;
+        apu.pos -= (uint64_t)used << 32;
+    }
+}
+
+/* Step the output levels by left and right at cycle now. */
+void apu_step(uint64_t now, int32_t left, int32_t right)
+{
+    if (now < apu.time)
+        now = apu.time;
+    if ((now - apu.time) / APU_SAMPLE_CYCLES >= APU_MIX_MAX)
+        apu_mix(now);
+    uint64_t offset = now - apu.time;
+    uint64_t i = offset / APU_SAMPLE_CYCLES;
+    const int32_t *k = apu_blep[offset % APU_SAMPLE_CYCLES * APU_BLEP_PHASES /
+                                APU_SAMPLE_CYCLES];
+    for (uint32_t t = 0; t < APU_BLEP_TAPS; ++t) {
+        apu.delta[0][i + t] += left * k[t];
+        apu.delta[1][i + t] += right * k[t];
+    }
+}
+
+/* Direct Sound output from the FIFO samples and SOUNDCNT_H. 100% volume
+ * takes 8-bit samples to the full range. */
+static void apu_levels(uint64_t now)
+{
+    uint16_t cnt = IO_REG(IO_SOUNDCNT_H);
+    int32_t left = 0, right = 0;
+
+    if (IO_REG(IO_SOUNDCNT_X) & APU_CNTX_ENABLE) {
+        for (int n = 0; n < 2; ++n) {
+            int32_t s = apu.fifo[n].sample *
+                        (cnt & APU_CNT_DS_VOLUME(n) ? 16 : 8);
+            if (cnt & APU_CNT_DS_LEFT(n))
+                left += s;
+            if (cnt & APU_CNT_DS_RIGHT(n))
+                right += s;
+        }
+    }
+    apu_step(now, left - apu.level[0], right - apu.level[1]);
+    apu.level[0] = left;
+    apu.level[1] = right;
+}
+
+static void apu_fifo_push(apu_fifo_t *f, uint16_t val)
+{
+    for (int i = 0; i < 2 && f->count < sizeof(f->data); ++i)
+        f->data[(f->head + f->count++) & 31] = (int8_t)(val >> (i * 8));
+}
+
+/* Play the next sample. A FIFO half empty asks its DMA channel for 16
+ * more bytes. */
+static void apu_fifo_pop(int n)
+{
+    apu_fifo_t *f = &apu.fifo[n];
+    if (f->count > 0) {
+        f->sample = f->data[f->head];
+        f->head = (f->head + 1) & 31;
+        f->count--;
+    }
+    if (f->count <= 16)
+        dma_fifo_request(0x04000000 + (n ? IO_FIFO_B : IO_FIFO_A));
+}
+
+/* Overflow of timer 0 or 1, the FIFOs playing at its rate move on. */
+void apu_timer_overflow(int timer, uint64_t when)
+{
+    uint16_t cnt = IO_REG(IO_SOUNDCNT_H);
+    if (!(IO_REG(IO_SOUNDCNT_X) & APU_CNTX_ENABLE))
+        return;
+    for (int n = 0; n < 2; ++n) {
+        if (!(cnt & APU_CNT_DS_TIMER(n)) == (timer == 0))
+            apu_fifo_pop(n);
+    }
+    apu_levels(when);
+}
+
+/* Store to a sound register, 0x60 to 0xa7. The FIFOs are write-only. */
+void apu_write(uint32_t offset, uint16_t val)
+{
+    switch (offset) {
+        case IO_FIFO_A:
+        case IO_FIFO_A + 2:
+        case IO_FIFO_B:
+        case IO_FIFO_B + 2:
+            apu_fifo_push(&apu.fifo[offset >= IO_FIFO_B], val);
+            return;
+        case IO_SOUNDCNT_H:
+            for (int n = 0; n < 2; ++n) {
+                if (val & APU_CNT_DS_RESET(n))
+                    apu.fifo[n].count = 0;
+            }
+            IO_REG(offset) =
+                val & (uint16_t) ~(APU_CNT_DS_RESET(0) | APU_CNT_DS_RESET(1));
+            break;
+        case IO_SOUNDCNT_X:
+            /* The channel status bits are read-only. */
+            IO_REG(offset) = (uint16_t)((IO_REG(offset) & 0xf) |
+                                        (val & APU_CNTX_ENABLE));
+            break;
+        case IO_SOUNDBIAS:
+            IO_REG(offset) = val;
+            return;
+        default:
+            apu_psg_write(offset, val);
+            return;
+    }
+    apu_levels(arm.cycles);
+    apu_psg_levels(arm.cycles);
+}
+
+/* Mix what the frame played. apu.out holds it until the next frame. */
+void apu_end_frame(void)
+{
+    apu_psg_run(arm.cycles);
+    apu_mix(arm.cycles);
+    if (apu_output != NULL)
+        apu_ring_write(apu_output, apu.out, apu.out_len);
+}
+
+/* Where the sound of each frame goes, NULL for nowhere. The ring is read
+ * by a frontend or sink thread. */
+void apu_set_output(apu_ring_t *ring)
+{
+    apu_output = ring;
+}
+
+/* Host sample rate, 8 to 96 kHz. */
+void apu_set_rate(uint32_t rate)
+{
+    rate = rate < 8000 ? 8000 : rate > APU_HOST_RATE_MAX ? APU_HOST_RATE_MAX
+                                                          : rate;
+    apu.rate = rate;
+    apu.step = ((uint64_t)APU_RATE << 32) / rate;
+    apu_build_filter(0.9 * (rate < APU_RATE ? (double)rate / APU_RATE : 1.0));
+}
+
+void apu_init(void)
+{
+    memset(&apu, 0, sizeof(apu));
+    apu.time = arm.cycles;
+    apu_set_rate(APU_HOST_RATE);
+    apu_build_blep();
+    apu_psg_init();
+    IO_REG(IO_SOUNDBIAS) = 0x200;
+
+    apu_resample = apu_resample_scalar;
+#if defined(APU_X86) && defined(__SSE2__)
+    apu_resample = apu_resample_sse2;
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        apu_resample = apu_resample_avx2;
+#endif
+#endif
+}
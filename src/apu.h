@@ -0,0 +1,125 @@
+#ifndef APU_H
+#define APU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "apu_ring.h"
+
+/* Sound is mixed at the rate of the hardware's PWM output, then resampled
+ * to the host rate once per frame. */
+#define APU_RATE 32768
+#define APU_SAMPLE_CYCLES 512 /* GBA_CLOCK / APU_RATE */
+#define APU_HOST_RATE 48000
+#define APU_HOST_RATE_MAX 96000
+
+/* Resampler: windowed sinc with APU_TAPS taps in APU_PHASES phases. */
+#define APU_TAPS 16
+#define APU_PHASES 256
+
+/* Output levels are 12-bit, full scale for Direct Sound at 100%. Level
+ * changes are band-limited steps spread over
+ * APU_BLEP_TAPS native samples, in APU_BLEP_PHASES positions within a
+ * sample, and the mix carries APU_FRAC fraction bits. */
+#define APU_LEVEL_MAX 0x800
+#define APU_BLEP_TAPS 8
+#define APU_BLEP_PHASES 32
+#define APU_FRAC 13
+
+/* Native samples mixed at once, and host sample pairs a mix can yield. */
+#define APU_MIX_MAX 1024
+#define APU_OUT_MAX 4096
+
+/* SOUNDCNT_L */
+#define APU_CNTL_VOLUME_RIGHT(v) ((v) & 7u)
+#define APU_CNTL_VOLUME_LEFT(v) (((v) >> 4) & 7u)
+#define APU_CNTL_RIGHT(n) (1u << (8 + (n)))
+#define APU_CNTL_LEFT(n) (1u << (12 + (n)))
+
+/* SOUNDCNT_H */
+#define APU_CNT_PSG_VOLUME(v) ((v) & 3u) /* 25%, 50%, 100% */
+#define APU_CNT_DS_VOLUME(n) (1u << (2 + (n))) /* 100% instead of 50% */
+#define APU_CNT_DS_RIGHT(n) (1u << (8 + (n) * 4))
+#define APU_CNT_DS_LEFT(n) (1u << (9 + (n) * 4))
+#define APU_CNT_DS_TIMER(n) (1u << (10 + (n) * 4))
+#define APU_CNT_DS_RESET(n) (1u << (11 + (n) * 4))
+
+/* SOUNDCNT_X */
+#define APU_CNTX_ENABLE (1u << 7)
+
+/* Direct Sound FIFO, 32 signed 8-bit samples. */
+typedef struct {
+    int8_t data[32];
+    uint32_t head;
+    uint32_t count;
+    int8_t sample; /* being played */
+} apu_fifo_t;
+
+/* PSG channel: squares 1 and 2, wave and noise. */
+typedef struct {
+    bool on;
+    uint32_t volume;     /* envelope, 0 to 15 */
+    uint32_t env_timer;  /* 64 Hz ticks to the next envelope step */
+    uint32_t length;     /* 256 Hz ticks until the channel stops */
+    uint32_t sweep_timer; /* 128 Hz ticks to the next sweep, square 1 */
+    uint32_t freq;       /* frequency, the sweep's shadow for square 1 */
+    uint64_t period;     /* cycles per waveform step */
+    uint64_t next;       /* cycle of the next waveform step */
+    uint32_t pos;        /* duty step, wave sample or noise LFSR */
+    int32_t out;         /* signed output, -15 to 15 */
+} apu_psg_t;
+
+typedef struct {
+    apu_fifo_t fifo[2];
+
+    /* Output level changes are added as deltas at the native sample they
+     * happen in, so the mix only walks the samples once per frame. */
+    int32_t level[2]; /* Direct Sound part of the output, left and right */
+    int32_t sum[2];   /* output at time */
+    uint64_t time;    /* cycle of delta[][0] */
+    int32_t delta[2][APU_MIX_MAX + APU_BLEP_TAPS];
+
+    apu_psg_t psg[4];
+    int32_t psg_level[2]; /* PSG part of the output */
+    uint8_t wave[2][16];  /* wave RAM banks */
+
+    /* Host side, not in saved states. Native samples not consumed by the
+     * resampler yet. */
+    float in[2][APU_TAPS + APU_MIX_MAX];
+    uint32_t in_len;
+    uint64_t pos;  /* of the next host sample in in[][], 32.32 */
+    uint64_t step; /* APU_RATE / rate, 32.32 */
+    uint32_t rate;
+
+    /* Interleaved stereo host samples produced by the last frame, also
+     * written to the output ring if there is one. */
+    int16_t out[APU_OUT_MAX * 2];
+    uint32_t out_len;
+} apu_t;
+
+typedef size_t (*apu_resample_fn)(int16_t *dst, size_t max,
+                                  const float *left, const float *right,
+                                  size_t n, uint64_t *pos, uint64_t step);
+
+extern apu_t apu;
+extern apu_resample_fn apu_resample;
+
+void apu_init(void);
+void apu_set_rate(uint32_t rate);
+void apu_write(uint32_t offset, uint16_t val);
+void apu_timer_overflow(int timer, uint64_t when);
+void apu_end_frame(void);
+void apu_set_output(apu_ring_t *ring);
+void apu_step(uint64_t now, int32_t left, int32_t right);
+
+/* apu_psg.c */
+void apu_psg_init(void);
+void apu_psg_write(uint32_t offset, uint16_t val);
+void apu_psg_levels(uint64_t now);
+void apu_psg_run(uint64_t now);
+size_t apu_resample_scalar(int16_t *dst, size_t max, const float *left,
+                           const float *right, size_t n, uint64_t *pos,
+                           uint64_t step);
+
+#endif /* !APU_H */
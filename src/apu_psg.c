@@ -0,0 +1,388 @@
+#include <string.h>
+
+#include "apu.h"
+#include "arm.h"
+#include "io.h"
+#include "mmu.h"
+#include "sched.h"
+
+/* The frame sequencer clocks lengths at 256 Hz, the square 1 sweep at
+ * 128 Hz and envelopes at 64 Hz, from a 512 Hz step counter. */
+#define APU_SEQ_CYCLES 32768
+
+enum {
+    APU_SQUARE1,
+    APU_SQUARE2,
+    APU_WAVE,
+    APU_NOISE,
+};
+
+/* Registers of each channel: length and envelope, frequency and control. */
+static const uint32_t apu_psg_cnt[4][2] = {
+    {IO_SOUND1CNT_H, IO_SOUND1CNT_X},
+    {IO_SOUND2CNT_L, IO_SOUND2CNT_H},
+    {IO_SOUND3CNT_H, IO_SOUND3CNT_X},
+    {IO_SOUND4CNT_L, IO_SOUND4CNT_H},
+};
+
+/* Duty steps out of 8 that are high, 12.5% to 75%. */
+static const uint32_t apu_duty[4] = {1, 2, 4, 6};
+
+/* Wave output volume in quarters, from SOUND3CNT_H. */
+static const int32_t apu_wave_volume[4] = {0, 4, 2, 1};
+
+/* Channels change their output only at waveform steps, at register writes
+ * and at sequencer events. In between nothing is computed: the steps up
+ * to a time are generated when the mix or a write needs them, and each
+ * change of output is one band-limited step. */
+
+/* Output of a channel in [-15, 15] in its current step. */
+static int32_t apu_psg_output(int n)
+{
+    apu_psg_t *ch = &apu.psg[n];
+    int32_t v = (int32_t)ch->volume;
+
+    if (!ch->on)
+        return 0;
+    switch (n) {
+        case APU_SQUARE1:
+        case APU_SQUARE2: {
+            uint32_t duty = (IO_REG(apu_psg_cnt[n][0]) >> 6) & 3;
+            return ch->pos < apu_duty[duty] ? v : -v;
+        }
+        case APU_WAVE: {
+            uint16_t cnt = IO_REG(IO_SOUND3CNT_L);
+            uint16_t vol = IO_REG(IO_SOUND3CNT_H);
+            uint32_t bank = ((cnt >> 6) & 1) ^ (ch->pos >> 5);
+            uint8_t byte = apu.wave[bank][(ch->pos & 31) / 2];
+            int32_t s = ch->pos & 1 ? byte & 0xf : byte >> 4;
+            int32_t quarters =
+                vol & 0x8000 ? 3 : apu_wave_volume[(vol >> 13) & 3];
+            return (2 * s - 15) * quarters / 4;
+        }
+        default:
+            return ch->pos & 1 ? -v : v;
+    }
+}
+
+/* Routing and volume of a channel's output, as the change of the left and
+ * right levels per unit of output. */
+static void apu_psg_gain(int n, int32_t *left, int32_t *right)
+{
+    uint16_t cnt = IO_REG(IO_SOUNDCNT_L);
+    uint32_t shift = APU_CNT_PSG_VOLUME(IO_REG(IO_SOUNDCNT_H));
+    if (shift == 3)
+        shift = 0;
+    *left = cnt & APU_CNTL_LEFT(n)
+                ? (int32_t)((APU_CNTL_VOLUME_LEFT(cnt) + 1) << shift)
+                : 0;
+    *right = cnt & APU_CNTL_RIGHT(n)
+                 ? (int32_t)((APU_CNTL_VOLUME_RIGHT(cnt) + 1) << shift)
+                 : 0;
+}
+
+/* The output of channel n becomes out at cycle when. */
+static void apu_psg_set(int n, uint64_t when, int32_t out)
+{
+    apu_psg_t *ch = &apu.psg[n];
+    int32_t left, right;
+    if (out == ch->out)
+        return;
+    apu_psg_gain(n, &left, &right);
+    left *= out - ch->out;
+    right *= out - ch->out;
+    ch->out = out;
+    apu.psg_level[0] += left;
+    apu.psg_level[1] += right;
+    apu_step(when, left, right);
+}
+
+/* Duty steps from pos to the next edge of a square. */
+static uint32_t apu_psg_edge(uint32_t pos, uint32_t high)
+{
+    return (pos < high ? high : 8) - pos;
+}
+
+/* Take a channel to its next step, and set when the one after it is due.
+ * Squares only step at the edges of their duty cycle. */
+static void apu_psg_advance(int n)
+{
+    apu_psg_t *ch = &apu.psg[n];
+    switch (n) {
+        case APU_SQUARE1:
+        case APU_SQUARE2: {
+            uint32_t high = apu_duty[(IO_REG(apu_psg_cnt[n][0]) >> 6) & 3];
+            ch->pos = (ch->pos + apu_psg_edge(ch->pos, high)) & 7;
+            ch->next += apu_psg_edge(ch->pos, high) * ch->period;
+            break;
+        }
+        case APU_WAVE: {
+            uint16_t cnt = IO_REG(IO_SOUND3CNT_L);
+            ch->pos = (ch->pos + 1) & (cnt & 0x20 ? 63 : 31);
+            ch->next += ch->period;
+            break;
+        }
+        default: {
+            /* The LFSR shifts right, the new bit is the xor of the two
+             * lowest. Bit 0 inverted is the output. */
+            bool narrow = IO_REG(IO_SOUND4CNT_H) & 8;
+            uint32_t bit = (ch->pos ^ (ch->pos >> 1)) & 1;
+            ch->pos = ch->pos >> 1 | bit << (narrow ? 6 : 14);
+            ch->next += ch->period;
+            break;
+        }
+    }
+}
+
+static void apu_psg_run_channel(int n, uint64_t now)
+{
+    apu_psg_t *ch = &apu.psg[n];
+    if (!ch->on || ch->period == 0)
+        return;
+    while (ch->next <= now) {
+        uint64_t when = ch->next;
+        apu_psg_advance(n);
+        apu_psg_set(n, when, apu_psg_output(n));
+    }
+}
+
+/* Generate the output of all channels up to cycle now. */
+void apu_psg_run(uint64_t now)
+{
+    for (int n = 0; n < 4; ++n)
+        apu_psg_run_channel(n, now);
+}
+
+static void apu_psg_status(void)
+{
+    uint16_t status = 0;
+    for (int n = 0; n < 4; ++n)
+        status |= (uint16_t)(apu.psg[n].on << n);
+    IO_REG(IO_SOUNDCNT_X) =
+        (uint16_t)((IO_REG(IO_SOUNDCNT_X) & ~0xfu) | status);
+}
+
+static void apu_psg_stop(int n, uint64_t now)
+{
+    apu.psg[n].on = false;
+    apu_psg_set(n, now, 0);
+    apu_psg_status();
+}
+
+/* Cycles per waveform step from the frequency registers. */
+static uint64_t apu_psg_period(int n, uint32_t freq)
+{
+    uint16_t cnt = IO_REG(apu_psg_cnt[n][1]);
+    switch (n) {
+        case APU_SQUARE1:
+        case APU_SQUARE2:
+            return (2048 - (uint64_t)freq) * 16;
+        case APU_WAVE:
+            return (2048 - (uint64_t)freq) * 8;
+        default: {
+            /* 524288 Hz divided by r, or r = 0.5, and 2^(s + 1). */
+            uint64_t r = cnt & 7;
+            return (r ? r * 32 : 16) << (((cnt >> 4) & 0xf) + 1);
+        }
+    }
+}
+
+/* The sweep's next frequency from the shadow one, past 2047 stops the
+ * channel. */
+static uint32_t apu_psg_sweep_freq(void)
+{
+    uint16_t sweep = IO_REG(IO_SOUND1CNT_L);
+    uint32_t delta = apu.psg[APU_SQUARE1].freq >> (sweep & 7);
+    return sweep & 8 ? apu.psg[APU_SQUARE1].freq - delta
+                     : apu.psg[APU_SQUARE1].freq + delta;
+}
+
+/* Count down a sequencer timer, true when it expires and reloads. */
+static bool apu_psg_tick(uint32_t *timer, uint32_t reload)
+{
+    if (*timer > 1) {
+        --*timer;
+        return false;
+    }
+    *timer = reload;
+    return true;
+}
+
+static bool apu_psg_needs_sequencer(void)
+{
+    for (int n = 0; n < 4; ++n) {
+        apu_psg_t *ch = &apu.psg[n];
+        if (!ch->on)
+            continue;
+        if (IO_REG(apu_psg_cnt[n][1]) & 0x4000)
+            return true;
+        if (n != APU_WAVE && (IO_REG(apu_psg_cnt[n][0]) & 0x700))
+            return true;
+        if (n == APU_SQUARE1 && (IO_REG(IO_SOUND1CNT_L) & 0x70))
+            return true;
+    }
+    return false;
+}
+
+/* Run the sequencer only while a channel has a length, envelope or sweep
+ * to clock. Its steps are counted from cycle 0. */
+static void apu_psg_schedule(uint64_t now)
+{
+    if (apu_psg_needs_sequencer()) {
+        sched_schedule(SCHED_PSG,
+                       (now / APU_SEQ_CYCLES + 1) * APU_SEQ_CYCLES);
+    } else {
+        sched_cancel(SCHED_PSG);
+    }
+}
+
+static void apu_psg_sequencer(uint64_t when)
+{
+    uint32_t step = (uint32_t)(when / APU_SEQ_CYCLES) & 7;
+
+    apu_psg_run(when);
+    for (int n = 0; n < 4; ++n) {
+        apu_psg_t *ch = &apu.psg[n];
+        uint16_t env = IO_REG(apu_psg_cnt[n][0]);
+        if (!ch->on)
+            continue;
+        if (!(step & 1) && (IO_REG(apu_psg_cnt[n][1]) & 0x4000) &&
+            apu_psg_tick(&ch->length, 0)) {
+            apu_psg_stop(n, when);
+            continue;
+        }
+        if (n == APU_SQUARE1 && (step == 2 || step == 6) &&
+            (IO_REG(IO_SOUND1CNT_L) & 0x70) &&
+            apu_psg_tick(&ch->sweep_timer, (IO_REG(IO_SOUND1CNT_L) >> 4) & 7)) {
+            uint16_t sweep = IO_REG(IO_SOUND1CNT_L);
+            uint32_t freq = apu_psg_sweep_freq();
+            if (freq > 2047) {
+                apu_psg_stop(n, when);
+                continue;
+            }
+            if (sweep & 7) {
+                ch->freq = freq;
+                ch->period = apu_psg_period(n, freq);
+            }
+        }
+        if (n != APU_WAVE && step == 7 && (env & 0x700) &&
+            apu_psg_tick(&ch->env_timer, (env >> 8) & 7)) {
+            if ((env & 0x800) && ch->volume < 15)
+                ch->volume++;
+            else if (!(env & 0x800) && ch->volume > 0)
+                ch->volume--;
+            apu_psg_set(n, when, apu_psg_output(n));
+        }
+    }
+    apu_psg_schedule(when);
+}
+
+/* Start a channel over, with bit 15 of its control register. */
+static void apu_psg_restart(int n, uint64_t now)
+{
+    apu_psg_t *ch = &apu.psg[n];
+    uint16_t env = IO_REG(apu_psg_cnt[n][0]);
+    uint16_t cnt = IO_REG(apu_psg_cnt[n][1]);
+
+    ch->on = true;
+    ch->volume = env >> 12;
+    ch->env_timer = (env >> 8) & 7;
+    if (ch->length == 0)
+        ch->length = n == APU_WAVE ? 256 : 64;
+    ch->freq = cnt & 0x7ff;
+    ch->period = apu_psg_period(n, ch->freq);
+    ch->pos = n == APU_NOISE ? (cnt & 8 ? 0x7f : 0x7fff) : 0;
+    ch->next = now + ch->period;
+    if (n <= APU_SQUARE2)
+        ch->next = now + apu_psg_edge(0, apu_duty[(env >> 6) & 3]) * ch->period;
+    if (n == APU_SQUARE1) {
+        uint16_t sweep = IO_REG(IO_SOUND1CNT_L);
+        ch->sweep_timer = (sweep >> 4) & 7;
+        if ((sweep & 7) && apu_psg_sweep_freq() > 2047)
+            ch->on = false;
+    }
+    /* With volume 0 going down, or wave playback off, the DAC is off. */
+    if (n == APU_WAVE ? !(IO_REG(IO_SOUND3CNT_L) & 0x80)
+                      : !(env & 0xf800))
+        ch->on = false;
+    if (!(IO_REG(IO_SOUNDCNT_X) & APU_CNTX_ENABLE))
+        ch->on = false;
+    apu_psg_set(n, now, apu_psg_output(n));
+    apu_psg_status();
+}
+
+/* Store to a PSG register or wave RAM. The channels are brought up to
+ * date first, so the change takes effect from now on. */
+void apu_psg_write(uint32_t offset, uint16_t val)
+{
+    uint64_t now = arm.cycles;
+
+    apu_psg_run(now);
+    if (offset >= IO_WAVE_RAM) {
+        /* The CPU sees the bank not being played. */
+        uint32_t bank = ((IO_REG(IO_SOUND3CNT_L) >> 6) & 1) ^ 1;
+        memcpy(&apu.wave[bank][offset - IO_WAVE_RAM], &val, sizeof(val));
+        IO_REG(offset) = val;
+        return;
+    }
+    IO_REG(offset) = val;
+    if (offset == IO_SOUNDCNT_L) {
+        apu_psg_levels(now);
+        return;
+    }
+    for (int n = 0; n < 4; ++n) {
+        apu_psg_t *ch = &apu.psg[n];
+        if (offset == apu_psg_cnt[n][0]) {
+            /* Length, and for wave the volume. */
+            uint32_t len = val & (n == APU_WAVE ? 0xff : 0x3f);
+            ch->length = (n == APU_WAVE ? 256 : 64) - len;
+            if (n != APU_WAVE && !(val & 0xf800) && ch->on)
+                apu_psg_stop(n, now);
+        } else if (offset == apu_psg_cnt[n][1]) {
+            if (val & 0x8000) {
+                apu_psg_restart(n, now);
+            } else if (ch->on) {
+                ch->freq = val & 0x7ff;
+                ch->period = apu_psg_period(n, ch->freq);
+            }
+        } else {
+            continue;
+        }
+        apu_psg_set(n, now, apu_psg_output(n));
+    }
+    if (offset == IO_SOUND3CNT_L && !(val & 0x80) && apu.psg[APU_WAVE].on)
+        apu_psg_stop(APU_WAVE, now);
+    apu_psg_schedule(now);
+}
+
+/* SOUNDCNT_L, SOUNDCNT_H or the master enable changed: step to the output
+ * the channels now add up to. */
+void apu_psg_levels(uint64_t now)
+{
+    int32_t level[2] = {0, 0};
+
+    apu_psg_run(now);
+    if (!(IO_REG(IO_SOUNDCNT_X) & APU_CNTX_ENABLE)) {
+        for (int n = 0; n < 4; ++n)
+            apu.psg[n].on = false;
+        apu_psg_status();
+    }
+    for (int n = 0; n < 4; ++n) {
+        int32_t left, right;
+        if (!apu.psg[n].on)
+            apu.psg[n].out = 0;
+        apu_psg_gain(n, &left, &right);
+        level[0] += left * apu.psg[n].out;
+        level[1] += right * apu.psg[n].out;
+    }
+    apu_step(now, level[0] - apu.psg_level[0], level[1] - apu.psg_level[1]);
+    apu.psg_level[0] = level[0];
+    apu.psg_level[1] = level[1];
+    apu_psg_schedule(now);
+}
+
+void apu_psg_init(void)
+{
+    sched_set_handler(SCHED_PSG, apu_psg_sequencer);
+    sched_cancel(SCHED_PSG);
+}
@@ -0,0 +1,200 @@
+#include "apu_ring.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apu.h"
+
+int apu_ring_init(apu_ring_t *ring, size_t size)
+{
+    memset(ring, 0, sizeof(*ring));
+    if (size == 0 || (size & (size - 1)))
+        return -1;
+    ring->data = calloc(size * 2, sizeof(ring->data[0]));
+    if (ring->data == NULL)
+        return -1;
+    ring->size = size;
+    return 0;
+}
+
+void apu_ring_free(apu_ring_t *ring)
+{
+    free(ring->data);
+    ring->data = NULL;
+}
+
+static void apu_ring_copy_in(apu_ring_t *ring, uint64_t pos,
+                             const int16_t *src, size_t n)
+{
+    size_t at = (size_t)pos & (ring->size - 1);
+    size_t first = n < ring->size - at ? n : ring->size - at;
+    memcpy(&ring->data[at * 2], src, first * 4);
+    memcpy(ring->data, &src[first * 2], (n - first) * 4);
+}
+
+static void apu_ring_copy_out(apu_ring_t *ring, int16_t *dst, uint64_t pos,
+                              size_t n)
+{
+    size_t at = (size_t)pos & (ring->size - 1);
+    size_t first = n < ring->size - at ? n : ring->size - at;
+    memcpy(dst, &ring->data[at * 2], first * 4);
+    memcpy(&dst[first * 2], ring->data, (n - first) * 4);
+}
+
+/* Producer side, returns the sample pairs stored. A lossless ring takes
+ * at most its size at a time. */
+size_t apu_ring_write(apu_ring_t *ring, const int16_t *src, size_t n)
+{
+    static const struct timespec nap = {0, 1000000};
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t room = ring->size - (size_t)(head - tail);
+
+    while (ring->lossless && n > room && n <= ring->size) {
+        nanosleep(&nap, NULL);
+        tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        room = ring->size - (size_t)(head - tail);
+    }
+    if (n > room) {
+        atomic_fetch_add_explicit(&ring->dropped, n - room,
+                                  memory_order_relaxed);
+        n = room;
+    }
+    apu_ring_copy_in(ring, head, src, n);
+    atomic_store_explicit(&ring->head, head + n, memory_order_release);
+    return n;
+}
+
+/* Consumer side, returns the sample pairs read. */
+size_t apu_ring_read(apu_ring_t *ring, int16_t *dst, size_t max)
+{
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t n = (size_t)(head - tail) < max ? (size_t)(head - tail) : max;
+
+    apu_ring_copy_out(ring, dst, tail, n);
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+    return n;
+}
+
+size_t apu_ring_used(apu_ring_t *ring)
+{
+    return (size_t)(atomic_load(&ring->head) - atomic_load(&ring->tail));
+}
+
+/* About 20 s at 48 kHz, so that the writer can fall behind a fast-forward
+ * run for a while before the emulation has to wait for it. */
+#define APU_SINK_RING (1u << 20)
+#define APU_SINK_CHUNK 4096
+
+static struct {
+    apu_ring_t ring;
+    FILE *file;
+    bool wav;
+    uint32_t rate;
+    uint64_t bytes;
+    bool failed; /* a write came short */
+    atomic_bool stop;
+    pthread_t thread;
+} sink;
+
+static void apu_put32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        p[i] = (uint8_t)(v >> (i * 8));
+}
+
+/* 16-bit stereo PCM, the sizes are filled in on close. */
+static int apu_sink_header(uint32_t data_bytes)
+{
+    uint8_t h[44];
+    memcpy(h, "RIFF\0\0\0\0WAVEfmt ", 16);
+    apu_put32(&h[4], 36 + data_bytes);
+    apu_put32(&h[16], 16);
+    apu_put32(&h[20], 1 | 2u << 16);
+    apu_put32(&h[24], sink.rate);
+    apu_put32(&h[28], sink.rate * 4);
+    apu_put32(&h[32], 4 | 16u << 16);
+    memcpy(&h[36], "data", 4);
+    apu_put32(&h[40], data_bytes);
+    return fwrite(h, 1, sizeof(h), sink.file) == sizeof(h) ? 0 : -1;
+}
+
+static void *apu_sink_thread(void *arg)
+{
+    static int16_t buf[APU_SINK_CHUNK * 2];
+    const struct timespec nap = {0, 2000000};
+    (void)arg;
+    for (;;) {
+        /* Checked before draining, so nothing written before stop is
+         * left behind. */
+        bool stop = atomic_load(&sink.stop);
+        size_t n;
+        while ((n = apu_ring_read(&sink.ring, buf, APU_SINK_CHUNK)) > 0) {
+            size_t done = fwrite(buf, 4, n, sink.file);
+            sink.bytes += done * 4;
+            sink.failed |= done != n;
+        }
+        if (stop)
+            return NULL;
+        nanosleep(&nap, NULL);
+    }
+}
+
+/* Stream the sound of every frame to path, a WAV file unless the name
+ * ends in .raw, for raw little-endian samples. Nothing is dropped, so the
+ * file is the same however fast the disk is. */
+int apu_sink_open(const char *path, uint32_t rate)
+{
+    size_t len = strlen(path);
+
+    apu_sink_close();
+    if (apu_ring_init(&sink.ring, APU_SINK_RING) != 0)
+        return -1;
+    sink.ring.lossless = true;
+    sink.file = fopen(path, "wb");
+    if (sink.file == NULL) {
+        apu_ring_free(&sink.ring);
+        return -1;
+    }
+    sink.wav = len < 4 || strcmp(&path[len - 4], ".raw") != 0;
+    sink.rate = rate;
+    sink.bytes = 0;
+    sink.failed = false;
+    if (sink.wav && apu_sink_header(0) != 0)
+        sink.failed = true;
+    atomic_store(&sink.stop, false);
+    if (pthread_create(&sink.thread, NULL, apu_sink_thread, NULL) != 0) {
+        fclose(sink.file);
+        sink.file = NULL;
+        apu_ring_free(&sink.ring);
+        return -1;
+    }
+    apu_set_output(&sink.ring);
+    return 0;
+}
+
+/* Flush and close the file. Returns -1 when any of the sound did not
+ * make it to the file. */
+int apu_sink_close(void)
+{
+    if (sink.file == NULL)
+        return 0;
+    apu_set_output(NULL);
+    atomic_store(&sink.stop, true);
+    pthread_join(sink.thread, NULL);
+    if (sink.wav && (fseek(sink.file, 0, SEEK_SET) != 0 ||
+                     apu_sink_header((uint32_t)sink.bytes) != 0))
+        sink.failed = true;
+    if (fclose(sink.file) != 0)
+        sink.failed = true;
+    sink.file = NULL;
+    if (atomic_load(&sink.ring.dropped) != 0)
+        sink.failed = true;
+    apu_ring_free(&sink.ring);
+    return sink.failed ? -1 : 0;
+}
@@ -0,0 +1,34 @@
+#ifndef APU_RING_H
+#define APU_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Single producer, single consumer ring of interleaved stereo samples.
+ * The emulation thread writes whole frames of sound. For a frontend it
+ * never waits: what does not fit is dropped and counted. A lossless ring
+ * makes it wait for room instead, for output that has to be the same
+ * from run to run. head is only written by the producer and tail by the
+ * consumer. */
+typedef struct {
+    int16_t *data;
+    size_t size; /* sample pairs, a power of two */
+    bool lossless;
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    _Atomic uint64_t dropped; /* sample pairs */
+} apu_ring_t;
+
+int apu_ring_init(apu_ring_t *ring, size_t size);
+void apu_ring_free(apu_ring_t *ring);
+size_t apu_ring_write(apu_ring_t *ring, const int16_t *src, size_t n);
+size_t apu_ring_read(apu_ring_t *ring, int16_t *dst, size_t max);
+size_t apu_ring_used(apu_ring_t *ring);
+
+/* Headless output to a file, written by a thread of its own. */
+int apu_sink_open(const char *path, uint32_t rate);
+int apu_sink_close(void);
+
+#endif /* !APU_RING_H */
@@ -6,9 +6,11 @@
 #include <string.h>
 
 #include "arm_isa.h"
+#include "irq.h"
 #include "mmu.h"
+#include "sched.h"
+#include "stats.h"
 
-#define CPU_DEBUG /* debugs are enabled for now */
 #ifdef CPU_DEBUG
 #include "arm_debug.h"
 #endif
@@ -87,16 +89,119 @@ void arm_reset(void)
     arm.r[PC] = 0;
 }
 
+/* Where a mode keeps its SP and LR while another mode runs. */
+static void arm_bank(uint32_t mode, uint32_t **sp, uint32_t **lr)
+{
+    switch (mode) {
+        case ARM_PSR_FIQ_MODE:
+            *sp = &arm.r13_fiq;
+            *lr = &arm.r14_fiq;
+            break;
+        case ARM_PSR_IRQ_MODE:
+            *sp = &arm.r13_irq;
+            *lr = &arm.r14_irq;
+            break;
+        case ARM_PSR_SVC_MODE:
+            *sp = &arm.r13_svc;
+            *lr = &arm.r14_svc;
+            break;
+        case ARM_PSR_ABT_MODE:
+            *sp = &arm.r13_abt;
+            *lr = &arm.r14_abt;
+            break;
+        case ARM_PSR_UND_MODE:
+            *sp = &arm.r13_und;
+            *lr = &arm.r14_und;
+            break;
+        default:
+            *sp = &arm.r13_usr;
+            *lr = &arm.r14_usr;
+            break;
+    }
+}
+
+/* Switch to another mode, swapping in its banked registers. */
+void arm_set_mode(uint32_t mode)
+{
+    uint32_t *old_sp, *old_lr, *sp, *lr;
+    arm_bank(arm.cpsr.mode, &old_sp, &old_lr);
+    arm_bank(mode, &sp, &lr);
+    if (sp != old_sp) {
+        *old_sp = arm.r[SP];
+        *old_lr = arm.r[LR];
+        arm.r[SP] = *sp;
+        arm.r[LR] = *lr;
+    }
+    if ((arm.cpsr.mode == ARM_PSR_FIQ_MODE) != (mode == ARM_PSR_FIQ_MODE)) {
+        uint32_t *usr[5] = {&arm.r8_usr, &arm.r9_usr, &arm.r10_usr,
+                            &arm.r11_usr, &arm.r12_usr};
+        uint32_t *fiq[5] = {&arm.r8_fiq, &arm.r9_fiq, &arm.r10_fiq,
+                            &arm.r11_fiq, &arm.r12_fiq};
+        uint32_t **save = mode == ARM_PSR_FIQ_MODE ? usr : fiq;
+        uint32_t **load = mode == ARM_PSR_FIQ_MODE ? fiq : usr;
+        for (int i = 0; i < 5; ++i) {
+            *save[i] = arm.r[R8 + i];
+            arm.r[R8 + i] = *load[i];
+        }
+    }
+    arm.cpsr.mode = mode & 0x1f;
+}
+
+/* Registers the BIOS IRQ handler saves on the IRQ stack. */
+static const int arm_irq_saved[] = {R0, R1, R2, R3, R12, LR};
+
+#define ARM_IRQ_FRAME (sizeof(arm_irq_saved) / sizeof(arm_irq_saved[0]) * 4)
+
+/* Take the IRQ exception before the instruction at PC, and do what the
+ * BIOS handler does: save r0-r3, r12 and LR on the IRQ stack, then call
+ * the game's handler with r0 pointing to the I/O registers. */
+void arm_irq(void)
+{
+    arm_psr_t cpsr = arm.cpsr;
+    uint32_t ret = arm.r[PC] + 4;
+    arm_set_mode(ARM_PSR_IRQ_MODE);
+    arm.r[LR] = ret;
+    arm.spsr_irq = cpsr;
+    arm.cpsr.t = 0;
+    arm.cpsr.i = 1;
+
+    uint32_t sp = arm.r[SP] - (uint32_t)ARM_IRQ_FRAME;
+    for (size_t i = 0; i < ARM_IRQ_FRAME / 4; ++i)
+        mmu_write_word(sp + (uint32_t)i * 4, arm.r[arm_irq_saved[i]]);
+    arm.r[SP] = sp;
+    arm.r[R0] = 0x04000000;
+    arm.r[LR] = ARM_BIOS_IRQ_RETURN;
+    arm.r[PC] = mmu_read_word(ARM_IRQ_HANDLER) & ~3u;
+}
+
+/* The rest of the BIOS handler, reached when the game's handler returns:
+ * restore the registers and return from the exception. */
+void arm_irq_return(void)
+{
+    uint32_t sp = arm.r[SP];
+    for (size_t i = 0; i < ARM_IRQ_FRAME / 4; ++i)
+        arm.r[arm_irq_saved[i]] = mmu_read_word(sp + (uint32_t)i * 4);
+    arm.r[SP] = sp + (uint32_t)ARM_IRQ_FRAME;
+    arm_psr_t spsr = arm.spsr_irq;
+    uint32_t pc = arm.r[LR] - 4;
+    arm_set_mode(spsr.mode);
+    arm.cpsr = spsr;
+    arm.r[PC] = pc;
+    /* Another interrupt may have come in meanwhile. */
+    irq_update();
+}
+
 static uint32_t arm_fetch(void)
 {
     uint32_t pc = arm.r[PC];
-    uint32_t addr = arm.cpsr.t ? pc >> 1 : pc >> 2;
-    return mmu_read_word(addr);
+    arm.r[PC] = pc + 4;
+    return mmu_fetch_word(pc);
 }
 
 static void arm_execute(void)
 {
     uint32_t opcode = arm_fetch();
+    arm.cycles++;
     if (evaluate_cond(opcode >> 28, arm.cpsr)) {
         uint32_t code = ((opcode >> 16) & 0xff0) | ((opcode >> 4) & 0x0f);
 #ifdef CPU_DEBUG
@@ -110,3 +215,11 @@ void arm_step(void)
 {
     arm_execute();
 }
+
+/* Run until the given cycle or the next scheduled event. */
+void arm_run(uint64_t until)
+{
+    STATS_SCOPE(STATS_CPU);
+    while (arm.cycles < until && arm.cycles < sched.next)
+        arm_execute();
+}
@@ -21,6 +21,14 @@ typedef union {
 typedef struct {
     /* ARM-state general registers */
     uint32_t r[16];
+    /* The user registers while another mode banks them */
+    uint32_t r8_usr;
+    uint32_t r9_usr;
+    uint32_t r10_usr;
+    uint32_t r11_usr;
+    uint32_t r12_usr;
+    uint32_t r13_usr;
+    uint32_t r14_usr;
     uint32_t r8_fiq;
     uint32_t r9_fiq;
     uint32_t r10_fiq;
@@ -45,6 +53,7 @@ typedef struct {
     arm_psr_t spsr_und;
     /* Internal variables */
     uint32_t shift_carry;
+    uint64_t cycles;
 } arm_t;
 
 extern arm_t arm;
@@ -59,6 +68,10 @@ extern arm_t arm;
 #define R6 6
 #define R7 7
 #define R8 8
+#define R9 9
+#define R10 10
+#define R11 11
+#define R12 12
 #define SP 13
 #define LR 14
 #define PC 15
@@ -86,8 +99,19 @@ extern arm_t arm;
 #define ARM_PSR_ZERO (1u << ARM_PSR_ZERO_SHIFT)
 #define ARM_PSR_NEGATIVE (1u << ARM_PSR_NEGATIVE_SHIFT)
 
+/* There is no BIOS image. Its IRQ handler is done by arm_irq(), the game's
+ * handler returns to an undefined opcode the MMU places where the BIOS
+ * would restore the registers. */
+#define ARM_BIOS_IRQ_RETURN 0x138
+#define ARM_OPCODE_IRQ_RETURN 0xe7f000f0u
+#define ARM_IRQ_HANDLER 0x03fffffc /* mirror of 0x03007ffc */
+
 void arm_init(void);
 void arm_reset(void);
+void arm_set_mode(uint32_t mode);
+void arm_irq(void);
+void arm_irq_return(void);
 void arm_step(void);
+void arm_run(uint64_t until);
 
 #endif /* !ARM_H */
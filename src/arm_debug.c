@@ -112,11 +112,31 @@ static void arm_debug_dp_rd(uint32_t opcode)
     printf("%s%s r%u, %s\n", code, s, rd, operand2);
 }
 
+static void arm_debug_branch(uint32_t opcode)
+{
+    const char *l = opcode & 0x1000000 ? "l" : "";
+    int32_t offset = (int32_t)(opcode << 8) >> 6;
+    printf("b%s #%d\n", l, offset + 8);
+}
+
+static void arm_debug_bx(uint32_t opcode)
+{
+    printf("bx r%u\n", opcode & 0xf);
+}
+
+static void arm_debug_irq_return(uint32_t opcode)
+{
+    (void)opcode;
+    printf("bios irq return\n");
+}
+
 /* clang-format off */
 
 static void (*instr_debug[0xfff])(uint32_t opcode) = {
     [0x000 ... 0x0ff] = arm_debug_dp_rd_rn,
-    [0x100 ... 0x17f] = arm_debug_dp_rn,
+    [0x100 ... 0x120] = arm_debug_dp_rn,
+    [0x121] = arm_debug_bx,
+    [0x122 ... 0x17f] = arm_debug_dp_rn,
     [0x180 ... 0x19f] = arm_debug_dp_rd_rn,
     [0x1a0 ... 0x1bf] = arm_debug_dp_rd,
     [0x1c0 ... 0x1df] = arm_debug_dp_rd_rn,
@@ -127,6 +147,8 @@ static void (*instr_debug[0xfff])(uint32_t opcode) = {
     [0x3a0 ... 0x3bf] = arm_debug_dp_rd,
     [0x3c0 ... 0x3df] = arm_debug_dp_rd_rn,
     [0x3e0 ... 0x3ff] = arm_debug_dp_rd,
+    [0x7ff] = arm_debug_irq_return,
+    [0xa00 ... 0xbff] = arm_debug_branch,
 };
 
 /* clang-format on */
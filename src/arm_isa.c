@@ -1,5 +1,6 @@
 #include "arm_isa.h"
 #include "arm.h"
+#include "arm_prof.h"
 
 /* Get register from opcode offset. */
 #define OPCODE_REG(offset) ((opcode >> offset) & 0xfu)
@@ -780,6 +781,43 @@ static void mvns_imm(uint32_t opcode) { DP_CCL(DP_OPER_MVN(dp_imm)); }
 
 /* clang-format on */
 
+/* Sign extended branch offset in bytes. */
+#define BRANCH_OFFSET(opcode) ((uint32_t)((int32_t)((opcode) << 8) >> 6))
+
+/* B <offset> */
+static void b(uint32_t opcode)
+{
+    arm.r[PC] += 4 + BRANCH_OFFSET(opcode);
+    arm.cycles += 2;
+}
+
+/* BL <offset> */
+static void bl(uint32_t opcode)
+{
+    arm.r[LR] = arm.r[PC];
+    arm.r[PC] += 4 + BRANCH_OFFSET(opcode);
+    arm.cycles += 2;
+    ARM_PROF_CALL(arm.r[PC], arm.r[LR]);
+}
+
+/* BX Rm */
+static void bx(uint32_t opcode)
+{
+    uint32_t addr = arm.r[OPCODE_REG(0)];
+    if (OPCODE_REG(0) == LR)
+        ARM_PROF_RETURN(addr);
+    arm.cpsr.t = addr & 1;
+    arm.r[PC] = addr & ~1u;
+    arm.cycles += 2;
+}
+
+/* ARM_OPCODE_IRQ_RETURN in the BIOS, see arm_irq(). */
+static void irq_return(uint32_t opcode)
+{
+    (void)opcode;
+    arm_irq_return();
+}
+
 arm_instr_t arm_instr[0xfff] = {
     /* 0x000 ... 0x01f */ INSTR_DP_REG(and),
     /* 0x020 ... 0x03f */ INSTR_DP_REG(eor),
@@ -790,7 +828,14 @@ arm_instr_t arm_instr[0xfff] = {
     /* 0x0c0 ... 0x0df */ INSTR_DP_REG(sbc),
     /* 0x0e0 ... 0x0ff */ INSTR_DP_REG(rsc),
     /* 0x100 ... 0x11f */ INSTR_DP_REG_NO_RD(tst),
-    /* 0x120 ... 0x13f */ INSTR_DP_REG_NO_RD(teq),
+    /* 0x120 ... 0x12f */ teq_lsl_imm, bx, teq_lsr_imm, teq_lsr_reg,
+    teq_asr_imm, teq_asr_reg, teq_ror_imm, teq_ror_reg, teq_lsl_imm,
+    teq_lsl_reg, teq_lsr_imm, teq_lsr_reg, teq_asr_imm, teq_asr_reg,
+    teq_ror_imm, teq_ror_reg,
+    /* 0x130 ... 0x13f */ teq_lsl_imm, teq_lsl_reg, teq_lsr_imm, teq_lsr_reg,
+    teq_asr_imm, teq_asr_reg, teq_ror_imm, teq_ror_reg, teq_lsl_imm,
+    teq_lsl_reg, teq_lsr_imm, teq_lsr_reg, teq_asr_imm, teq_asr_reg,
+    teq_ror_imm, teq_ror_reg,
     /* 0x140 ... 0x15f */ INSTR_DP_REG_NO_RD(cmp),
     /* 0x160 ... 0x17f */ INSTR_DP_REG_NO_RD(cmn),
     /* 0x180 ... 0x19f */ INSTR_DP_REG(orr),
@@ -825,4 +870,7 @@ arm_instr_t arm_instr[0xfff] = {
     [0x3d0 ... 0x3df] = bics_imm,
     [0x3e0 ... 0x3ef] = mvn_imm,
     [0x3f0 ... 0x3ff] = mvns_imm,
+    [0x7ff] = irq_return,
+    [0xa00 ... 0xaff] = b,
+    [0xb00 ... 0xbff] = bl,
 };
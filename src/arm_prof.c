@@ -0,0 +1,190 @@
+#include "arm_prof.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "arm.h"
+
+#define PROF_MAX_NODES 4096
+#define PROF_MAX_DEPTH 256
+
+/* Calling context tree node, node 0 is the root. */
+typedef struct {
+    uint32_t addr;     /* function entry address */
+    uint32_t parent;   /* caller node */
+    uint32_t child;    /* first callee node, 0 if none */
+    uint32_t sibling;  /* next callee of the parent, 0 if none */
+    uint32_t calls;    /* number of times entered */
+    uint64_t incl;     /* cycles spent in the function and its callees */
+    uint64_t children; /* cycles spent in callees */
+} prof_node_t;
+
+/* Shadow call stack frame. */
+typedef struct {
+    uint32_t node;
+    uint32_t ret;   /* expected return address */
+    uint64_t entry; /* cycle count at entry */
+} prof_frame_t;
+
+static struct {
+    prof_node_t nodes[PROF_MAX_NODES];
+    uint32_t num_nodes;
+    prof_frame_t stack[PROF_MAX_DEPTH];
+    uint32_t depth;
+    uint32_t dropped;
+} prof;
+
+bool arm_prof_enabled;
+
+void arm_prof_start(void)
+{
+    memset(&prof, 0, sizeof(prof));
+    prof.nodes[0].addr = arm.r[PC];
+    prof.nodes[0].calls = 1;
+    prof.num_nodes = 1;
+    prof.stack[0].ret = UINT32_MAX;
+    prof.stack[0].entry = arm.cycles;
+    prof.depth = 1;
+    arm_prof_enabled = true;
+}
+
+void arm_prof_stop(void)
+{
+    arm_prof_enabled = false;
+}
+
+static uint32_t prof_find_child(uint32_t parent, uint32_t addr)
+{
+    uint32_t n;
+    for (n = prof.nodes[parent].child; n != 0; n = prof.nodes[n].sibling) {
+        if (prof.nodes[n].addr == addr)
+            return n;
+    }
+    if (prof.num_nodes == PROF_MAX_NODES)
+        return 0;
+    n = prof.num_nodes++;
+    prof.nodes[n].addr = addr;
+    prof.nodes[n].parent = parent;
+    prof.nodes[n].sibling = prof.nodes[parent].child;
+    prof.nodes[parent].child = n;
+    return n;
+}
+
+void arm_prof_call(uint32_t target, uint32_t ret)
+{
+    if (prof.depth == PROF_MAX_DEPTH) {
+        prof.dropped++;
+        return;
+    }
+    uint32_t node = prof_find_child(prof.stack[prof.depth - 1].node, target);
+    if (node == 0) {
+        prof.dropped++;
+        return;
+    }
+    prof.nodes[node].calls++;
+    prof.stack[prof.depth].node = node;
+    prof.stack[prof.depth].ret = ret;
+    prof.stack[prof.depth].entry = arm.cycles;
+    prof.depth++;
+}
+
+/* Charge the cycles of the frame at index i up to now. */
+static void prof_charge(uint32_t i)
+{
+    uint64_t cycles = arm.cycles - prof.stack[i].entry;
+    prof.nodes[prof.stack[i].node].incl += cycles;
+    if (i > 0)
+        prof.nodes[prof.stack[i - 1].node].children += cycles;
+    prof.stack[i].entry = arm.cycles;
+}
+
+void arm_prof_return(uint32_t target)
+{
+    /* Unwind to the frame expecting this return address, so that frames
+     * left by tail calls or longjmp-style exits do not pile up. */
+    uint32_t i = prof.depth;
+    while (i > 1) {
+        if (prof.stack[--i].ret == target) {
+            while (prof.depth > i)
+                prof_charge(--prof.depth);
+            return;
+        }
+    }
+}
+
+static void prof_flush(void)
+{
+    for (uint32_t i = prof.depth; i > 0; --i)
+        prof_charge(i - 1);
+}
+
+static void prof_print_path(FILE *f, uint32_t n)
+{
+    if (n != 0) {
+        prof_print_path(f, prof.nodes[n].parent);
+        fputc(';', f);
+    }
+    fprintf(f, "0x%08x", prof.nodes[n].addr);
+}
+
+/* Output in the folded stack format read by flamegraph.pl. */
+void arm_prof_dump_folded(FILE *f)
+{
+    prof_flush();
+    for (uint32_t n = 0; n < prof.num_nodes; ++n) {
+        prof_node_t *node = &prof.nodes[n];
+        uint64_t self = node->incl - node->children;
+        if (self == 0)
+            continue;
+        prof_print_path(f, n);
+        fprintf(f, " %" PRIu64 "\n", self);
+    }
+}
+
+static bool prof_is_recursive(uint32_t n)
+{
+    uint32_t addr = prof.nodes[n].addr;
+    while (n != 0) {
+        n = prof.nodes[n].parent;
+        if (prof.nodes[n].addr == addr)
+            return true;
+    }
+    return false;
+}
+
+static uint32_t prof_first_node(uint32_t addr)
+{
+    uint32_t n = 0;
+    while (prof.nodes[n].addr != addr)
+        ++n;
+    return n;
+}
+
+/* Output inclusive and exclusive cycles per function. */
+void arm_prof_dump_flat(FILE *f)
+{
+    prof_flush();
+    fprintf(f, "%-10s %10s %16s %16s\n", "function", "calls", "inclusive",
+            "exclusive");
+    for (uint32_t n = 0; n < prof.num_nodes; ++n) {
+        uint32_t addr = prof.nodes[n].addr;
+        uint32_t calls = 0;
+        uint64_t incl = 0, excl = 0;
+        if (prof_first_node(addr) != n)
+            continue;
+        for (uint32_t m = n; m < prof.num_nodes; ++m) {
+            prof_node_t *node = &prof.nodes[m];
+            if (node->addr != addr)
+                continue;
+            calls += node->calls;
+            excl += node->incl - node->children;
+            /* Nested activations are already part of the outer one. */
+            if (!prof_is_recursive(m))
+                incl += node->incl;
+        }
+        fprintf(f, "0x%08x %10u %16" PRIu64 " %16" PRIu64 "\n", addr, calls,
+                incl, excl);
+    }
+    if (prof.dropped)
+        fprintf(f, "%u calls dropped\n", prof.dropped);
+}
@@ -0,0 +1,38 @@
+#ifndef ARM_PROF_H
+#define ARM_PROF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+extern bool arm_prof_enabled;
+
+void arm_prof_start(void);
+void arm_prof_stop(void);
+void arm_prof_call(uint32_t target, uint32_t ret);
+void arm_prof_return(uint32_t target);
+void arm_prof_dump_folded(FILE *f);
+void arm_prof_dump_flat(FILE *f);
+
+/* Hooks for the branch handlers, compiled out unless CPU_PROFILE is set. */
+#ifdef CPU_PROFILE
+#define ARM_PROF_CALL(target, ret)             \
+    do {                                       \
+        if (arm_prof_enabled)                  \
+            arm_prof_call((target), (ret));    \
+    } while (0)
+#define ARM_PROF_RETURN(target)                \
+    do {                                       \
+        if (arm_prof_enabled)                  \
+            arm_prof_return((target));         \
+    } while (0)
+#else
+#define ARM_PROF_CALL(target, ret) \
+    do {                           \
+    } while (0)
+#define ARM_PROF_RETURN(target) \
+    do {                        \
+    } while (0)
+#endif
+
+#endif /* !ARM_PROF_H */
@@ -5,6 +5,7 @@
 #define M4(val) ((uint32_t)val & 0xfu)
 #define M5(val) ((uint32_t)val & 0x1fu)
 #define M8(val) ((uint32_t)val & 0xffu)
+#define M24(val) ((uint32_t)val & 0xffffffu)
 
 static uint32_t enc_shift(shift_t *s)
 {
@@ -29,3 +30,14 @@ uint32_t arm_enc_dp(cond_t cond, uint32_t opcode, bool s, reg_t rd, reg_t rn,
     return M4(cond) << 28 | M4(opcode) << 21 | M1(o->is_imm_val) << 25 |
            M1(s) << 20 | M4(rn) << 16 | M4(rd) << 12 | oper2;
 }
+
+/* Offset is relative to the branch instruction address plus 8. */
+uint32_t arm_enc_branch(cond_t cond, bool link, int32_t offset)
+{
+    return M4(cond) << 28 | 0x5u << 25 | M1(link) << 24 | M24(offset >> 2);
+}
+
+uint32_t arm_enc_bx(cond_t cond, reg_t rm)
+{
+    return M4(cond) << 28 | 0x012fff10u | M4(rm);
+}
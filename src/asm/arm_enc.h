@@ -75,5 +75,7 @@ typedef struct {
 
 uint32_t arm_enc_dp(cond_t cond, uint32_t opcode, bool s, reg_t rd, reg_t rn,
                     oper2_t *o);
+uint32_t arm_enc_branch(cond_t cond, bool link, int32_t offset);
+uint32_t arm_enc_bx(cond_t cond, reg_t rm);
 
 #endif /* ARM_ENC_H */
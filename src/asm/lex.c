@@ -22,8 +22,11 @@ static struct keyword {
     { "ands", TOKEN_KW_ANDS },
     { "asl", TOKEN_KW_ASL },
     { "asr", TOKEN_KW_ASR },
+    { "b", TOKEN_KW_B },
     { "bic", TOKEN_KW_BIC },
     { "bics", TOKEN_KW_BICS },
+    { "bl", TOKEN_KW_BL },
+    { "bx", TOKEN_KW_BX },
     { "cmn", TOKEN_KW_CMN },
     { "cmp", TOKEN_KW_CMP },
     { "eor", TOKEN_KW_EOR },
@@ -88,6 +91,8 @@ static int lex_readc(lex_t *l)
 
 static int lex_ungetc(lex_t *l, int c)
 {
+    if (c == '\n')
+        l->line--;
     l->col--;
     return ungetc(c, l->input);
 }
@@ -130,7 +135,7 @@ static token_t *read_keyword(lex_t *l, int c)
         token_type_t tok_type;
         char *tok_str;
         c = lex_readc(l);
-        if (isalnum(c)) {
+        if (isalnum(c) || c == '_') {
             str_append(str, (char)c);
             continue;
         }
@@ -138,10 +143,14 @@ static token_t *read_keyword(lex_t *l, int c)
         str_append(str, '\0');
         tok_str = str_destroy(str);
         tok_type = get_token_type(tok_str);
-        free(tok_str);
         if (tok_type == TOKEN_IDENT) {
-            return token_create(TOKEN_KW_INVALID);
+            if (!isalpha(tok_str[0]) && tok_str[0] != '_') {
+                free(tok_str);
+                return token_create(TOKEN_KW_INVALID);
+            }
+            return token_create_string(TOKEN_IDENT, tok_str);
         }
+        free(tok_str);
         return token_create(tok_type);
     }
 }
@@ -172,7 +181,14 @@ token_t *lex_next_token(lex_t *l)
     switch (c) {
         case ',':
         case '#':
+        case ':':
             return token_create(c);
+        case '@':
+        case ';':
+            /* Comment until the end of the line. */
+            while ((c = lex_readc(l)) != EOF && c != '\n')
+                ;
+            return c == EOF ? NULL : token_create(TOKEN_END);
         case '0':
         case '1':
         case '2':
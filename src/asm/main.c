@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include "parser.h"
+
+int main(int argc, char **argv)
+{
+    parser_t p;
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s input.s output.gba\n", argv[0]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "r");
+    if (in == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    FILE *out = fopen(argv[2], "wb");
+    if (out == NULL) {
+        perror(argv[2]);
+        fclose(in);
+        return 1;
+    }
+    parser_init(&p, in, out);
+    int ret = parser_exec(&p);
+    parser_print_error(&p, ret);
+    fclose(in);
+    fclose(out);
+    if (ret != PARSER_OK) {
+        remove(argv[2]);
+        return 1;
+    }
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include "parser.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include "arm_enc.h"
 
 #define CHK(f)               \
@@ -14,14 +15,27 @@ int parser_init(parser_t *p, FILE *input, FILE *output)
 {
     lex_init(&p->l, input);
     p->out = output;
+    p->pushback = NULL;
+    p->num_labels = 0;
+    p->num_fixups = 0;
     return 0;
 }
 
 static token_t *parser_next_token(parser_t *p)
 {
+    token_t *tok = p->pushback;
+    if (tok) {
+        p->pushback = NULL;
+        return tok;
+    }
     return lex_next_token(&p->l);
 }
 
+static void parser_unget_token(parser_t *p, token_t *tok)
+{
+    p->pushback = tok;
+}
+
 static token_type_t parser_next_token_type(parser_t *p)
 {
     token_type_t type;
@@ -162,7 +176,9 @@ static int parse_imm_val(parser_t *p, imm_val_t *imm_val)
 static int parse_shift(parser_t *p, token_type_t tok_type, shift_t *shift)
 {
     CHK(parse_reg(tok_type, &shift->rm));
-    if (parser_next_token_type(p) == ',') {
+    token_t *tok = parser_next_token(p);
+    if (tok && tok->type == ',') {
+        token_destroy(tok);
         CHK(parse_shift_type(parser_next_token_type(p), &shift->type));
         if (shift->type == SHIFT_TYPE_RRX) {
             shift->type = SHIFT_TYPE_ROR;
@@ -188,6 +204,8 @@ static int parse_shift(parser_t *p, token_type_t tok_type, shift_t *shift)
             CHK(parse_reg(type, &shift->rs));
         }
     } else {
+        /* No shift, leave the end of the statement to the caller. */
+        parser_unget_token(p, tok);
         shift->is_register = 0;
         shift->type = 0;
         shift->amount = 0;
@@ -267,11 +285,107 @@ static int parse_cmd_dp_rd(parser_t *p, uint32_t opcode, bool s)
     return out_u32(p->out, arm_enc_dp(COND_AL, opcode, s, rd, 0, &oper2));
 }
 
+static parser_label_t *find_label(parser_t *p, const char *name)
+{
+    for (int i = 0; i < p->num_labels; ++i) {
+        if (strcmp(p->labels[i].name, name) == 0)
+            return &p->labels[i];
+    }
+    return NULL;
+}
+
+static int parse_label(parser_t *p, token_t *tok)
+{
+    if (parser_next_token_type(p) != ':')
+        return PARSER_ERR_CMD;
+    if (find_label(p, tok->s) != NULL || p->num_labels == PARSER_MAX_LABELS ||
+        strlen(tok->s) >= PARSER_LABEL_LEN)
+        return PARSER_ERR_LABEL;
+    parser_label_t *label = &p->labels[p->num_labels++];
+    strcpy(label->name, tok->s);
+    label->pos = ftell(p->out);
+    return PARSER_OK;
+}
+
+static int parse_cmd_branch(parser_t *p, bool link)
+{
+    long pos = ftell(p->out);
+    token_t *tok = parser_next_token(p);
+    if (tok == NULL || tok->type != TOKEN_IDENT) {
+        token_destroy(tok);
+        return PARSER_ERR_SYNTAX;
+    }
+    parser_label_t *label = find_label(p, tok->s);
+    int32_t offset = 0;
+    if (label) {
+        offset = (int32_t)(label->pos - (pos + 8));
+    } else if (p->num_fixups < PARSER_MAX_LABELS &&
+               strlen(tok->s) < PARSER_LABEL_LEN) {
+        parser_fixup_t *fixup = &p->fixups[p->num_fixups++];
+        strcpy(fixup->name, tok->s);
+        fixup->pos = pos;
+        fixup->link = link;
+        fixup->checkpoint = p->l.checkpoint;
+        fixup->line = p->l.line;
+    } else {
+        token_destroy(tok);
+        return PARSER_ERR_LABEL;
+    }
+    token_destroy(tok);
+    if (parser_next_token_type(p) != TOKEN_END) {
+        return PARSER_ERR_SYNTAX;
+    }
+    return out_u32(p->out, arm_enc_branch(COND_AL, link, offset));
+}
+
+static int parse_cmd_bx(parser_t *p)
+{
+    reg_t rm;
+    CHK(parse_reg(parser_next_token_type(p), &rm));
+    if (parser_next_token_type(p) != TOKEN_END) {
+        return PARSER_ERR_SYNTAX;
+    }
+    return out_u32(p->out, arm_enc_bx(COND_AL, rm));
+}
+
+static int resolve_fixups(parser_t *p)
+{
+    long end = ftell(p->out);
+    for (int i = 0; i < p->num_fixups; ++i) {
+        parser_fixup_t *fixup = &p->fixups[i];
+        parser_label_t *label = find_label(p, fixup->name);
+        if (label == NULL) {
+            p->l.checkpoint = fixup->checkpoint;
+            p->l.last_tok_line = fixup->line;
+            p->l.last_tok_col = 1;
+            return PARSER_ERR_LABEL;
+        }
+        int32_t offset = (int32_t)(label->pos - (fixup->pos + 8));
+        fseek(p->out, fixup->pos, SEEK_SET);
+        out_u32(p->out, arm_enc_branch(COND_AL, fixup->link, offset));
+    }
+    fseek(p->out, end, SEEK_SET);
+    return PARSER_OK;
+}
+
 static int parse_cmd(parser_t *p, token_t *tok)
 {
     token_type_t tok_type = tok->type;
+    if (tok_type == TOKEN_IDENT) {
+        int ret = parse_label(p, tok);
+        token_destroy(tok);
+        return ret;
+    }
     token_destroy(tok);
     switch (tok_type) {
+        case TOKEN_END:
+            return PARSER_OK;
+        case TOKEN_KW_B:
+            return parse_cmd_branch(p, false);
+        case TOKEN_KW_BL:
+            return parse_cmd_branch(p, true);
+        case TOKEN_KW_BX:
+            return parse_cmd_bx(p);
         case TOKEN_KW_AND:
             return parse_cmd_dp_rd_rn(p, 0x0, false);
         case TOKEN_KW_ANDS:
@@ -343,7 +457,7 @@ int parser_exec(parser_t *p)
         }
         lex_checkpoint(&p->l);
     }
-    return PARSER_OK;
+    return resolve_fixups(p);
 }
 
 static const char *parser_strerror(int error)
@@ -359,6 +473,8 @@ static const char *parser_strerror(int error)
             return "shift expression is too large";
         case PARSER_ERR_INVALID_CONSTANT:
             return "invalid constant after fixup";
+        case PARSER_ERR_LABEL:
+            return "invalid or undefined label";
         default:
             return "unknown error";
     }
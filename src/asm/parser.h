@@ -1,6 +1,7 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stdbool.h>
 #include "lex.h"
 
 enum {
@@ -9,11 +10,35 @@ enum {
     PARSER_ERR_SYNTAX,
     PARSER_ERR_SHIFT,
     PARSER_ERR_INVALID_CONSTANT,
+    PARSER_ERR_LABEL,
 };
 
+#define PARSER_MAX_LABELS 128
+#define PARSER_LABEL_LEN 32
+
+typedef struct {
+    char name[PARSER_LABEL_LEN];
+    long pos;
+} parser_label_t;
+
+/* Branch to a label not defined yet, patched at the end. */
+typedef struct {
+    char name[PARSER_LABEL_LEN];
+    long pos;
+    bool link;
+    /* Source position for error reporting */
+    long checkpoint;
+    int line;
+} parser_fixup_t;
+
 typedef struct {
     lex_t l;
     FILE *out;
+    token_t *pushback;
+    parser_label_t labels[PARSER_MAX_LABELS];
+    int num_labels;
+    parser_fixup_t fixups[PARSER_MAX_LABELS];
+    int num_fixups;
 } parser_t;
 
 int parser_init(parser_t *p, FILE *input, FILE *output);
@@ -18,5 +18,7 @@ token_t *token_create_string(token_type_t type, char *s)
 
 void token_destroy(token_t *t)
 {
+    if (t)
+        free(t->s);
     free(t);
 }
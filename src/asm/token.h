@@ -34,8 +34,11 @@ typedef enum {
     TOKEN_KW_ADDS,
     TOKEN_KW_AND,
     TOKEN_KW_ANDS,
+    TOKEN_KW_B,
     TOKEN_KW_BIC,
     TOKEN_KW_BICS,
+    TOKEN_KW_BL,
+    TOKEN_KW_BX,
     TOKEN_KW_CMN,
     TOKEN_KW_CMP,
     TOKEN_KW_EOR,
@@ -0,0 +1,407 @@
+#include "backup.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Time without writes after which dirty save data is written out. */
+#define BACKUP_SETTLE_MS 500
+
+#define FLASH_ID_64K 0x1b32  /* Panasonic MN63F805MNP */
+#define FLASH_ID_128K 0x1362 /* Sanyo LE26FV10N1TS */
+
+enum {
+    FLASH_READY,
+    FLASH_CMD1, /* received 0xaa at 0x5555 */
+    FLASH_CMD2, /* received 0x55 at 0x2aaa */
+};
+
+backup_t backup = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .save_lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static const struct {
+    const char *id;
+    backup_type_t type;
+} backup_ids[] = {
+    {"EEPROM_V", BACKUP_EEPROM},      {"SRAM_V", BACKUP_SRAM},
+    {"SRAM_F_V", BACKUP_SRAM},        {"FLASH_V", BACKUP_FLASH_64K},
+    {"FLASH512_V", BACKUP_FLASH_64K}, {"FLASH1M_V", BACKUP_FLASH_128K},
+};
+
+/* Look for the library ID string the SDK links into the ROM, which is
+ * word aligned. */
+backup_type_t backup_detect(const uint8_t *rom, size_t size)
+{
+    for (size_t i = 0; i + 12 <= size; i += 4) {
+        if (rom[i] != 'E' && rom[i] != 'S' && rom[i] != 'F')
+            continue;
+        for (size_t j = 0; j < sizeof(backup_ids) / sizeof(backup_ids[0]);
+             ++j) {
+            size_t len = strlen(backup_ids[j].id);
+            if (memcmp(&rom[i], backup_ids[j].id, len) == 0)
+                return backup_ids[j].type;
+        }
+    }
+    return BACKUP_NONE;
+}
+
+static uint32_t backup_type_size(backup_type_t type)
+{
+    switch (type) {
+        case BACKUP_SRAM:
+            return BACKUP_SRAM_SIZE;
+        case BACKUP_FLASH_64K:
+            return 0x10000;
+        case BACKUP_FLASH_128K:
+            return 0x20000;
+        default:
+            return 0;
+    }
+}
+
+static void backup_load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return;
+    size_t size = fread(backup.data, 1, sizeof(backup.data), f);
+    fclose(f);
+    /* An existing save tells the EEPROM size before the game does. */
+    if (backup.type == BACKUP_EEPROM &&
+        (size == BACKUP_EEPROM_512 || size == BACKUP_EEPROM_8K))
+        backup.size = (uint32_t)size;
+}
+
+/* Write the current contents, returns 0 when there was nothing to do.
+ * The flush thread and the emulation thread both save, one at a time so
+ * that a newer save cannot be overtaken by an older one. */
+static int backup_save(void)
+{
+    static uint8_t snapshot[BACKUP_MAX_SIZE];
+    pthread_mutex_lock(&backup.save_lock);
+    pthread_mutex_lock(&backup.lock);
+    uint64_t generation = atomic_load(&backup.generation);
+    uint32_t size = backup.size;
+    if (generation == backup.saved || size == 0 || backup.path == NULL) {
+        pthread_mutex_unlock(&backup.lock);
+        pthread_mutex_unlock(&backup.save_lock);
+        return 0;
+    }
+    memcpy(snapshot, backup.data, size);
+    size_t len = strlen(backup.path);
+    char *tmp = malloc(len + 5);
+    if (tmp != NULL) {
+        memcpy(tmp, backup.path, len);
+        memcpy(tmp + len, ".tmp", 5);
+    }
+    pthread_mutex_unlock(&backup.lock);
+    if (tmp == NULL) {
+        pthread_mutex_unlock(&backup.save_lock);
+        return -1;
+    }
+
+    /* Replace the file atomically so a crash leaves the previous save. */
+    int ret = -1;
+    FILE *f = fopen(tmp, "wb");
+    if (f != NULL) {
+        size_t n = fwrite(snapshot, 1, size, f);
+        if (fclose(f) == 0 && n == size && rename(tmp, backup.path) == 0)
+            ret = 0;
+    }
+    if (ret != 0) {
+        perror(tmp);
+        remove(tmp);
+    } else {
+        pthread_mutex_lock(&backup.lock);
+        backup.saved = generation;
+        pthread_mutex_unlock(&backup.lock);
+    }
+    pthread_mutex_unlock(&backup.save_lock);
+    free(tmp);
+    return ret;
+}
+
+static void backup_settle_deadline(struct timespec *ts)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_nsec += BACKUP_SETTLE_MS * 1000000L;
+    ts->tv_sec += ts->tv_nsec / 1000000000L;
+    ts->tv_nsec %= 1000000000L;
+}
+
+/* Sleeps until the contents are changed, then saves once there has been
+ * no write for BACKUP_SETTLE_MS. */
+static void *backup_thread(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&backup.lock);
+    while (!backup.stop) {
+        uint64_t seen = atomic_load(&backup.generation);
+        if (seen == backup.saved) {
+            pthread_cond_wait(&backup.cond, &backup.lock);
+            continue;
+        }
+        /* Later writes do not signal, the generation is only looked at
+         * again once the wait is over. */
+        struct timespec ts;
+        backup_settle_deadline(&ts);
+        int ret = 0;
+        while (!backup.stop && ret != ETIMEDOUT)
+            ret = pthread_cond_timedwait(&backup.cond, &backup.lock, &ts);
+        if (backup.stop || atomic_load(&backup.generation) != seen)
+            continue;
+        pthread_mutex_unlock(&backup.lock);
+        backup_save();
+        pthread_mutex_lock(&backup.lock);
+    }
+    pthread_mutex_unlock(&backup.lock);
+    return NULL;
+}
+
+int backup_open(backup_type_t type, const char *path)
+{
+    backup_close();
+    backup.type = type;
+    backup.size = backup_type_size(type);
+    memset(backup.data, 0xff, sizeof(backup.data));
+    memset(&backup.flash, 0, sizeof(backup.flash));
+    memset(&backup.eeprom, 0, sizeof(backup.eeprom));
+    backup.eeprom.out_pos = 68;
+    atomic_store(&backup.generation, 0);
+    backup.saved = 0;
+    backup.stop = false;
+    if (type == BACKUP_NONE || path == NULL)
+        return 0;
+
+    backup.path = strdup(path);
+    if (backup.path == NULL)
+        return -1;
+    backup_load(path);
+    if (pthread_create(&backup.thread, NULL, backup_thread, NULL) != 0)
+        return -1;
+    backup.thread_running = true;
+    return 0;
+}
+
+void backup_close(void)
+{
+    if (backup.thread_running) {
+        pthread_mutex_lock(&backup.lock);
+        backup.stop = true;
+        pthread_cond_signal(&backup.cond);
+        pthread_mutex_unlock(&backup.lock);
+        pthread_join(backup.thread, NULL);
+        backup.thread_running = false;
+    }
+    backup_save();
+    free(backup.path);
+    backup.path = NULL;
+    backup.type = BACKUP_NONE;
+}
+
+int backup_flush(void)
+{
+    return backup_save();
+}
+
+/* Count a write, with backup.lock held. Only the first one since the last
+ * save wakes the flush thread, so a burst of writes costs one wakeup. */
+static void backup_touch(void)
+{
+    if (atomic_fetch_add(&backup.generation, 1) == backup.saved)
+        pthread_cond_signal(&backup.cond);
+}
+
+static void backup_store(uint32_t offset, uint8_t val)
+{
+    pthread_mutex_lock(&backup.lock);
+    backup.data[offset] = val;
+    backup_touch();
+    pthread_mutex_unlock(&backup.lock);
+}
+
+static void backup_fill(uint32_t offset, uint32_t size)
+{
+    pthread_mutex_lock(&backup.lock);
+    memset(&backup.data[offset], 0xff, size);
+    backup_touch();
+    pthread_mutex_unlock(&backup.lock);
+}
+
+static uint8_t flash_read(uint32_t offset)
+{
+    if (backup.flash.id && offset < 2) {
+        uint16_t id =
+            backup.type == BACKUP_FLASH_128K ? FLASH_ID_128K : FLASH_ID_64K;
+        return (uint8_t)(id >> (offset * 8));
+    }
+    return backup.data[backup.flash.bank * 0x10000 + offset];
+}
+
+static void flash_command(uint32_t offset, uint8_t val)
+{
+    if (offset != 0x5555) {
+        /* Sector erase takes the sector address instead. */
+        if (val == 0x30 && backup.flash.erase) {
+            backup_fill(backup.flash.bank * 0x10000 + (offset & 0xf000),
+                        0x1000);
+            backup.flash.erase = false;
+        }
+        return;
+    }
+    switch (val) {
+        case 0x90:
+            backup.flash.id = true;
+            break;
+        case 0xf0:
+            backup.flash.id = false;
+            break;
+        case 0x80:
+            backup.flash.erase = true;
+            break;
+        case 0x10:
+            if (backup.flash.erase)
+                backup_fill(0, backup.size);
+            backup.flash.erase = false;
+            break;
+        case 0xa0:
+            backup.flash.write = true;
+            break;
+        case 0xb0:
+            backup.flash.bank_select = backup.type == BACKUP_FLASH_128K;
+            break;
+        default:
+            break;
+    }
+}
+
+static void flash_write(uint32_t offset, uint8_t val)
+{
+    if (backup.flash.write) {
+        backup_store(backup.flash.bank * 0x10000 + offset, val);
+        backup.flash.write = false;
+        return;
+    }
+    if (backup.flash.bank_select && offset == 0) {
+        backup.flash.bank = val & 1;
+        backup.flash.bank_select = false;
+        return;
+    }
+    switch (backup.flash.state) {
+        case FLASH_READY:
+            if (offset == 0x5555 && val == 0xaa)
+                backup.flash.state = FLASH_CMD1;
+            break;
+        case FLASH_CMD1:
+            backup.flash.state =
+                offset == 0x2aaa && val == 0x55 ? FLASH_CMD2 : FLASH_READY;
+            break;
+        case FLASH_CMD2:
+            backup.flash.state = FLASH_READY;
+            flash_command(offset, val);
+            break;
+    }
+}
+
+/* SRAM and flash sit on an 8-bit bus in 0x0e000000-0x0fffffff. */
+uint8_t backup_read(uint32_t addr)
+{
+    switch (backup.type) {
+        case BACKUP_SRAM:
+            return backup.data[addr & (BACKUP_SRAM_SIZE - 1)];
+        case BACKUP_FLASH_64K:
+        case BACKUP_FLASH_128K:
+            return flash_read(addr & 0xffff);
+        default:
+            return 0xff;
+    }
+}
+
+void backup_write(uint32_t addr, uint8_t val)
+{
+    switch (backup.type) {
+        case BACKUP_SRAM:
+            backup_store(addr & (BACKUP_SRAM_SIZE - 1), val);
+            break;
+        case BACKUP_FLASH_64K:
+        case BACKUP_FLASH_128K:
+            flash_write(addr & 0xffff, val);
+            break;
+        default:
+            break;
+    }
+}
+
+static uint32_t eeprom_bits(uint32_t start, uint32_t n)
+{
+    uint32_t val = 0;
+    for (uint32_t i = start; i < start + n; ++i)
+        val = val << 1 | backup.eeprom.bits[i];
+    return val;
+}
+
+/* Run the command shifted in so far. Requests are 2 command bits, a 6 or
+ * 14 bit block address, 64 data bits for writes and a stop bit, so an
+ * EEPROM of unknown size learns it from the first request. */
+static void eeprom_command(void)
+{
+    uint32_t n = backup.eeprom.num_bits;
+    bool read = n >= 2 && backup.eeprom.bits[0] && backup.eeprom.bits[1];
+    bool write = n >= 2 && backup.eeprom.bits[0] && !backup.eeprom.bits[1];
+    uint32_t addr_bits = read ? n - 3 : n - 67;
+    backup.eeprom.num_bits = 0;
+    if ((!read && !write) || n < 3 || (write && n < 67))
+        return;
+    if (backup.size == 0 && (addr_bits == 6 || addr_bits == 14))
+        backup.size = addr_bits == 6 ? BACKUP_EEPROM_512 : BACKUP_EEPROM_8K;
+    if (addr_bits != (backup.size == BACKUP_EEPROM_512 ? 6u : 14u))
+        return;
+
+    uint32_t offset = (eeprom_bits(2, addr_bits) * 8) & (backup.size - 1);
+    if (read) {
+        uint64_t out = 0;
+        for (int i = 0; i < 8; ++i)
+            out = out << 8 | backup.data[offset + (uint32_t)i];
+        backup.eeprom.out = out;
+        backup.eeprom.out_pos = 0;
+        return;
+    }
+    for (uint32_t i = 0; i < 8; ++i)
+        backup_store(offset + i, (uint8_t)eeprom_bits(2 + addr_bits + i * 8, 8));
+}
+
+uint16_t backup_eeprom_read(void)
+{
+    if (backup.eeprom.num_bits > 0)
+        eeprom_command();
+    /* 4 junk bits then the 64 data bits, 1 means ready otherwise. */
+    if (backup.eeprom.out_pos >= 68)
+        return 1;
+    uint32_t pos = backup.eeprom.out_pos++;
+    if (pos < 4)
+        return 0;
+    return (uint16_t)((backup.eeprom.out >> (63 - (pos - 4))) & 1);
+}
+
+void backup_eeprom_write(uint16_t val)
+{
+    backup.eeprom.out_pos = 68;
+    if (backup.eeprom.num_bits < sizeof(backup.eeprom.bits))
+        backup.eeprom.bits[backup.eeprom.num_bits++] = val & 1;
+}
+
+/* Take the chip state and contents of a saved state, rewind point or
+ * instance. They are not written out: the save file only follows the
+ * game's own writes, so going back and forth between states leaves it
+ * alone. */
+void backup_restore(const void *state)
+{
+    pthread_mutex_lock(&backup.lock);
+    memcpy(&backup, state, BACKUP_STATE_SIZE);
+    pthread_mutex_unlock(&backup.lock);
+}
@@ -0,0 +1,79 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BACKUP_MAX_SIZE 0x20000
+#define BACKUP_SRAM_SIZE 0x8000
+#define BACKUP_EEPROM_512 0x200
+#define BACKUP_EEPROM_8K 0x2000
+
+/* EEPROM is mapped at the top of the ROM area, in all of 0x0d000000 for
+ * cartridges up to 16MiB and only in the last 256 bytes above that. */
+#define BACKUP_EEPROM_ADDR(rom_size) \
+    ((rom_size) > 0x1000000 ? 0x0dffff00u : 0x0d000000u)
+
+typedef enum {
+    BACKUP_NONE,
+    BACKUP_SRAM,
+    BACKUP_FLASH_64K,
+    BACKUP_FLASH_128K,
+    BACKUP_EEPROM,
+} backup_type_t;
+
+typedef struct {
+    backup_type_t type;
+    uint32_t size; /* 0 for an EEPROM until its size is known */
+    uint8_t data[BACKUP_MAX_SIZE];
+
+    struct {
+        int state;
+        bool id;
+        bool erase;
+        bool write;
+        bool bank_select;
+        uint32_t bank;
+    } flash;
+
+    struct {
+        uint8_t bits[96]; /* serial command being received */
+        uint32_t num_bits;
+        uint64_t out;     /* data being sent back */
+        uint32_t out_pos; /* bits sent, reading while below 68 */
+    } eeprom;
+
+    /* Writes bump the generation under the lock, and the first write
+     * after a save signals cond. The flush thread saves once it stops
+     * changing so that a burst of writes costs one save. Saves from any
+     * thread hold save_lock throughout. */
+    pthread_mutex_t lock;
+    pthread_mutex_t save_lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool thread_running;
+    bool stop;
+    atomic_uint_fast64_t generation;
+    uint64_t saved;
+    char *path;
+} backup_t;
+
+/* Chip state and contents, the part of backup_t in saved states. */
+#define BACKUP_STATE_SIZE offsetof(backup_t, lock)
+
+extern backup_t backup;
+
+backup_type_t backup_detect(const uint8_t *rom, size_t size);
+int backup_open(backup_type_t type, const char *path);
+void backup_close(void);
+int backup_flush(void);
+uint8_t backup_read(uint32_t addr);
+void backup_write(uint32_t addr, uint8_t val);
+uint16_t backup_eeprom_read(void);
+void backup_eeprom_write(uint16_t val);
+void backup_restore(const void *state);
+
+#endif /* !BACKUP_H */
@@ -0,0 +1,108 @@
+#include "cart.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mmu.h"
+
+/* Open mappings, keyed by device and inode. */
+static cart_t *carts;
+static pthread_mutex_t carts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static cart_t *cart_find(dev_t dev, ino_t ino)
+{
+    for (cart_t *c = carts; c != NULL; c = c->next) {
+        if (c->dev == dev && c->ino == ino)
+            return c;
+    }
+    return NULL;
+}
+
+/* Map the file over a zeroed reservation so that the page-rounded tail
+ * reads as zero instead of faulting past the end of the file. */
+static const uint8_t *cart_map(int fd, size_t size, size_t map_size)
+{
+    uint8_t *base = mmap(NULL, map_size, PROT_READ,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    if (mmap(base, size, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0) ==
+        MAP_FAILED) {
+        munmap(base, map_size);
+        return NULL;
+    }
+    return base;
+}
+
+cart_t *cart_open(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size <= 0 || st.st_size > MMU_ROM_MAX_SIZE) {
+        fprintf(stderr, "%s: invalid ROM size\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&carts_lock);
+    cart_t *cart = cart_find(st.st_dev, st.st_ino);
+    if (cart != NULL) {
+        cart->refs++;
+        goto out;
+    }
+    cart = calloc(1, sizeof(*cart));
+    if (cart == NULL)
+        goto out;
+    cart->dev = st.st_dev;
+    cart->ino = st.st_ino;
+    cart->size = (size_t)st.st_size;
+    cart->map_size = (cart->size + MMU_PAGE_MASK) & ~(size_t)MMU_PAGE_MASK;
+    cart->data = cart_map(fd, cart->size, cart->map_size);
+    if (cart->data == NULL) {
+        perror(path);
+        free(cart);
+        cart = NULL;
+        goto out;
+    }
+    cart->refs = 1;
+    cart->next = carts;
+    carts = cart;
+out:
+    pthread_mutex_unlock(&carts_lock);
+    close(fd);
+    return cart;
+}
+
+void cart_close(cart_t *cart)
+{
+    if (cart == NULL)
+        return;
+    pthread_mutex_lock(&carts_lock);
+    if (--cart->refs > 0) {
+        pthread_mutex_unlock(&carts_lock);
+        return;
+    }
+    for (cart_t **c = &carts; *c != NULL; c = &(*c)->next) {
+        if (*c == cart) {
+            *c = cart->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&carts_lock);
+    munmap((void *)cart->data, cart->map_size);
+    free(cart);
+}
@@ -0,0 +1,24 @@
+#ifndef CART_H
+#define CART_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Read-only mapping of a ROM file, shared by every instance that loads the
+ * same file. The mapping covers the ROM rounded up to the MMU page size,
+ * bytes past the end of the file read as zero. */
+typedef struct cart {
+    dev_t dev;
+    ino_t ino;
+    const uint8_t *data;
+    size_t size;
+    size_t map_size;
+    unsigned int refs;
+    struct cart *next;
+} cart_t;
+
+cart_t *cart_open(const char *path);
+void cart_close(cart_t *cart);
+
+#endif /* !CART_H */
@@ -0,0 +1,193 @@
+#include "dma.h"
+
+#include <string.h>
+
+#include "arm.h"
+#include "io.h"
+#include "irq.h"
+#include "mmu.h"
+#include "ppu.h"
+#include "stats.h"
+
+dma_t dma;
+
+static const uint32_t src_mask[4] = {0x07ffffff, 0x0fffffff, 0x0fffffff,
+                                     0x0fffffff};
+static const uint32_t dst_mask[4] = {0x07ffffff, 0x07ffffff, 0x07ffffff,
+                                     0x0fffffff};
+
+void dma_init(void)
+{
+    memset(&dma, 0, sizeof(dma));
+}
+
+static uint32_t dma_reg(int ch, uint32_t offset)
+{
+    return offset + (uint32_t)ch * IO_DMA_STRIDE;
+}
+
+static uint32_t dma_io_addr(uint32_t offset)
+{
+    return IO_REG(offset) | (uint32_t)IO_REG(offset + 2) << 16;
+}
+
+static void dma_latch_count(int ch)
+{
+    uint32_t count = IO_REG(dma_reg(ch, IO_DMA0CNT_L));
+    if (ch != 3)
+        count &= 0x3fff;
+    dma.ch[ch].count = count ? count : ch == 3 ? 0x10000 : 0x4000;
+}
+
+static int32_t dma_step(int ctl, uint32_t size)
+{
+    switch (ctl) {
+        case DMA_DECREMENT:
+            return -(int32_t)size;
+        case DMA_FIXED:
+            return 0;
+        default:
+            return (int32_t)size;
+    }
+}
+
+/* A nonsequential access on each side for the first unit, sequential
+ * ones after that, and 2 internal cycles to start. */
+static uint64_t dma_cycles(uint32_t src, uint32_t dst, uint32_t n,
+                           mmu_width_t width)
+{
+    uint32_t rs = MMU_REGION(src), rd = MMU_REGION(dst);
+    uint64_t cycles = 2 + 2 * (uint64_t)n;
+    cycles += mmu.wait[0][width][rs] + mmu.wait[0][width][rd];
+    cycles += (uint64_t)(n - 1) *
+              (uint64_t)(mmu.wait[1][width][rs] + mmu.wait[1][width][rd]);
+    return cycles;
+}
+
+/* Do the whole transfer with one host copy or fill when both ends are
+ * plain memory and the copy order cannot be observed. */
+static bool dma_fast(dma_channel_t *c, uint32_t n, uint32_t size,
+                     int src_ctl, int dst_ctl)
+{
+    if (dst_ctl != DMA_INCREMENT && dst_ctl != DMA_RELOAD)
+        return false;
+    if (src_ctl != DMA_INCREMENT && src_ctl != DMA_FIXED)
+        return false;
+    uint32_t len = n * size;
+    uint32_t src_len = src_ctl == DMA_FIXED ? size : len;
+    uint8_t *dst = mmu_dma_ptr(c->dst, len, true);
+    const uint8_t *src = mmu_dma_ptr(c->src, src_len, false);
+    if (dst == NULL || src == NULL)
+        return false;
+    if (src < dst + len && dst < src + src_len)
+        return false;
+
+    if (src_ctl == DMA_INCREMENT) {
+        memcpy(dst, src, len);
+    } else if (size == 4) {
+        uint32_t val = *(const uint32_t *)src;
+        for (uint32_t i = 0; i < n; ++i)
+            ((uint32_t *)dst)[i] = val;
+    } else {
+        uint16_t val = *(const uint16_t *)src;
+        for (uint32_t i = 0; i < n; ++i)
+            ((uint16_t *)dst)[i] = val;
+    }
+    switch (MMU_REGION(c->dst)) {
+        case MMU_REGION_PAL:
+            ppu_mem_write(MMU_REGION_PAL, (uint32_t)(dst - mmu.mem.pal), len);
+            break;
+        case MMU_REGION_VRAM:
+            ppu_mem_write(MMU_REGION_VRAM, (uint32_t)(dst - mmu.mem.vram),
+                          len);
+            break;
+        case MMU_REGION_OAM:
+            ppu_mem_write(MMU_REGION_OAM, (uint32_t)(dst - mmu.mem.oam), len);
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+static void dma_transfer(int ch)
+{
+    STATS_SCOPE(STATS_DMA);
+    dma_channel_t *c = &dma.ch[ch];
+    uint16_t cnt = IO_REG(dma_reg(ch, IO_DMA0CNT_H));
+    dma_timing_t timing = DMA_CNT_TIMING(cnt);
+    /* Sound FIFO transfers are always 4 words to a fixed address. */
+    bool fifo = timing == DMA_SPECIAL && (ch == 1 || ch == 2);
+    mmu_width_t width =
+        fifo || (cnt & DMA_CNT_WORD) ? MMU_WIDTH_32 : MMU_WIDTH_16;
+    uint32_t size = width == MMU_WIDTH_32 ? 4 : 2;
+    uint32_t n = fifo ? 4 : c->count;
+    int src_ctl = DMA_CNT_SRC(cnt);
+    int dst_ctl = fifo ? DMA_FIXED : DMA_CNT_DST(cnt);
+    int32_t src_step = dma_step(src_ctl, size);
+    int32_t dst_step = dma_step(dst_ctl, size);
+
+    c->src &= ~(size - 1);
+    c->dst &= ~(size - 1);
+    arm.cycles += dma_cycles(c->src, c->dst, n, width);
+    if (MMU_REGION(c->src) >= MMU_REGION_ROM_WS0)
+        mmu.prefetch.head = 0;
+    if (dma_fast(c, n, size, src_ctl, dst_ctl)) {
+        dma.fast++;
+        c->src += (uint32_t)src_step * n;
+        c->dst += (uint32_t)dst_step * n;
+    } else {
+        dma.slow++;
+        for (uint32_t i = 0; i < n; ++i) {
+            mmu_dma_write(c->dst, mmu_dma_read(c->src, width), width);
+            c->src += (uint32_t)src_step;
+            c->dst += (uint32_t)dst_step;
+        }
+    }
+
+    if (cnt & DMA_CNT_IRQ)
+        irq_raise((irq_t)(IRQ_DMA0 + ch));
+    if ((cnt & DMA_CNT_REPEAT) && timing != DMA_IMMEDIATE) {
+        if (!fifo)
+            dma_latch_count(ch);
+        if (dst_ctl == DMA_RELOAD)
+            c->dst = dma_io_addr(dma_reg(ch, IO_DMA0DAD)) & dst_mask[ch];
+    } else {
+        IO_REG(dma_reg(ch, IO_DMA0CNT_H)) &= (uint16_t)~DMA_CNT_ENABLE;
+    }
+}
+
+void dma_write_cnt(int ch, uint16_t val)
+{
+    uint16_t old = IO_REG(dma_reg(ch, IO_DMA0CNT_H));
+    IO_REG(dma_reg(ch, IO_DMA0CNT_H)) = val;
+    if ((old & DMA_CNT_ENABLE) || !(val & DMA_CNT_ENABLE))
+        return;
+    dma_channel_t *c = &dma.ch[ch];
+    c->src = dma_io_addr(dma_reg(ch, IO_DMA0SAD)) & src_mask[ch];
+    c->dst = dma_io_addr(dma_reg(ch, IO_DMA0DAD)) & dst_mask[ch];
+    dma_latch_count(ch);
+    if (DMA_CNT_TIMING(val) == DMA_IMMEDIATE)
+        dma_transfer(ch);
+}
+
+/* Run the enabled channels waiting for timing, in priority order. */
+void dma_trigger(dma_timing_t timing)
+{
+    for (int ch = 0; ch < 4; ++ch) {
+        uint16_t cnt = IO_REG(dma_reg(ch, IO_DMA0CNT_H));
+        if ((cnt & DMA_CNT_ENABLE) && DMA_CNT_TIMING(cnt) == timing)
+            dma_transfer(ch);
+    }
+}
+
+/* Refill request from a sound FIFO, served by channel 1 or 2. */
+void dma_fifo_request(uint32_t fifo_addr)
+{
+    for (int ch = 1; ch <= 2; ++ch) {
+        uint16_t cnt = IO_REG(dma_reg(ch, IO_DMA0CNT_H));
+        if ((cnt & DMA_CNT_ENABLE) &&
+            DMA_CNT_TIMING(cnt) == DMA_SPECIAL && dma.ch[ch].dst == fifo_addr)
+            dma_transfer(ch);
+    }
+}
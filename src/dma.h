@@ -0,0 +1,52 @@
+#ifndef DMA_H
+#define DMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Start timing, bits 12-13 of DMAxCNT_H. */
+typedef enum {
+    DMA_IMMEDIATE,
+    DMA_VBLANK,
+    DMA_HBLANK,
+    DMA_SPECIAL,
+} dma_timing_t;
+
+#define DMA_CNT_DST(cnt) (((cnt) >> 5) & 3)
+#define DMA_CNT_SRC(cnt) (((cnt) >> 7) & 3)
+#define DMA_CNT_REPEAT (1u << 9)
+#define DMA_CNT_WORD (1u << 10)
+#define DMA_CNT_TIMING(cnt) (((cnt) >> 12) & 3)
+#define DMA_CNT_IRQ (1u << 14)
+#define DMA_CNT_ENABLE (1u << 15)
+
+/* Address control, 3 is increment and reload for destinations. */
+enum {
+    DMA_INCREMENT,
+    DMA_DECREMENT,
+    DMA_FIXED,
+    DMA_RELOAD,
+};
+
+typedef struct {
+    /* Internal registers, latched from the I/O registers on enable. */
+    uint32_t src;
+    uint32_t dst;
+    uint32_t count;
+} dma_channel_t;
+
+typedef struct {
+    dma_channel_t ch[4];
+    /* Statistics, not saved in states. */
+    uint64_t fast; /* transfers done with a single host copy */
+    uint64_t slow; /* transfers done unit by unit */
+} dma_t;
+
+extern dma_t dma;
+
+void dma_init(void);
+void dma_write_cnt(int ch, uint16_t val);
+void dma_trigger(dma_timing_t timing);
+void dma_fifo_request(uint32_t fifo_addr);
+
+#endif /* !DMA_H */
@@ -0,0 +1,152 @@
+#include "gba.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apu.h"
+#include "arm.h"
+#include "backup.h"
+#include "dma.h"
+#include "io.h"
+#include "irq.h"
+#include "mmu.h"
+#include "movie.h"
+#include "ppu.h"
+#include "rewind.h"
+#include "sched.h"
+#include "timer.h"
+
+gba_t gba;
+
+void gba_init(void)
+{
+    gba_unload_rom();
+    memset(&gba, 0, sizeof(gba));
+    gba.video = true;
+    gba.audio = true;
+    sched_init();
+    mmu_init();
+    dma_init();
+    irq_init();
+    arm_init();
+    ppu_init();
+    timer_init();
+    apu_init();
+}
+
+/* Start at the cartridge entry point with the state left by the BIOS. */
+static void gba_direct_boot(void)
+{
+    arm_reset();
+    arm_set_mode(ARM_PSR_SYS_MODE);
+    arm.r[SP] = 0x03007f00;
+    arm.r13_svc = 0x03007fe0;
+    arm.r13_irq = 0x03007fa0;
+    arm.r[PC] = 0x08000000;
+    gba.next_frame_cycles = arm.cycles + GBA_CYCLES_PER_FRAME;
+}
+
+/* Save data lives next to the ROM, with a .sav extension. */
+static char *gba_save_path(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    size_t len = dot && (slash == NULL || dot > slash) ? (size_t)(dot - path)
+                                                       : strlen(path);
+    char *save = malloc(len + 5);
+    if (save != NULL) {
+        memcpy(save, path, len);
+        memcpy(save + len, ".sav", 5);
+    }
+    return save;
+}
+
+/* The ROM is mapped, not copied, so instances loading the same file share
+ * its pages. */
+int gba_load_rom(const char *path)
+{
+    cart_t *cart = cart_open(path);
+    if (cart == NULL)
+        return -1;
+    char *save = gba_save_path(path);
+    int ret = backup_open(backup_detect(cart->data, cart->size), save);
+    free(save);
+    if (ret != 0) {
+        fprintf(stderr, "%s: cannot open save data\n", path);
+        cart_close(cart);
+        return -1;
+    }
+    mmu_map_rom(cart->data, cart->size);
+    cart_close(gba.cart);
+    gba.cart = cart;
+    gba_direct_boot();
+    return 0;
+}
+
+void gba_unload_rom(void)
+{
+    if (gba.cart == NULL)
+        return;
+    backup_close();
+    mmu_map_rom(NULL, 0);
+    cart_close(gba.cart);
+    gba.cart = NULL;
+}
+
+void gba_run_frame(void)
+{
+    movie_frame_start();
+    apu.out_len = 0;
+    while (arm.cycles < gba.next_frame_cycles) {
+        arm_run(gba.next_frame_cycles);
+        sched_dispatch();
+    }
+    /* The render thread overlaps the frame, it is done when we return. */
+    ppu_thread_sync();
+    apu_end_frame();
+    gba.next_frame_cycles += GBA_CYCLES_PER_FRAME;
+    gba.frame++;
+    movie_frame_end();
+    rewind_frame();
+}
+
+/* Have the next frame the PPU starts drawn, whatever the video and
+ * frameskip settings. Returns its number, it is complete once ppu.frames
+ * is past it. */
+uint64_t gba_request_frame(void)
+{
+    gba.render_request = true;
+    return ppu.line < PPU_HEIGHT ? ppu.frames + 1 : ppu.frames;
+}
+
+/* Draw frames or not, and how many to skip after each one drawn. Takes
+ * effect on the frame running now. */
+void gba_set_video(bool video, uint32_t frameskip)
+{
+    gba.video = video;
+    gba.frameskip = frameskip;
+    ppu_video_changed();
+}
+
+/* Do the pressed keys meet the KEYCNT condition. */
+static bool gba_keys_match(uint16_t cnt, uint16_t keys)
+{
+    uint16_t sel = cnt & GBA_KEY_ALL;
+    return cnt & GBA_KEYCNT_AND ? sel && (keys & sel) == sel
+                                : (keys & sel) != 0;
+}
+
+/* Keys held down from now on, GBA_KEY_* bits. */
+void gba_set_keys(uint16_t keys)
+{
+    uint16_t cnt = IO_REG(IO_KEYCNT);
+    uint16_t held = (uint16_t)(~IO_REG(IO_KEYINPUT) & GBA_KEY_ALL);
+    keys &= GBA_KEY_ALL;
+    IO_REG(IO_KEYINPUT) = (uint16_t)(~keys & GBA_KEY_ALL);
+    /* Only entering the condition raises the IRQ, so setting the same
+     * keys again, as movie playback does every frame, does not. */
+    if ((cnt & GBA_KEYCNT_IRQ) && gba_keys_match(cnt, keys) &&
+        !gba_keys_match(cnt, held))
+        irq_raise(IRQ_KEYPAD);
+}
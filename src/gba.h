@@ -0,0 +1,50 @@
+#ifndef GBA_H
+#define GBA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cart.h"
+
+#define GBA_CLOCK 16777216
+#define GBA_CYCLES_PER_FRAME 280896
+
+/* Keys, the bits of KEYINPUT and KEYCNT. */
+#define GBA_KEY_A (1u << 0)
+#define GBA_KEY_B (1u << 1)
+#define GBA_KEY_SELECT (1u << 2)
+#define GBA_KEY_START (1u << 3)
+#define GBA_KEY_RIGHT (1u << 4)
+#define GBA_KEY_LEFT (1u << 5)
+#define GBA_KEY_UP (1u << 6)
+#define GBA_KEY_DOWN (1u << 7)
+#define GBA_KEY_R (1u << 8)
+#define GBA_KEY_L (1u << 9)
+#define GBA_KEY_ALL 0x3ffu
+
+/* KEYCNT */
+#define GBA_KEYCNT_IRQ (1u << 14)
+#define GBA_KEYCNT_AND (1u << 15) /* all the selected keys, not any */
+
+typedef struct {
+    uint64_t frame;
+    uint64_t next_frame_cycles;
+    /* Host side, kept when a state is loaded. */
+    bool video;
+    uint32_t frameskip;  /* frames skipped after each one drawn */
+    bool render_request; /* draw the next frame even if skipped */
+    bool audio;
+    cart_t *cart;
+} gba_t;
+
+extern gba_t gba;
+
+void gba_init(void);
+int gba_load_rom(const char *path);
+void gba_unload_rom(void);
+void gba_run_frame(void);
+uint64_t gba_request_frame(void);
+void gba_set_keys(uint16_t keys);
+void gba_set_video(bool video, uint32_t frameskip);
+
+#endif /* !GBA_H */
@@ -0,0 +1,171 @@
+#include "instance.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "backup.h"
+#include "mmu.h"
+#include "ppu.h"
+#include "state.h"
+
+typedef struct {
+    uint32_t refs;
+    uint8_t data[MMU_PAGE_SIZE];
+} instance_page_t;
+
+typedef struct {
+    uint32_t refs;
+    uint8_t data[BACKUP_STATE_SIZE];
+} instance_backup_t;
+
+struct instance {
+    const uint8_t *rom;
+    instance_page_t *page[MMU_COW_PAGES];
+    instance_backup_t *backup;
+    uint8_t core[]; /* state_core_size() bytes */
+};
+
+/* What the running machine was last forked from or switched to. A page
+ * still clean in mmu.dirty holds the same bytes as its page here. The
+ * backup is rarely written and is compared instead. */
+static struct {
+    instance_page_t *page[MMU_COW_PAGES];
+    instance_backup_t *backup;
+    uint32_t instances;
+    size_t bytes;
+} live;
+
+static void instance_page_put(instance_page_t *p)
+{
+    if (p != NULL && --p->refs == 0) {
+        live.bytes -= sizeof(*p);
+        free(p);
+    }
+}
+
+static void instance_backup_put(instance_backup_t *b)
+{
+    if (b != NULL && --b->refs == 0) {
+        live.bytes -= sizeof(*b);
+        free(b);
+    }
+}
+
+/* Copy a page of the running machine, which then matches it. */
+static int instance_page_copy(unsigned i)
+{
+    instance_page_t *p = malloc(sizeof(*p));
+    if (p == NULL)
+        return -1;
+    p->refs = 1;
+    memcpy(p->data, mmu_cow_page(i), sizeof(p->data));
+    live.bytes += sizeof(*p);
+    instance_page_put(live.page[i]);
+    live.page[i] = p;
+    return 0;
+}
+
+static int instance_backup_copy(void)
+{
+    instance_backup_t *b = malloc(sizeof(*b));
+    if (b == NULL)
+        return -1;
+    b->refs = 1;
+    memcpy(b->data, &backup, sizeof(b->data));
+    live.bytes += sizeof(*b);
+    instance_backup_put(live.backup);
+    live.backup = b;
+    return 0;
+}
+
+/* Capture the running machine, which carries on. Only the pages written
+ * since the last fork or switch are copied, the first write to any other
+ * page after this is caught by the MMU. */
+instance_t *instance_fork(void)
+{
+    instance_t *in = calloc(1, sizeof(*in) + state_core_size());
+    if (in == NULL)
+        return NULL;
+    live.instances++;
+    live.bytes += sizeof(*in) + state_core_size();
+    in->rom = mmu.rom;
+    for (unsigned i = 0; i < MMU_COW_PAGES; ++i) {
+        if ((mmu.dirty & 1u << i || live.page[i] == NULL) &&
+            instance_page_copy(i) != 0) {
+            instance_free(in);
+            return NULL;
+        }
+        in->page[i] = live.page[i];
+        in->page[i]->refs++;
+    }
+    if ((live.backup == NULL ||
+         memcmp(live.backup->data, &backup, BACKUP_STATE_SIZE) != 0) &&
+        instance_backup_copy() != 0) {
+        instance_free(in);
+        return NULL;
+    }
+    in->backup = live.backup;
+    in->backup->refs++;
+    mmu_protect(MMU_COW_ALL);
+    state_core_save(in->core);
+    return in;
+}
+
+/* Make in the running machine, copying in only the pages that differ.
+ * Returns -1 if another cartridge was loaded since it was forked. */
+int instance_switch(const instance_t *in)
+{
+    if (in->rom != mmu.rom)
+        return -1;
+    bool threaded = ppu.threaded;
+    ppu_thread_stop();
+    for (unsigned i = 0; i < MMU_COW_PAGES; ++i) {
+        if (!(mmu.dirty & 1u << i) && live.page[i] == in->page[i])
+            continue;
+        memcpy(mmu_cow_page(i), in->page[i]->data, MMU_PAGE_SIZE);
+        if (i >= MMU_COW_RAM_PAGES)
+            ppu_mem_changed(MMU_REGION_VRAM,
+                            (i - MMU_COW_RAM_PAGES) << MMU_PAGE_SHIFT,
+                            MMU_PAGE_SIZE);
+        in->page[i]->refs++;
+        instance_page_put(live.page[i]);
+        live.page[i] = in->page[i];
+    }
+    mmu_protect(MMU_COW_ALL);
+    backup_restore(in->backup->data);
+    in->backup->refs++;
+    instance_backup_put(live.backup);
+    live.backup = in->backup;
+    state_core_load(in->core);
+    if (threaded)
+        ppu_thread_start();
+    return 0;
+}
+
+void instance_free(instance_t *in)
+{
+    if (in == NULL)
+        return;
+    for (unsigned i = 0; i < MMU_COW_PAGES; ++i)
+        instance_page_put(in->page[i]);
+    instance_backup_put(in->backup);
+    live.bytes -= sizeof(*in) + state_core_size();
+    free(in);
+    /* With no instance left there is nothing to share with. */
+    if (--live.instances == 0) {
+        for (unsigned i = 0; i < MMU_COW_PAGES; ++i) {
+            instance_page_put(live.page[i]);
+            live.page[i] = NULL;
+        }
+        instance_backup_put(live.backup);
+        live.backup = NULL;
+    }
+}
+
+/* Host memory held for instances, a page shared by several counted once. */
+size_t instance_bytes(void)
+{
+    return live.bytes;
+}
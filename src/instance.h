@@ -0,0 +1,16 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <stddef.h>
+
+/* A machine captured by instance_fork(), run again by switching to it.
+ * Instances share their memory by page with each other and with the
+ * running machine, and only hold what changed in between. */
+typedef struct instance instance_t;
+
+instance_t *instance_fork(void);
+int instance_switch(const instance_t *in);
+void instance_free(instance_t *in);
+size_t instance_bytes(void);
+
+#endif /* !INSTANCE_H */
@@ -0,0 +1,62 @@
+#ifndef IO_H
+#define IO_H
+
+/* I/O register offsets from 0x04000000. */
+#define IO_DISPCNT 0x000
+#define IO_DISPSTAT 0x004
+#define IO_VCOUNT 0x006
+#define IO_BG0CNT 0x008
+#define IO_BG0HOFS 0x010
+#define IO_BG0VOFS 0x012
+#define IO_BG2PA 0x020
+#define IO_BG2PB 0x022
+#define IO_BG2PC 0x024
+#define IO_BG2PD 0x026
+#define IO_BG2X 0x028
+#define IO_BG2Y 0x02c
+#define IO_BG3X 0x038
+#define IO_BG3Y 0x03c
+#define IO_BG_AFFINE_STRIDE 0x10
+#define IO_WIN0H 0x040
+#define IO_WIN0V 0x044
+#define IO_WININ 0x048
+#define IO_WINOUT 0x04a
+#define IO_BLDCNT 0x050
+#define IO_BLDALPHA 0x052
+#define IO_BLDY 0x054
+#define IO_SOUND1CNT_L 0x060
+#define IO_SOUND1CNT_H 0x062
+#define IO_SOUND1CNT_X 0x064
+#define IO_SOUND2CNT_L 0x068
+#define IO_SOUND2CNT_H 0x06c
+#define IO_SOUND3CNT_L 0x070
+#define IO_SOUND3CNT_H 0x072
+#define IO_SOUND3CNT_X 0x074
+#define IO_SOUND4CNT_L 0x078
+#define IO_SOUND4CNT_H 0x07c
+#define IO_SOUNDCNT_L 0x080
+#define IO_SOUNDCNT_H 0x082
+#define IO_SOUNDCNT_X 0x084
+#define IO_SOUNDBIAS 0x088
+#define IO_WAVE_RAM 0x090
+#define IO_FIFO_A 0x0a0
+#define IO_FIFO_B 0x0a4
+#define IO_DMA0SAD 0x0b0
+#define IO_DMA0DAD 0x0b4
+#define IO_DMA0CNT_L 0x0b8
+#define IO_DMA0CNT_H 0x0ba
+#define IO_DMA3CNT_H 0x0de
+#define IO_DMA_STRIDE 12
+#define IO_TM0CNT_L 0x100
+#define IO_TM0CNT_H 0x102
+#define IO_TM_STRIDE 4
+#define IO_KEYINPUT 0x130
+#define IO_KEYCNT 0x132
+#define IO_IE 0x200
+#define IO_IF 0x202
+#define IO_WAITCNT 0x204
+#define IO_IME 0x208
+
+#define IO_REG(offset) (*(uint16_t *)&mmu.mem.io[(offset)])
+
+#endif /* !IO_H */
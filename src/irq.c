@@ -0,0 +1,37 @@
+#include "irq.h"
+
+#include <stdint.h>
+
+#include "arm.h"
+#include "io.h"
+#include "mmu.h"
+#include "sched.h"
+
+static void irq_check(uint64_t when)
+{
+    (void)when;
+    if (irq_pending() && !arm.cpsr.i)
+        arm_irq();
+}
+
+void irq_init(void)
+{
+    sched_set_handler(SCHED_IRQ, irq_check);
+}
+
+/* Have the CPU check for an interrupt before its next instruction. */
+void irq_update(void)
+{
+    sched_schedule(SCHED_IRQ, arm.cycles);
+}
+
+void irq_raise(irq_t irq)
+{
+    IO_REG(IO_IF) |= (uint16_t)(1u << irq);
+    irq_update();
+}
+
+bool irq_pending(void)
+{
+    return (IO_REG(IO_IME) & 1) && (IO_REG(IO_IE) & IO_REG(IO_IF));
+}
@@ -0,0 +1,29 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdbool.h>
+
+/* Interrupt sources, the bit number in IE and IF. */
+typedef enum {
+    IRQ_VBLANK,
+    IRQ_HBLANK,
+    IRQ_VCOUNT,
+    IRQ_TIMER0,
+    IRQ_TIMER1,
+    IRQ_TIMER2,
+    IRQ_TIMER3,
+    IRQ_SERIAL,
+    IRQ_DMA0,
+    IRQ_DMA1,
+    IRQ_DMA2,
+    IRQ_DMA3,
+    IRQ_KEYPAD,
+    IRQ_GAMEPAK,
+} irq_t;
+
+void irq_init(void);
+void irq_update(void);
+void irq_raise(irq_t irq);
+bool irq_pending(void);
+
+#endif /* !IRQ_H */
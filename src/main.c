@@ -1,8 +1,226 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "apu.h"
 #include "arm.h"
+#include "arm_prof.h"
+#include "gba.h"
+#include "mmu.h"
+#include "movie.h"
+#include "ppu.h"
+#include "ppu_color.h"
+#include "state.h"
+#include "stats.h"
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void benchmark(const char *rom, unsigned long frames)
+{
+    stats_t stats;
+    uint64_t cycles = arm.cycles;
+    uint64_t start_ns = host_ns();
+    stats_poll(&stats);
+    for (unsigned long i = 0; i < frames; ++i)
+        gba_run_frame();
+    stats_poll(&stats);
+    uint64_t host = stats.elapsed;
+    double secs = (double)(host_ns() - start_ns) / 1e9;
+    double fps = (double)frames / secs;
+    double realtime = (double)GBA_CLOCK / GBA_CYCLES_PER_FRAME;
+
+    cycles = arm.cycles - cycles;
+    printf("rom:          %s\n", rom);
+    printf("frames:       %lu (video %s, frameskip %" PRIu32 ", audio %s)\n",
+           frames, gba.video ? "on" : "off", gba.frameskip,
+           gba.audio ? "on" : "off");
+    printf("host time:    %.3f s\n", secs);
+    printf("emulated fps: %.1f (%.2fx realtime)\n", fps, fps / realtime);
+    printf("video isa:    %s%s\n", ppu_color_isa(),
+           ppu.threaded ? ", render thread" : "");
+    printf("host cycles per emulated cycle: %.2f\n",
+           (double)host / (double)cycles);
+#ifdef TIMING_STATS
+    printf("time split:  ");
+    for (int id = 0; id < STATS_NUM; ++id) {
+        printf(" %s %.1f%%", stats_name(id),
+               100.0 * (double)stats.ticks[id] / (double)host);
+    }
+    printf("\n");
+#else
+    printf("time split:   not built in (TIMING_STATS)\n");
+#endif
+}
 
-int main(void)
+static void usage(const char *prog)
 {
-    arm_init();
-    arm_step();
-    return 0;
+    fprintf(stderr,
+            "usage: %s [-b] [-m] [-n frames] [-V] [-s n] [-A] [-w file] [-t] "
+            "[-p file] [-l file] [-S file]\n"
+            "       [-M file [-k n]] [-P file] rom.gba\n"
+            "  -b         print benchmark results when done\n"
+            "  -m         print memory access statistics when done\n"
+            "  -n frames  number of frames to run (default: unlimited)\n"
+            "  -V         disable video rendering\n"
+            "  -s n       skip n frames after each one rendered\n"
+            "  -A         disable audio rendering\n"
+            "  -w file    write audio to a WAV file, raw samples for .raw\n"
+            "  -t         render video on a separate thread\n"
+            "  -p file    write a folded call-graph profile to file\n"
+            "  -l file    start from a saved state\n"
+            "  -S file    save the state when done\n"
+            "  -M file    record an input movie\n"
+            "  -k n       hash the state every n frames of the movie\n"
+            "  -P file    play a movie back and check its state hashes\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long frames = 0;
+    const char *profile = NULL, *wav = NULL;
+    const char *load_state = NULL, *save_state = NULL;
+    const char *record = NULL, *play = NULL;
+    uint32_t hash_interval = MOVIE_HASH_INTERVAL;
+    bool bench = false, mem_stats = false, video = true, audio = true;
+    bool render_thread = false;
+    uint32_t frameskip = 0;
+    int opt, status = 0;
+
+    while ((opt = getopt(argc, argv, "bmn:Vs:Aw:tp:l:S:M:k:P:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                bench = true;
+                break;
+            case 'm':
+                mem_stats = true;
+                break;
+            case 'n':
+                frames = strtoul(optarg, NULL, 0);
+                break;
+            case 'V':
+                video = false;
+                break;
+            case 's':
+                frameskip = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'A':
+                audio = false;
+                break;
+            case 'w':
+                wav = optarg;
+                break;
+            case 't':
+                render_thread = true;
+                break;
+            case 'p':
+                profile = optarg;
+                break;
+            case 'l':
+                load_state = optarg;
+                break;
+            case 'S':
+                save_state = optarg;
+                break;
+            case 'M':
+                record = optarg;
+                break;
+            case 'k':
+                hash_interval = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'P':
+                play = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (bench && frames == 0)
+        frames = 600;
+
+    gba_init();
+    gba_set_video(video, frameskip);
+    gba.audio = audio;
+    if (gba_load_rom(argv[optind]) != 0)
+        return 1;
+    if (load_state && state_load_file(load_state) != 0) {
+        fprintf(stderr, "%s: cannot load state\n", load_state);
+        return 1;
+    }
+    if (record && movie_record(record, hash_interval) != 0) {
+        perror(record);
+        return 1;
+    }
+    if (play) {
+        if (movie_play(play) != 0) {
+            fprintf(stderr, "%s: cannot play movie\n", play);
+            return 1;
+        }
+        if (frames == 0)
+            frames = movie_length();
+    }
+    if (render_thread)
+        ppu_thread_start();
+    if (wav && apu_sink_open(wav, apu.rate) != 0) {
+        perror(wav);
+        return 1;
+    }
+#ifdef CPU_PROFILE
+    if (profile)
+        arm_prof_start();
+#else
+    if (profile)
+        fprintf(stderr, "profiling support not built (CPU_PROFILE)\n");
+#endif
+
+    if (bench) {
+        benchmark(argv[optind], frames);
+    } else {
+        for (unsigned long i = 0; frames == 0 || i < frames; ++i)
+            gba_run_frame();
+    }
+
+    if (play && movie_divergence() >= 0) {
+        fprintf(stderr, "%s: state differs from the recording after frame "
+                        "%" PRId64 "\n", play, movie_divergence());
+        status = 1;
+    }
+    if (movie_stop() != 0)
+        perror(record);
+    if (mem_stats)
+        mmu_stats_dump(stdout);
+    if (save_state && state_save_file(save_state) != 0)
+        perror(save_state);
+
+#ifdef CPU_PROFILE
+    if (profile) {
+        FILE *f = fopen(profile, "w");
+        if (f == NULL) {
+            perror(profile);
+            return 1;
+        }
+        arm_prof_dump_folded(f);
+        fclose(f);
+    }
+#endif
+    if (apu_sink_close() != 0) {
+        fprintf(stderr, "%s: sound output incomplete\n", wav);
+        status = 1;
+    }
+    ppu_thread_stop();
+    gba_unload_rom();
+    return status;
 }
@@ -1,13 +1,551 @@
 #include "mmu.h"
 
-uint32_t mmu_read_word(uint32_t addr)
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apu.h"
+#include "arm.h"
+#include "backup.h"
+#include "dma.h"
+#include "io.h"
+#include "irq.h"
+#include "ppu.h"
+#include "stats.h"
+#include "timer.h"
+
+mmu_t mmu;
+mmu_stats_t mmu_stats;
+
+#ifdef MMU_STATS
+static const uint8_t mmu_stat_region[16] = {
+    MMU_STAT_BIOS,     MMU_STAT_UNMAPPED, MMU_STAT_EWRAM, MMU_STAT_IWRAM,
+    MMU_STAT_IO,       MMU_STAT_PAL,      MMU_STAT_VRAM,  MMU_STAT_OAM,
+    MMU_STAT_ROM,      MMU_STAT_ROM,      MMU_STAT_ROM,   MMU_STAT_ROM,
+    MMU_STAT_ROM,      MMU_STAT_ROM,      MMU_STAT_SRAM,  MMU_STAT_SRAM,
+};
+#endif
+
+static const uint8_t sram_wait[4] = {4, 3, 2, 8};
+static const uint8_t rom_wait_n[4] = {4, 3, 2, 8};
+static const uint8_t rom_wait_s[3][2] = {{2, 1}, {4, 1}, {8, 1}};
+
+/* Map [start, end) to mem, mirrored every size bytes (a power of two). */
+static void mmu_map(uint32_t start, uint32_t end, uint8_t *mem, uint32_t size,
+                    bool writable)
+{
+    for (uint32_t addr = start; addr < end; addr += MMU_PAGE_SIZE) {
+        uint8_t *page = mem + ((addr - start) & (size - 1));
+        mmu.read_page[addr >> MMU_PAGE_SHIFT] = page;
+        mmu.write_page[addr >> MMU_PAGE_SHIFT] = writable ? page : NULL;
+    }
+}
+
+/* VRAM offset, the upper 32KiB of each 128KiB mirror the OBJ tiles. */
+static uint32_t mmu_vram_offset(uint32_t addr)
+{
+    uint32_t offset = addr & 0x1ffff;
+    return offset < sizeof(mmu.mem.vram) ? offset : offset - 0x8000;
+}
+
+/* Give the mirrors of a work RAM page their write pointers, or take
+ * them away. */
+static void mmu_ram_writable(unsigned i, bool writable)
+{
+    uint32_t start = 0x02000000 + (i << MMU_PAGE_SHIFT);
+    uint32_t mirror = sizeof(mmu.mem.ewram);
+    if (i >= sizeof(mmu.mem.ewram) >> MMU_PAGE_SHIFT) {
+        start = 0x03000000 + ((uint32_t)(i << MMU_PAGE_SHIFT) & 0x7fff);
+        mirror = sizeof(mmu.mem.iwram);
+    }
+    for (uint32_t addr = start; MMU_REGION(addr) == MMU_REGION(start);
+         addr += mirror) {
+        uint32_t page = addr >> MMU_PAGE_SHIFT;
+        mmu.write_page[page] = writable ? mmu.read_page[page] : NULL;
+    }
+}
+
+/* Note a write to a copy-on-write page, a clean work RAM page gets its
+ * write pointers back. */
+static void mmu_touch(uint32_t addr)
+{
+    unsigned i;
+    switch (MMU_REGION(addr)) {
+        case MMU_REGION_EWRAM:
+            i = (addr & 0x3ffff) >> MMU_PAGE_SHIFT;
+            break;
+        case MMU_REGION_IWRAM:
+            i = (0x40000 + (addr & 0x7fff)) >> MMU_PAGE_SHIFT;
+            break;
+        case MMU_REGION_VRAM:
+            i = MMU_COW_RAM_PAGES + (mmu_vram_offset(addr) >> MMU_PAGE_SHIFT);
+            mmu.dirty |= 1u << i;
+            return;
+        default:
+            return;
+    }
+    if (!(mmu.dirty & 1u << i)) {
+        mmu.dirty |= 1u << i;
+        mmu_ram_writable(i, true);
+    }
+}
+
+/* Host memory of a copy-on-write page. */
+uint8_t *mmu_cow_page(unsigned i)
+{
+    if (i < MMU_COW_RAM_PAGES)
+        return &mmu.mem.ewram[i << MMU_PAGE_SHIFT];
+    return &mmu.mem.vram[(i - MMU_COW_RAM_PAGES) << MMU_PAGE_SHIFT];
+}
+
+/* Mark the given copy-on-write pages clean and the others dirty. */
+void mmu_protect(uint32_t pages)
+{
+    for (unsigned i = 0; i < MMU_COW_RAM_PAGES; ++i)
+        mmu_ram_writable(i, !(pages & 1u << i));
+    mmu.dirty = MMU_COW_ALL & ~pages;
+}
+
+static void mmu_set_wait(int region, uint8_t n, uint8_t s)
+{
+    mmu.wait[0][MMU_WIDTH_8][region] = n;
+    mmu.wait[0][MMU_WIDTH_16][region] = n;
+    mmu.wait[1][MMU_WIDTH_8][region] = s;
+    mmu.wait[1][MMU_WIDTH_16][region] = s;
+    /* 32-bit accesses to a 16-bit bus take an extra sequential access. */
+    mmu.wait[0][MMU_WIDTH_32][region] = (uint8_t)(n + 1 + s);
+    mmu.wait[1][MMU_WIDTH_32][region] = (uint8_t)(s + 1 + s);
+}
+
+static void mmu_update_waitcnt(uint16_t waitcnt)
+{
+    for (int ws = 0; ws < 3; ++ws) {
+        uint8_t n = rom_wait_n[(waitcnt >> (2 + ws * 3)) & 3];
+        uint8_t s = rom_wait_s[ws][(waitcnt >> (4 + ws * 3)) & 1];
+        mmu_set_wait(MMU_REGION_ROM_WS0 + ws * 2, n, s);
+        mmu_set_wait(MMU_REGION_ROM_WS0 + ws * 2 + 1, n, s);
+    }
+    mmu.prefetch.enabled = (waitcnt >> 14) & 1;
+    mmu.prefetch.head = 0;
+    uint8_t sram = sram_wait[waitcnt & 3];
+    for (int seq = 0; seq < 2; ++seq) {
+        for (int width = MMU_WIDTH_8; width <= MMU_WIDTH_32; ++width) {
+            mmu.wait[seq][width][MMU_REGION_SRAM] = sram;
+            mmu.wait[seq][width][MMU_REGION_SRAM + 1] = sram;
+        }
+    }
+}
+
+static void mmu_reset_wait(void)
+{
+    memset(mmu.wait, 0, sizeof(mmu.wait));
+    mmu_set_wait(MMU_REGION_EWRAM, 2, 2);
+    for (int region = MMU_REGION_PAL; region <= MMU_REGION_OAM; ++region) {
+        mmu.wait[0][MMU_WIDTH_32][region] = 1;
+        mmu.wait[1][MMU_WIDTH_32][region] = 1;
+    }
+    mmu_update_waitcnt(0);
+}
+
+void mmu_init(void)
+{
+    free(mmu.rom_copy);
+    memset(&mmu, 0, sizeof(mmu));
+    mmu_map(0x00000000, 0x00004000, mmu.mem.bios, sizeof(mmu.mem.bios),
+            false);
+    /* No BIOS is loaded, only the end of its IRQ handler. */
+    *(uint32_t *)&mmu.mem.bios[ARM_BIOS_IRQ_RETURN] = ARM_OPCODE_IRQ_RETURN;
+    mmu_map(0x02000000, 0x03000000, mmu.mem.ewram, sizeof(mmu.mem.ewram),
+            true);
+    mmu_map(0x03000000, 0x04000000, mmu.mem.iwram, sizeof(mmu.mem.iwram),
+            true);
+    /* VRAM writes go through the slow path for the 8-bit write quirks. */
+    for (uint32_t addr = 0x06000000; addr < 0x07000000;
+         addr += MMU_PAGE_SIZE) {
+        uint8_t *page = &mmu.mem.vram[mmu_vram_offset(addr)];
+        mmu.read_page[addr >> MMU_PAGE_SHIFT] = page;
+    }
+    mmu.dirty = MMU_COW_ALL;
+    mmu_reset_wait();
+    IO_REG(IO_KEYINPUT) = 0x3ff; /* active low, nothing held */
+}
+
+/* Point the ROM pages at the cartridge, which must stay readable up to
+ * the next page boundary for as long as it is mapped. */
+void mmu_map_rom(const uint8_t *rom, size_t size)
+{
+    size_t alloc = (size + MMU_PAGE_MASK) & ~(size_t)MMU_PAGE_MASK;
+    if (rom != mmu.rom_copy) {
+        free(mmu.rom_copy);
+        mmu.rom_copy = NULL;
+    }
+    mmu.rom = rom;
+    mmu.rom_size = (uint32_t)size;
+    for (uint32_t base = 0x08000000; base < 0x0e000000; base += 0x2000000) {
+        for (uint32_t offset = 0; offset < MMU_ROM_MAX_SIZE;
+             offset += MMU_PAGE_SIZE) {
+            uint32_t page = (base + offset) >> MMU_PAGE_SHIFT;
+            mmu.read_page[page] =
+                offset < alloc ? (uint8_t *)&rom[offset] : NULL;
+        }
+    }
+    /* EEPROM accesses go through the slow path. */
+    if (backup.type == BACKUP_EEPROM) {
+        for (uint32_t addr = BACKUP_EEPROM_ADDR(size) & ~MMU_PAGE_MASK;
+             addr < 0x0e000000; addr += MMU_PAGE_SIZE)
+            mmu.read_page[addr >> MMU_PAGE_SHIFT] = NULL;
+    }
+}
+
+int mmu_load_rom(const void *data, size_t size)
+{
+    if (size == 0 || size > MMU_ROM_MAX_SIZE)
+        return -1;
+    /* Round up so that the last page can be mapped directly. */
+    size_t alloc = (size + MMU_PAGE_MASK) & ~(size_t)MMU_PAGE_MASK;
+    uint8_t *rom = calloc(1, alloc);
+    if (rom == NULL)
+        return -1;
+    memcpy(rom, data, size);
+    free(mmu.rom_copy);
+    mmu.rom_copy = rom;
+    mmu_map_rom(rom, size);
+    return 0;
+}
+
+uint32_t mmu_read_slow(uint32_t addr, mmu_width_t width)
+{
+    STATS_SCOPE(STATS_MMU);
+    switch (MMU_REGION(addr)) {
+        case MMU_REGION_IO:
+            if ((addr & 0xffffff) >= sizeof(mmu.mem.io))
+                return 0;
+            /* The counters are only brought up to date when read. */
+            if ((addr & 0xffffff) - IO_TM0CNT_L < IO_TM_STRIDE * 4) {
+                for (int n = 0; n < 4; ++n)
+                    IO_REG(IO_TM0CNT_L + (uint32_t)n * IO_TM_STRIDE) =
+                        timer_read(n);
+            }
+            return mmu_load(&mmu.mem.io[addr & 0x3ff], width);
+        case MMU_REGION_PAL:
+            return mmu_load(&mmu.mem.pal[addr & 0x3ff], width);
+        case MMU_REGION_OAM:
+            return mmu_load(&mmu.mem.oam[addr & 0x3ff], width);
+        case MMU_REGION_ROM_WS0:
+        case MMU_REGION_ROM_WS0 + 1:
+        case MMU_REGION_ROM_WS1:
+        case MMU_REGION_ROM_WS1 + 1:
+        case MMU_REGION_ROM_WS2:
+        case MMU_REGION_ROM_WS2 + 1: {
+            if (backup.type == BACKUP_EEPROM &&
+                addr >= BACKUP_EEPROM_ADDR(mmu.rom_size))
+                return backup_eeprom_read();
+            uint32_t offset = addr & (MMU_ROM_MAX_SIZE - 1);
+            if (offset < mmu.rom_size)
+                return mmu_load(&mmu.rom[offset], width);
+            /* Reads past the end of the cartridge return the address bus. */
+            if (width == MMU_WIDTH_32) {
+                uint32_t lo = (addr >> 1) & 0xffff;
+                return lo | ((lo + 1) & 0xffff) << 16;
+            }
+            return (addr >> 1) & 0xffff;
+        }
+        case MMU_REGION_SRAM:
+        case MMU_REGION_SRAM + 1:
+            /* 8-bit bus, wider reads see the byte repeated. */
+            if (width == MMU_WIDTH_32)
+                return backup_read(addr) * 0x01010101u;
+            if (width == MMU_WIDTH_16)
+                return backup_read(addr) * 0x0101u;
+            return backup_read(addr);
+        default:
+            return 0;
+    }
+}
+
+/* Write the lanes of a halfword register set in mask, 0x00ff or 0xff00
+ * for byte stores. Registers with side effects only see the bytes that
+ * were written. */
+static void mmu_io_write(uint32_t offset, uint16_t val, uint16_t mask)
+{
+    uint16_t merged = (uint16_t)((IO_REG(offset) & ~mask) | (val & mask));
+    if (offset >= IO_SOUND1CNT_L && offset < IO_FIFO_B + 4) {
+        apu_write(offset, merged);
+        return;
+    }
+    switch (offset) {
+        case IO_DMA0CNT_H:
+        case IO_DMA0CNT_H + IO_DMA_STRIDE:
+        case IO_DMA0CNT_H + IO_DMA_STRIDE * 2:
+        case IO_DMA3CNT_H:
+            dma_write_cnt((int)(offset - IO_DMA0CNT_H) / IO_DMA_STRIDE,
+                          merged);
+            return;
+        case IO_TM0CNT_H:
+        case IO_TM0CNT_H + IO_TM_STRIDE:
+        case IO_TM0CNT_H + IO_TM_STRIDE * 2:
+        case IO_TM0CNT_H + IO_TM_STRIDE * 3:
+            timer_write_cnt((int)(offset - IO_TM0CNT_H) / IO_TM_STRIDE,
+                            merged);
+            return;
+        case IO_TM0CNT_L:
+        case IO_TM0CNT_L + IO_TM_STRIDE:
+        case IO_TM0CNT_L + IO_TM_STRIDE * 2:
+        case IO_TM0CNT_L + IO_TM_STRIDE * 3: {
+            /* The register reads back the counter, not the reload. */
+            int n = (int)(offset - IO_TM0CNT_L) / IO_TM_STRIDE;
+            timer_write_reload(n, (uint16_t)((timers.ch[n].reload & ~mask) |
+                                             (val & mask)));
+            return;
+        }
+        case IO_DISPSTAT:
+            /* The status bits are read-only. */
+            IO_REG(IO_DISPSTAT) =
+                (uint16_t)((merged & ~7u) | (IO_REG(IO_DISPSTAT) & 7));
+            return;
+        case IO_VCOUNT:
+        case IO_KEYINPUT:
+            return;
+        case IO_IE:
+        case IO_IME:
+            IO_REG(offset) = merged;
+            irq_update();
+            return;
+        case IO_IF:
+            /* Writing 1 acknowledges the interrupt. */
+            IO_REG(IO_IF) &= (uint16_t)~(val & mask);
+            return;
+        case IO_WAITCNT:
+            mmu_update_waitcnt(merged);
+            break;
+        default:
+            break;
+    }
+    IO_REG(offset) = merged;
+    if (offset < PPU_IO_SIZE)
+        ppu_mem_write(MMU_REGION_IO, offset, 2);
+}
+
+void mmu_write_slow(uint32_t addr, uint32_t val, mmu_width_t width)
+{
+    STATS_SCOPE(STATS_MMU);
+    switch (MMU_REGION(addr)) {
+        case MMU_REGION_EWRAM:
+        case MMU_REGION_IWRAM:
+            /* A page write-protected by mmu_protect(). */
+            if (addr >= 0x10000000)
+                break;
+            mmu_touch(addr);
+            mmu_store(mmu.write_page[addr >> MMU_PAGE_SHIFT] +
+                          (addr & MMU_PAGE_MASK),
+                      val, width);
+            break;
+        case MMU_REGION_IO: {
+            uint32_t offset = addr & 0xfffffe;
+            if (offset >= sizeof(mmu.mem.io))
+                return;
+            if (width == MMU_WIDTH_8) {
+                int shift = (addr & 1) * 8;
+                mmu_io_write(offset, (uint16_t)((val & 0xff) << shift),
+                             (uint16_t)(0xff << shift));
+                break;
+            }
+            mmu_io_write(offset, (uint16_t)val, 0xffff);
+            if (width == MMU_WIDTH_32)
+                mmu_io_write(offset + 2, (uint16_t)(val >> 16), 0xffff);
+            break;
+        }
+        case MMU_REGION_PAL:
+            /* 8-bit writes are stored to both bytes of the halfword. */
+            if (width == MMU_WIDTH_8) {
+                width = MMU_WIDTH_16;
+                val = (val & 0xff) * 0x101;
+                addr &= ~1u;
+            }
+            mmu_store(&mmu.mem.pal[addr & 0x3ff], val, width);
+            ppu_mem_write(MMU_REGION_PAL, addr & 0x3ff, 1u << width);
+            break;
+        case MMU_REGION_VRAM: {
+            uint32_t offset = mmu_vram_offset(addr);
+            if (width == MMU_WIDTH_8) {
+                /* Ignored for OBJ tiles, duplicated for BG data. */
+                if (offset >= 0x10000)
+                    return;
+                width = MMU_WIDTH_16;
+                val = (val & 0xff) * 0x101;
+                offset &= ~1u;
+            }
+            mmu_store(&mmu.mem.vram[offset], val, width);
+            mmu_touch(addr);
+            ppu_mem_write(MMU_REGION_VRAM, offset, 1u << width);
+            break;
+        }
+        case MMU_REGION_OAM:
+            if (width != MMU_WIDTH_8) {
+                mmu_store(&mmu.mem.oam[addr & 0x3ff], val, width);
+                ppu_mem_write(MMU_REGION_OAM, addr & 0x3ff, 1u << width);
+            }
+            break;
+        case MMU_REGION_ROM_WS2 + 1:
+            if (backup.type == BACKUP_EEPROM &&
+                addr >= BACKUP_EEPROM_ADDR(mmu.rom_size))
+                backup_eeprom_write((uint16_t)val);
+            break;
+        case MMU_REGION_SRAM:
+        case MMU_REGION_SRAM + 1:
+            backup_write(addr, (uint8_t)val);
+            break;
+        default:
+            break;
+    }
+}
+
+/* Waitstates of an ARM opcode fetch from the cartridge. The buffer fills
+ * one halfword per sequential access time since the previous fetch, and a
+ * fetch it already holds costs no waitstates. */
+static uint32_t mmu_prefetch_charge(uint32_t addr)
+{
+    uint32_t region = MMU_REGION(addr);
+    uint32_t s = mmu.wait[1][MMU_WIDTH_16][region] + 1u;
+    uint64_t elapsed = arm.cycles - mmu.prefetch.last;
+    uint32_t wait;
+    if (addr == mmu.prefetch.head) {
+        uint64_t count = mmu.prefetch.count + elapsed / s;
+        if (count > MMU_PREFETCH_SIZE)
+            count = MMU_PREFETCH_SIZE;
+        if (count >= 2) {
+            wait = 0;
+            count -= 2;
+        } else {
+            wait = count == 1 ? s - 1 : mmu.wait[1][MMU_WIDTH_32][region];
+            count = 0;
+        }
+        mmu.prefetch.count = (uint32_t)count;
+    } else {
+        wait = mmu.wait[addr == mmu.last_addr + 4][MMU_WIDTH_32][region];
+        mmu.prefetch.count = 0;
+    }
+    arm.cycles += wait;
+    mmu.prefetch.head = addr + 4;
+    mmu.prefetch.last = arm.cycles;
+    mmu.last_addr = addr;
+    return wait;
+}
+
+uint32_t mmu_fetch_prefetch(uint32_t addr)
+{
+    uint32_t wait = mmu_prefetch_charge(addr);
+    uint8_t *page = mmu.read_page[addr >> MMU_PAGE_SHIFT];
+    MMU_STATS_COUNT(addr, MMU_WIDTH_32, 0, page == NULL, wait);
+    (void)wait;
+    if (page)
+        return mmu_load(page + (addr & MMU_PAGE_MASK), MMU_WIDTH_32);
+    return mmu_read_slow(addr, MMU_WIDTH_32);
+}
+
+/* DMA accesses, the controller charges its own cycles. */
+uint32_t mmu_dma_read(uint32_t addr, mmu_width_t width)
+{
+    uint8_t *page = addr < 0x10000000 ? mmu.read_page[addr >> MMU_PAGE_SHIFT]
+                                      : NULL;
+    if (page)
+        return mmu_load(page + (addr & MMU_PAGE_MASK), width);
+    return mmu_read_slow(addr, width);
+}
+
+void mmu_dma_write(uint32_t addr, uint32_t val, mmu_width_t width)
+{
+    uint8_t *page = addr < 0x10000000 ? mmu.write_page[addr >> MMU_PAGE_SHIFT]
+                                      : NULL;
+    if (page)
+        mmu_store(page + (addr & MMU_PAGE_MASK), val, width);
+    else
+        mmu_write_slow(addr, val, width);
+}
+
+/* Host memory backing [addr, addr + len) if it is contiguous and can be
+ * accessed directly with 16 or 32-bit units, NULL otherwise. VRAM, PAL
+ * and OAM writes only need the slow path for 8-bit stores. */
+uint8_t *mmu_dma_ptr(uint32_t addr, uint32_t len, bool write)
+{
+    if (len == 0 || addr >= 0x10000000 || len > 0x10000000 - addr)
+        return NULL;
+    switch (MMU_REGION(addr)) {
+        case MMU_REGION_BIOS:
+            return NULL;
+        case MMU_REGION_PAL:
+            return write && (addr & 0x3ff) + len <= 0x400
+                       ? &mmu.mem.pal[addr & 0x3ff]
+                       : NULL;
+        case MMU_REGION_OAM:
+            return write && (addr & 0x3ff) + len <= 0x400
+                       ? &mmu.mem.oam[addr & 0x3ff]
+                       : NULL;
+        default:
+            break;
+    }
+    uint8_t **pages = write && MMU_REGION(addr) != MMU_REGION_VRAM
+                          ? mmu.write_page
+                          : mmu.read_page;
+    uint8_t *host = NULL;
+    for (uint32_t a = addr & ~MMU_PAGE_MASK; a < addr + len;
+         a += MMU_PAGE_SIZE) {
+        if (write)
+            mmu_touch(a);
+        uint8_t *page = pages[a >> MMU_PAGE_SHIFT];
+        if (page == NULL)
+            return NULL;
+        if (host == NULL)
+            host = page + (addr & MMU_PAGE_MASK);
+        else if (page != host + (a - addr))
+            return NULL;
+    }
+    return host;
+}
+
+#ifdef MMU_STATS
+void mmu_stats_count(uint32_t addr, mmu_width_t width, int write, int slow,
+                     uint32_t cycles)
+{
+    int r = addr < 0x10000000 ? mmu_stat_region[MMU_REGION(addr)]
+                              : MMU_STAT_UNMAPPED;
+    mmu_stats.access[r][write][width]++;
+    mmu_stats.slow[r] += (uint64_t)slow;
+    mmu_stats.wait[r] += cycles;
+}
+#endif
+
+void mmu_stats_reset(void)
 {
-    (void)addr;
-    return 0x00;
+    memset(&mmu_stats, 0, sizeof(mmu_stats));
 }
 
-uint16_t mmu_read_half_word(uint32_t addr)
+void mmu_stats_dump(FILE *f)
 {
-    (void)addr;
-    return 0x00;
+#ifndef MMU_STATS
+    fprintf(f, "memory statistics not built (MMU_STATS)\n");
+#else
+    static const char *names[MMU_STAT_NUM] = {
+        "bios", "ewram", "iwram", "io", "pal",
+        "vram", "oam",   "rom",   "sram", "unmapped",
+    };
+    fprintf(f, "%-9s %12s %12s %12s %12s %12s %12s %12s %12s %12s\n",
+            "region", "read8", "read16", "read32", "write8", "write16",
+            "write32", "fast", "slow", "waitstates");
+    for (int r = 0; r < MMU_STAT_NUM; ++r) {
+        uint64_t total = 0;
+        fprintf(f, "%-9s", names[r]);
+        for (int write = 0; write < 2; ++write) {
+            for (int width = MMU_WIDTH_8; width <= MMU_WIDTH_32; ++width) {
+                fprintf(f, " %12llu",
+                        (unsigned long long)mmu_stats.access[r][write][width]);
+                total += mmu_stats.access[r][write][width];
+            }
+        }
+        fprintf(f, " %12llu %12llu %12llu\n",
+                (unsigned long long)(total - mmu_stats.slow[r]),
+                (unsigned long long)mmu_stats.slow[r],
+                (unsigned long long)mmu_stats.wait[r]);
+    }
+#endif
 }
@@ -1,9 +1,246 @@
 #ifndef MMU_H
 #define MMU_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
-uint32_t mmu_read_word(uint32_t addr);
-uint16_t mmu_read_half_word(uint32_t addr);
+#include "arm.h"
+
+/* Page table granularity, the smallest mirrored RAM region is 16KiB. */
+#define MMU_PAGE_SHIFT 14
+#define MMU_PAGE_SIZE (1u << MMU_PAGE_SHIFT)
+#define MMU_PAGE_MASK (MMU_PAGE_SIZE - 1)
+#define MMU_NUM_PAGES (1u << (28 - MMU_PAGE_SHIFT))
+
+#define MMU_ROM_MAX_SIZE 0x2000000
+#define MMU_PREFETCH_SIZE 8
+
+/* Memory regions, indexed by bits 24-27 of the address. */
+typedef enum {
+    MMU_REGION_BIOS = 0x0,
+    MMU_REGION_EWRAM = 0x2,
+    MMU_REGION_IWRAM = 0x3,
+    MMU_REGION_IO = 0x4,
+    MMU_REGION_PAL = 0x5,
+    MMU_REGION_VRAM = 0x6,
+    MMU_REGION_OAM = 0x7,
+    MMU_REGION_ROM_WS0 = 0x8,
+    MMU_REGION_ROM_WS1 = 0xa,
+    MMU_REGION_ROM_WS2 = 0xc,
+    MMU_REGION_SRAM = 0xe,
+} mmu_region_t;
+
+#define MMU_REGION(addr) (((addr) >> 24) & 0xf)
+
+/* Access width, used to index the waitstate tables. */
+typedef enum {
+    MMU_WIDTH_8,
+    MMU_WIDTH_16,
+    MMU_WIDTH_32,
+} mmu_width_t;
+
+/* Internal memory, kept contiguous. */
+typedef struct {
+    uint8_t bios[0x4000];
+    uint8_t ewram[0x40000];
+    uint8_t iwram[0x8000];
+    uint8_t io[0x400];
+    uint8_t pal[0x400];
+    uint8_t vram[0x18000];
+    uint8_t oam[0x400];
+} mmu_mem_t;
+
+/* Pages instances share copy-on-write: EWRAM and IWRAM, then VRAM. */
+#define MMU_COW_RAM_PAGES ((0x40000 + 0x8000) >> MMU_PAGE_SHIFT)
+#define MMU_COW_PAGES (MMU_COW_RAM_PAGES + (0x18000 >> MMU_PAGE_SHIFT))
+#define MMU_COW_ALL ((1u << MMU_COW_PAGES) - 1)
+
+typedef struct {
+    mmu_mem_t mem;
+    const uint8_t *rom; /* read-only, page-rounded and zero padded */
+    uint8_t *rom_copy;  /* owned copy made by mmu_load_rom */
+    uint32_t rom_size;
+    /* Direct pointers to host memory, NULL goes through the slow path. */
+    uint8_t *read_page[MMU_NUM_PAGES];
+    uint8_t *write_page[MMU_NUM_PAGES];
+    /* One bit per copy-on-write page, set once it is written after
+     * mmu_protect(). Clean work RAM pages have no write pointers, so the
+     * first write to one takes the slow path. */
+    uint32_t dirty;
+    /* Saved in states from here to the end, with mem. Extra cycles per
+     * access: [sequential][width][region]. */
+    uint8_t wait[2][3][16];
+    uint32_t last_addr;
+    /* Game Pak prefetch buffer, filled with the halfwords following head
+     * while the CPU is not using the cartridge bus. */
+    struct {
+        bool enabled;
+        uint32_t head;  /* next opcode address the buffer holds */
+        uint32_t count; /* halfwords buffered from head */
+        uint64_t last;  /* cycle count at the previous opcode fetch */
+    } prefetch;
+} mmu_t;
+
+extern mmu_t mmu;
+
+/* Access statistics buckets. */
+typedef enum {
+    MMU_STAT_BIOS,
+    MMU_STAT_EWRAM,
+    MMU_STAT_IWRAM,
+    MMU_STAT_IO,
+    MMU_STAT_PAL,
+    MMU_STAT_VRAM,
+    MMU_STAT_OAM,
+    MMU_STAT_ROM,
+    MMU_STAT_SRAM,
+    MMU_STAT_UNMAPPED,
+    MMU_STAT_NUM,
+} mmu_stat_region_t;
+
+typedef struct {
+    uint64_t access[MMU_STAT_NUM][2][3]; /* [region][write][width] */
+    uint64_t slow[MMU_STAT_NUM];         /* accesses through the slow path */
+    uint64_t wait[MMU_STAT_NUM];         /* waitstate cycles */
+} mmu_stats_t;
+
+extern mmu_stats_t mmu_stats;
+
+void mmu_init(void);
+int mmu_load_rom(const void *data, size_t size);
+void mmu_map_rom(const uint8_t *rom, size_t size);
+uint32_t mmu_read_slow(uint32_t addr, mmu_width_t width);
+void mmu_write_slow(uint32_t addr, uint32_t val, mmu_width_t width);
+uint32_t mmu_fetch_prefetch(uint32_t addr);
+uint32_t mmu_dma_read(uint32_t addr, mmu_width_t width);
+void mmu_dma_write(uint32_t addr, uint32_t val, mmu_width_t width);
+uint8_t *mmu_dma_ptr(uint32_t addr, uint32_t len, bool write);
+uint8_t *mmu_cow_page(unsigned i);
+void mmu_protect(uint32_t pages);
+void mmu_stats_reset(void);
+void mmu_stats_dump(FILE *f);
+
+/* Counting stays out of line, so that it does not weigh on the inlined
+ * fast paths. */
+#ifdef MMU_STATS
+void mmu_stats_count(uint32_t addr, mmu_width_t width, int write, int slow,
+                     uint32_t cycles);
+#define MMU_STATS_COUNT(addr, width, write, is_slow, cycles) \
+    mmu_stats_count(addr, width, write, is_slow, cycles)
+#else
+#define MMU_STATS_COUNT(addr, width, write, is_slow, cycles) \
+    do {                                                    \
+    } while (0)
+#endif
+
+/* Fast paths, inlined into the instruction handlers. Only I/O, unmapped
+ * pages and the write quirks of video memory call into mmu.c. */
+
+static inline uint32_t mmu_charge(uint32_t addr, mmu_width_t width)
+{
+    int seq = addr == mmu.last_addr + (1u << width);
+    uint32_t wait = mmu.wait[seq][width][MMU_REGION(addr)];
+    arm.cycles += wait;
+    mmu.last_addr = addr;
+    return wait;
+}
+
+static inline uint32_t mmu_load(const uint8_t *p, mmu_width_t width)
+{
+    switch (width) {
+        case MMU_WIDTH_8:
+            return *p;
+        case MMU_WIDTH_16:
+            return *(const uint16_t *)p;
+        case MMU_WIDTH_32:
+        default:
+            return *(const uint32_t *)p;
+    }
+}
+
+static inline void mmu_store(uint8_t *p, uint32_t val, mmu_width_t width)
+{
+    switch (width) {
+        case MMU_WIDTH_8:
+            *p = (uint8_t)val;
+            break;
+        case MMU_WIDTH_16:
+            *(uint16_t *)p = (uint16_t)val;
+            break;
+        case MMU_WIDTH_32:
+            *(uint32_t *)p = val;
+            break;
+    }
+}
+
+static inline uint32_t mmu_read(uint32_t addr, mmu_width_t width)
+{
+    /* Data reads from the cartridge interrupt the prefetcher. */
+    if (MMU_REGION(addr) >= MMU_REGION_ROM_WS0)
+        mmu.prefetch.head = 0;
+    uint32_t wait = mmu_charge(addr, width);
+    uint8_t *page = addr < 0x10000000 ? mmu.read_page[addr >> MMU_PAGE_SHIFT]
+                                      : NULL;
+    MMU_STATS_COUNT(addr, width, 0, page == NULL, wait);
+    (void)wait;
+    if (page)
+        return mmu_load(page + (addr & MMU_PAGE_MASK), width);
+    return mmu_read_slow(addr, width);
+}
+
+static inline void mmu_write(uint32_t addr, uint32_t val, mmu_width_t width)
+{
+    uint32_t wait = mmu_charge(addr, width);
+    uint8_t *page = addr < 0x10000000 ? mmu.write_page[addr >> MMU_PAGE_SHIFT]
+                                      : NULL;
+    MMU_STATS_COUNT(addr, width, 1, page == NULL, wait);
+    (void)wait;
+    if (page)
+        mmu_store(page + (addr & MMU_PAGE_MASK), val, width);
+    else
+        mmu_write_slow(addr, val, width);
+}
+
+/* Opcode fetch, cartridge fetches go through the prefetch buffer. */
+static inline uint32_t mmu_fetch_word(uint32_t addr)
+{
+    addr &= ~3u;
+    if (mmu.prefetch.enabled && MMU_REGION(addr) >= MMU_REGION_ROM_WS0 &&
+        addr < 0x0e000000)
+        return mmu_fetch_prefetch(addr);
+    return mmu_read(addr, MMU_WIDTH_32);
+}
+
+static inline uint32_t mmu_read_word(uint32_t addr)
+{
+    return mmu_read(addr & ~3u, MMU_WIDTH_32);
+}
+
+static inline uint16_t mmu_read_half_word(uint32_t addr)
+{
+    return (uint16_t)mmu_read(addr & ~1u, MMU_WIDTH_16);
+}
+
+static inline uint8_t mmu_read_byte(uint32_t addr)
+{
+    return (uint8_t)mmu_read(addr, MMU_WIDTH_8);
+}
+
+static inline void mmu_write_word(uint32_t addr, uint32_t val)
+{
+    mmu_write(addr & ~3u, val, MMU_WIDTH_32);
+}
+
+static inline void mmu_write_half_word(uint32_t addr, uint16_t val)
+{
+    mmu_write(addr & ~1u, val, MMU_WIDTH_16);
+}
+
+static inline void mmu_write_byte(uint32_t addr, uint8_t val)
+{
+    mmu_write(addr, val, MMU_WIDTH_8);
+}
 
 #endif /* !MMU_H */
@@ -0,0 +1,218 @@
+#include "movie.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "gba.h"
+#include "io.h"
+#include "mmu.h"
+#include "state.h"
+
+typedef enum {
+    MOVIE_OFF,
+    MOVIE_RECORD,
+    MOVIE_PLAY,
+} movie_mode_t;
+
+/* Keys are taken at the start of each frame, so a frontend has to change
+ * them between frames for a recording to play back the same. */
+static struct {
+    movie_mode_t mode;
+    char *path; /* written on stop when recording */
+    uint8_t *state;
+    size_t state_size;
+    uint16_t *keys;
+    uint64_t *hash;
+    uint32_t frames; /* in the movie */
+    uint32_t cap;    /* keys allocated */
+    uint32_t hash_interval;
+    uint32_t frame; /* frames run since the start */
+    int64_t diverged;
+} mv = {.diverged = -1};
+
+static void movie_free(void)
+{
+    free(mv.path);
+    free(mv.state);
+    free(mv.keys);
+    free(mv.hash);
+    int64_t diverged = mv.diverged;
+    memset(&mv, 0, sizeof(mv));
+    mv.diverged = diverged;
+}
+
+static int movie_start(uint32_t hash_interval)
+{
+    mv.state_size = state_size();
+    mv.state = malloc(mv.state_size);
+    mv.hash_interval = hash_interval ? hash_interval : MOVIE_HASH_INTERVAL;
+    mv.frame = 0;
+    mv.diverged = -1;
+    return mv.state == NULL ? -1 : 0;
+}
+
+/* Record from the current state until movie_stop(), with a state hash
+ * every hash_interval frames, 0 for the default. */
+int movie_record(const char *path, uint32_t hash_interval)
+{
+    movie_stop();
+    if (movie_start(hash_interval) != 0 ||
+        (mv.path = strdup(path)) == NULL) {
+        movie_free();
+        return -1;
+    }
+    state_save(mv.state, mv.state_size);
+    mv.mode = MOVIE_RECORD;
+    return 0;
+}
+
+/* The header comes from the file, so the counts in it are only trusted
+ * once they add up to the file's length. */
+static int movie_read(FILE *f)
+{
+    movie_header_t h;
+    struct stat st;
+    if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != MOVIE_MAGIC ||
+        h.version != MOVIE_VERSION || h.hash_interval == 0 ||
+        h.state_size != state_size() || fstat(fileno(f), &st) != 0)
+        return -1;
+    size_t frames = h.frames;
+    size_t hashes = frames / h.hash_interval;
+    if ((uint64_t)st.st_size != sizeof(h) + h.state_size +
+                                    frames * sizeof(mv.keys[0]) +
+                                    hashes * sizeof(mv.hash[0]))
+        return -1;
+    if (movie_start(h.hash_interval) != 0)
+        return -1;
+    mv.frames = h.frames;
+    mv.keys = malloc((frames + 1) * sizeof(mv.keys[0]));
+    mv.hash = malloc((hashes + 1) * sizeof(mv.hash[0]));
+    if (mv.keys == NULL || mv.hash == NULL)
+        return -1;
+    if (fread(mv.state, 1, mv.state_size, f) != mv.state_size ||
+        fread(mv.keys, sizeof(mv.keys[0]), frames, f) != frames ||
+        fread(mv.hash, sizeof(mv.hash[0]), hashes, f) != hashes)
+        return -1;
+    return state_load(mv.state, mv.state_size);
+}
+
+/* Go back to the state the movie starts from and play its keys from
+ * there, checking the state hashes on the way. */
+int movie_play(const char *path)
+{
+    movie_stop();
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return -1;
+    int ret = movie_read(f);
+    fclose(f);
+    if (ret != 0) {
+        movie_free();
+        return -1;
+    }
+    mv.mode = MOVIE_PLAY;
+    return 0;
+}
+
+static int movie_write(FILE *f)
+{
+    movie_header_t h = {
+        .magic = MOVIE_MAGIC,
+        .version = MOVIE_VERSION,
+        .frames = mv.frames,
+        .hash_interval = mv.hash_interval,
+        .state_size = (uint32_t)mv.state_size,
+    };
+    size_t n = mv.frames / mv.hash_interval;
+    if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+        fwrite(mv.state, 1, mv.state_size, f) != mv.state_size ||
+        fwrite(mv.keys, sizeof(mv.keys[0]), mv.frames, f) != mv.frames ||
+        fwrite(mv.hash, sizeof(mv.hash[0]), n, f) != n)
+        return -1;
+    return 0;
+}
+
+/* Ends playback, or ends a recording and writes it out. */
+int movie_stop(void)
+{
+    int ret = 0;
+    if (mv.mode == MOVIE_RECORD) {
+        FILE *f = fopen(mv.path, "wb");
+        ret = f != NULL && movie_write(f) == 0 ? 0 : -1;
+        if (f != NULL && fclose(f) != 0)
+            ret = -1;
+    }
+    movie_free();
+    return ret;
+}
+
+/* Recording, or playing with frames left. */
+bool movie_active(void)
+{
+    return mv.mode == MOVIE_RECORD ||
+           (mv.mode == MOVIE_PLAY && mv.frame < mv.frames);
+}
+
+uint32_t movie_length(void)
+{
+    return mv.frames;
+}
+
+/* The first frame after which the state hash did not match the
+ * recording's, -1 if there was none. The state went wrong during one of
+ * the hash_interval frames before it. */
+int64_t movie_divergence(void)
+{
+    return mv.diverged;
+}
+
+static int movie_grow(void)
+{
+    uint32_t cap = mv.cap ? mv.cap * 2 : 1024;
+    uint16_t *keys = realloc(mv.keys, cap * sizeof(keys[0]));
+    if (keys == NULL)
+        return -1;
+    mv.keys = keys;
+    uint64_t *hash =
+        realloc(mv.hash, (cap / mv.hash_interval + 1) * sizeof(hash[0]));
+    if (hash == NULL)
+        return -1;
+    mv.hash = hash;
+    mv.cap = cap;
+    return 0;
+}
+
+void movie_frame_start(void)
+{
+    if (!movie_active())
+        return;
+    if (mv.mode == MOVIE_PLAY) {
+        gba_set_keys(mv.keys[mv.frame]);
+        return;
+    }
+    if (mv.frame == mv.cap && movie_grow() != 0) {
+        /* Keep what was recorded so far. */
+        movie_stop();
+        return;
+    }
+    mv.keys[mv.frame] = (uint16_t)(~IO_REG(IO_KEYINPUT) & GBA_KEY_ALL);
+}
+
+void movie_frame_end(void)
+{
+    if (!movie_active())
+        return;
+    mv.frame++;
+    if (mv.mode == MOVIE_RECORD)
+        mv.frames = mv.frame;
+    if (mv.frame % mv.hash_interval)
+        return;
+    uint64_t h = state_hash();
+    uint32_t i = mv.frame / mv.hash_interval - 1;
+    if (mv.mode == MOVIE_RECORD)
+        mv.hash[i] = h;
+    else if (h != mv.hash[i] && mv.diverged < 0)
+        mv.diverged = mv.frame;
+}
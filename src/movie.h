@@ -0,0 +1,32 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MOVIE_MAGIC 0x564d5347u /* "GSMV" */
+#define MOVIE_VERSION 1
+#define MOVIE_HASH_INTERVAL 60
+
+/* A movie is this header, the state it starts from, the keys held in
+ * each frame as 16-bit words, then a 64-bit state hash for every
+ * hash_interval frames. All in host byte order. */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t frames;
+    uint32_t hash_interval;
+    uint32_t state_size;
+    uint32_t reserved;
+} movie_header_t;
+
+int movie_record(const char *path, uint32_t hash_interval);
+int movie_play(const char *path);
+int movie_stop(void);
+bool movie_active(void);
+uint32_t movie_length(void);
+int64_t movie_divergence(void);
+void movie_frame_start(void);
+void movie_frame_end(void);
+
+#endif /* !MOVIE_H */
@@ -0,0 +1,415 @@
+#include "ppu.h"
+
+#include <string.h>
+
+#include "arm.h"
+#include "dma.h"
+#include "gba.h"
+#include "io.h"
+#include "irq.h"
+#include "mmu.h"
+#include "ppu_blend.h"
+#include "ppu_color.h"
+#include "sched.h"
+#include "stats.h"
+
+/* The renderer reads the MMU's memory until a render thread takes over. */
+ppu_t ppu = {
+    .mem = {mmu.mem.io, mmu.mem.pal, mmu.mem.vram, mmu.mem.oam},
+};
+
+static void ppu_fill(uint32_t *out, uint32_t color, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i)
+        out[i] = color;
+}
+
+/* Is BG2 drawn unscaled from the origin on line y, so that a bitmap line
+ * is a line of VRAM. */
+static bool ppu_bitmap_direct(uint32_t y)
+{
+    return PPU_REG(IO_BG2PA) == 0x100 && PPU_REG(IO_BG2PC) == 0 &&
+           ppu.affine[0].x == 0 && ppu.affine[0].y == (int32_t)(y << 8);
+}
+
+/* Bitmap modes draw BG2 straight from VRAM when ppu_bitmap_direct(). */
+static void ppu_render_bitmap(uint32_t y, uint16_t dispcnt, uint32_t *out)
+{
+    const uint8_t *vram = ppu.mem.vram;
+    uint32_t backdrop = ppu.host_pal[0];
+    uint32_t page = dispcnt & PPU_DISPCNT_PAGE ? 0xa000 : 0;
+
+    if (!(dispcnt & PPU_DISPCNT_BG(2))) {
+        ppu_fill(out, backdrop, PPU_WIDTH);
+        return;
+    }
+    switch (PPU_DISPCNT_MODE(dispcnt)) {
+        case 3:
+            ppu_color_convert(out, (const uint16_t *)&vram[y * PPU_WIDTH * 2],
+                              PPU_WIDTH);
+            break;
+        case 4:
+            ppu_color_lookup(out, &vram[page + y * PPU_WIDTH], ppu.host_pal,
+                             PPU_WIDTH);
+            break;
+        case 5:
+            /* 160x128, the rest of the screen shows the backdrop. */
+            if (y >= 128) {
+                ppu_fill(out, backdrop, PPU_WIDTH);
+                break;
+            }
+            ppu_color_convert(out, (const uint16_t *)&vram[page + y * 320],
+                              160);
+            ppu_fill(&out[160], backdrop, PPU_WIDTH - 160);
+            break;
+        default:
+            ppu_fill(out, backdrop, PPU_WIDTH);
+            break;
+    }
+}
+
+/* Does a window span [start, end) contain pos, the range wraps around
+ * when start is past end. */
+static bool ppu_win_inside(uint32_t pos, uint32_t start, uint32_t end)
+{
+    return start <= end ? pos >= start && pos < end : pos >= start || pos < end;
+}
+
+/* Enabled layers of each pixel of line y as WININ and WINOUT bits. WIN0
+ * takes precedence over WIN1, then the OBJ window, then the outside. */
+static void ppu_window(uint32_t y, uint16_t dispcnt, const ppu_obj_line_t *obj,
+                       uint8_t *win)
+{
+    uint16_t winin = PPU_REG(IO_WININ), winout = PPU_REG(IO_WINOUT);
+
+    if (!(dispcnt & (PPU_DISPCNT_WIN(0) | PPU_DISPCNT_WIN(1) |
+                     PPU_DISPCNT_WINOBJ))) {
+        memset(win, 0x3f, PPU_WIDTH);
+        return;
+    }
+    memset(win, winout & 0x3f, PPU_WIDTH);
+    if ((dispcnt & PPU_DISPCNT_WINOBJ) && obj != NULL) {
+        for (int x = 0; x < PPU_WIDTH; ++x)
+            win[x] = obj->flags[x] & PPU_OBJ_WINDOW
+                         ? (uint8_t)((winout >> 8) & 0x3f)
+                         : win[x];
+    }
+    for (int n = 1; n >= 0; --n) {
+        uint16_t h = PPU_REG(IO_WIN0H + (uint32_t)n * 2);
+        uint16_t v = PPU_REG(IO_WIN0V + (uint32_t)n * 2);
+        uint32_t left = h >> 8, right = h & 0xff;
+        uint8_t bits = (uint8_t)((winin >> (n * 8)) & 0x3f);
+        if (!(dispcnt & PPU_DISPCNT_WIN(n)) ||
+            !ppu_win_inside(y, v >> 8, v & 0xff))
+            continue;
+        bool wraps = left > right;
+        left = left > PPU_WIDTH ? PPU_WIDTH : left;
+        right = right > PPU_WIDTH ? PPU_WIDTH : right;
+        if (wraps) {
+            memset(win, bits, right);
+            memset(&win[left], bits, PPU_WIDTH - left);
+        } else {
+            memset(&win[left], bits, right - left);
+        }
+    }
+}
+
+/* Pack a background line for composition, dropping pixels its window
+ * hides. */
+static void ppu_pack_bg(uint32_t *out, const uint16_t *layer,
+                        const uint8_t *win, int bg)
+{
+    uint32_t cnt = PPU_REG(IO_BG0CNT + (uint32_t)bg * 2);
+    uint32_t attr = PPU_LAYER(PPU_BGCNT_PRIO(cnt), bg + 1, bg);
+    for (int x = 0; x < PPU_WIDTH; ++x)
+        out[x] = (layer[x] & PPU_OPAQUE) && (win[x] & (1u << bg))
+                     ? attr | (layer[x] & 0x7fff)
+                     : PPU_LAYER_NONE;
+}
+
+/* Sprites go in front of backgrounds of the same priority. */
+static void ppu_pack_obj(uint32_t *out, const ppu_obj_line_t *obj,
+                         const uint8_t *win)
+{
+    for (int x = 0; x < PPU_WIDTH; ++x) {
+        uint32_t f = obj->flags[x];
+        out[x] = (obj->color[x] & PPU_OPAQUE) &&
+                         (win[x] & (1u << PPU_LAYER_OBJ))
+                     ? PPU_LAYER(PPU_OBJ_PRIO(f), 0, PPU_LAYER_OBJ) |
+                           (f & PPU_OBJ_BLEND ? PPU_LAYER_SEMI : 0) |
+                           (obj->color[x] & 0x7fff)
+                     : PPU_LAYER_NONE;
+    }
+}
+
+static void ppu_blend_regs(ppu_blend_t *b)
+{
+    uint16_t bldcnt = PPU_REG(IO_BLDCNT), bldalpha = PPU_REG(IO_BLDALPHA);
+    uint32_t evy = PPU_REG(IO_BLDY) & 0x1f;
+    b->first = bldcnt & 0x3f;
+    b->second = (bldcnt >> 8) & 0x3f;
+    b->mode = PPU_BLDCNT_MODE(bldcnt);
+    b->eva = bldalpha & 0x1f;
+    b->evb = (bldalpha >> 8) & 0x1f;
+    b->eva = b->eva > 16 ? 16 : b->eva;
+    b->evb = b->evb > 16 ? 16 : b->evb;
+    b->evy = evy > 16 ? 16 : evy;
+}
+
+/* Draw each enabled layer into its own line and keep the two frontmost
+ * pixels of every column, then apply the color special effects to whole
+ * lines. Layers are stacked in any order, the packed priorities decide. */
+static void ppu_render_layers(uint32_t y, uint16_t dispcnt, uint32_t *out)
+{
+    static const uint8_t text_mask[8] = {0xf, 0x3, 0x0, 0, 0, 0, 0, 0};
+    static const uint8_t other_mask[8] = {0x0, 0x4, 0xc, 0x4, 0x4, 0x4, 0, 0};
+    uint32_t mode = PPU_DISPCNT_MODE(dispcnt);
+    uint16_t layer[PPU_WIDTH];
+    uint32_t packed[PPU_WIDTH], top[PPU_WIDTH], below[PPU_WIDTH];
+    uint16_t line[PPU_WIDTH];
+    uint8_t win[PPU_WIDTH];
+    ppu_obj_line_t obj;
+    ppu_blend_t blend;
+
+    bool objs = (dispcnt & (PPU_DISPCNT_OBJ | PPU_DISPCNT_WINOBJ)) &&
+                ppu_obj_line(y, dispcnt, &obj);
+    ppu_window(y, dispcnt, objs ? &obj : NULL, win);
+
+    uint32_t backdrop = PPU_LAYER(4, 0, PPU_LAYER_BD) |
+                        (((const uint16_t *)ppu.mem.pal)[0] & 0x7fff);
+    for (int x = 0; x < PPU_WIDTH; ++x) {
+        top[x] = backdrop;
+        below[x] = PPU_LAYER_NONE;
+    }
+    for (int bg = 0; bg < 4; ++bg) {
+        if (!(dispcnt & PPU_DISPCNT_BG(bg)) ||
+            !((text_mask[mode] | other_mask[mode]) & (1u << bg)))
+            continue;
+        if (text_mask[mode] & (1u << bg))
+            ppu_bg_text(bg, y, layer);
+        else if (mode <= 2)
+            ppu_bg_affine(bg, layer);
+        else
+            ppu_bg_bitmap(dispcnt, layer);
+        ppu_pack_bg(packed, layer, win, bg);
+        ppu_blend_stack(top, below, packed, PPU_WIDTH);
+    }
+    if (objs && (dispcnt & PPU_DISPCNT_OBJ)) {
+        ppu_pack_obj(packed, &obj, win);
+        ppu_blend_stack(top, below, packed, PPU_WIDTH);
+    }
+    ppu_blend_regs(&blend);
+    ppu_blend_effects(line, top, below, win, &blend, PPU_WIDTH);
+    ppu_color_convert(out, line, PPU_WIDTH);
+}
+
+void ppu_render_line(uint32_t y)
+{
+    STATS_SCOPE(STATS_PPU);
+    uint16_t dispcnt = PPU_REG(IO_DISPCNT);
+    uint32_t *out = &ppu.frame[y * PPU_WIDTH];
+
+    /* Unscaled bitmap modes without sprites, windows or effects convert
+     * VRAM straight to the frame. */
+    if (dispcnt & PPU_DISPCNT_BLANK)
+        ppu_fill(out, ppu_color_host(0x7fff), PPU_WIDTH);
+    else if (PPU_DISPCNT_MODE(dispcnt) >= 3 &&
+             !(dispcnt & (PPU_DISPCNT_OBJ | PPU_DISPCNT_WIN(0) |
+                          PPU_DISPCNT_WIN(1) | PPU_DISPCNT_WINOBJ)) &&
+             PPU_BLDCNT_MODE(PPU_REG(IO_BLDCNT)) == 0 &&
+             ppu_bitmap_direct(y))
+        ppu_render_bitmap(y, dispcnt, out);
+    else
+        ppu_render_layers(y, dispcnt, out);
+}
+
+/* Reload an affine reference point from its 28-bit signed registers, on
+ * writes and at the start of each frame. */
+void ppu_affine_latch(int bg)
+{
+    uint32_t regs = (uint32_t)(bg - 2) * IO_BG_AFFINE_STRIDE;
+    uint32_t x = PPU_REG(IO_BG2X + regs) | (uint32_t)PPU_REG(IO_BG2X + regs + 2)
+                                               << 16;
+    uint32_t y = PPU_REG(IO_BG2Y + regs) | (uint32_t)PPU_REG(IO_BG2Y + regs + 2)
+                                               << 16;
+    ppu.affine[bg - 2].x = (int32_t)(x << 4) >> 4;
+    ppu.affine[bg - 2].y = (int32_t)(y << 4) >> 4;
+}
+
+/* Step the reference points to the next line by PB and PD. */
+static void ppu_affine_step(void)
+{
+    for (int i = 0; i < 2; ++i) {
+        uint32_t regs = (uint32_t)i * IO_BG_AFFINE_STRIDE;
+        ppu.affine[i].x += (int16_t)PPU_REG(IO_BG2PB + regs);
+        ppu.affine[i].y += (int16_t)PPU_REG(IO_BG2PD + regs);
+    }
+}
+
+/* End of the visible part of line y, for the renderer. */
+void ppu_scanline(uint32_t y)
+{
+    ppu_render_line(y);
+    ppu_affine_step();
+}
+
+/* Start of VBlank, for the renderer. */
+void ppu_vblank(void)
+{
+    ppu_affine_latch(2);
+    ppu_affine_latch(3);
+    ppu_obj_update();
+}
+
+/* Keep the host format palette in step with palette RAM. */
+static void ppu_pal_write(uint32_t offset, uint32_t len)
+{
+    const uint16_t *pal = (const uint16_t *)ppu.mem.pal;
+    for (uint32_t i = offset / 2; i < (offset + len + 1) / 2 && i < 512; ++i)
+        ppu.host_pal[i] = ppu_color_host(pal[i]);
+}
+
+/* Change the color correction, see ppu_color_correct. */
+void ppu_color_correction(const uint8_t *lut)
+{
+    ppu_thread_sync();
+    ppu_color_correct(lut);
+    ppu_pal_write(0, 0x400);
+}
+
+/* Video memory or a display register was stored to. The render thread
+ * gets the change through its log, in order with the scanlines. */
+void ppu_mem_write(mmu_region_t region, uint32_t offset, uint32_t len)
+{
+    if (ppu.threaded)
+        ppu_log_write(region, offset, len);
+    else
+        ppu_mem_changed(region, offset, len);
+}
+
+/* Drop what the renderer derived from memory that changed. */
+void ppu_mem_changed(mmu_region_t region, uint32_t offset, uint32_t len)
+{
+    switch (region) {
+        case MMU_REGION_VRAM:
+            ppu_vram_write(offset, len);
+            break;
+        case MMU_REGION_PAL:
+            ppu_pal_write(offset, len);
+            break;
+        case MMU_REGION_OAM:
+            ppu_oam_write(offset, len);
+            break;
+        case MMU_REGION_IO:
+            /* BGxX and BGxY, the last 8 bytes of each affine block. */
+            if (offset >= IO_BG2X && offset < IO_BG3Y + 4 && (offset & 8))
+                ppu_affine_latch(offset < IO_BG3X ? 2 : 3);
+            break;
+        default:
+            break;
+    }
+}
+
+static void ppu_set_stat(uint16_t set, uint16_t clear)
+{
+    IO_REG(IO_DISPSTAT) = (uint16_t)((IO_REG(IO_DISPSTAT) & ~clear) | set);
+}
+
+/* Whether the frame starting now is drawn. Skipped frames only keep the
+ * timing: VCOUNT, the status flags, IRQs and DMA. */
+static bool ppu_frame_wanted(void)
+{
+    if (gba.render_request) {
+        gba.render_request = false;
+        return true;
+    }
+    return gba.video && ppu.frames % (gba.frameskip + 1) == 0;
+}
+
+/* The video or frameskip settings changed, the current frame is drawn or
+ * skipped by the new ones from its next line. */
+void ppu_video_changed(void)
+{
+    ppu.render = ppu_frame_wanted();
+}
+
+/* Start of a scanline. */
+static void ppu_hdraw(uint64_t when)
+{
+    ppu.line = (ppu.line + 1) % PPU_LINES;
+    if (ppu.line == 0)
+        ppu.render = ppu_frame_wanted();
+    IO_REG(IO_VCOUNT) = (uint16_t)ppu.line;
+    uint16_t stat = IO_REG(IO_DISPSTAT);
+
+    ppu_set_stat(0, PPU_STAT_HBLANK);
+    if (ppu.line == PPU_HEIGHT) {
+        ppu_set_stat(PPU_STAT_VBLANK, 0);
+        if (stat & PPU_STAT_VBLANK_IRQ)
+            irq_raise(IRQ_VBLANK);
+        dma_trigger(DMA_VBLANK);
+        if (ppu.threaded)
+            ppu_log_vblank();
+        else
+            ppu_vblank();
+        ppu.frames++;
+    } else if (ppu.line == PPU_LINES - 1) {
+        ppu_set_stat(0, PPU_STAT_VBLANK);
+    }
+    if (ppu.line == PPU_STAT_LYC(stat)) {
+        ppu_set_stat(PPU_STAT_VCOUNT, 0);
+        if (stat & PPU_STAT_VCOUNT_IRQ)
+            irq_raise(IRQ_VCOUNT);
+    } else {
+        ppu_set_stat(0, PPU_STAT_VCOUNT);
+    }
+    sched_schedule(SCHED_PPU, when + PPU_HDRAW_CYCLES);
+}
+
+/* End of the visible part of a scanline, render it as it stands. */
+static void ppu_hblank(uint64_t when)
+{
+    if (ppu.line < PPU_HEIGHT && ppu.render && ppu.threaded)
+        ppu_log_line(ppu.line);
+    else if (ppu.line < PPU_HEIGHT && ppu.render)
+        ppu_scanline(ppu.line);
+    ppu_set_stat(PPU_STAT_HBLANK, 0);
+    if (IO_REG(IO_DISPSTAT) & PPU_STAT_HBLANK_IRQ)
+        irq_raise(IRQ_HBLANK);
+    if (ppu.line < PPU_HEIGHT)
+        dma_trigger(DMA_HBLANK);
+    sched_schedule(SCHED_PPU, when + PPU_HBLANK_CYCLES);
+}
+
+/* The HBlank flag tells which half of the line ends, so the handler is
+ * fixed and a saved state does not need to know about it. */
+static void ppu_event(uint64_t when)
+{
+    if (IO_REG(IO_DISPSTAT) & PPU_STAT_HBLANK)
+        ppu_hdraw(when);
+    else
+        ppu_hblank(when);
+}
+
+void ppu_init(void)
+{
+    ppu_thread_stop();
+    memset(&ppu, 0, sizeof(ppu));
+    ppu.mem.io = mmu.mem.io;
+    ppu.mem.pal = mmu.mem.pal;
+    ppu.mem.vram = mmu.mem.vram;
+    ppu.mem.oam = mmu.mem.oam;
+    ppu.render = gba.video;
+    ppu_color_init();
+    ppu_pal_write(0, 0x400);
+    /* BG2 and BG3 start unscaled, as the BIOS leaves them. */
+    IO_REG(IO_BG2PA) = 0x100;
+    IO_REG(IO_BG2PD) = 0x100;
+    IO_REG(IO_BG2PA + IO_BG_AFFINE_STRIDE) = 0x100;
+    IO_REG(IO_BG2PD + IO_BG_AFFINE_STRIDE) = 0x100;
+    ppu_blend_init();
+    ppu_bg_init();
+    ppu_obj_init();
+    sched_set_handler(SCHED_PPU, ppu_event);
+    sched_schedule(SCHED_PPU, arm.cycles + PPU_HDRAW_CYCLES);
+}
@@ -0,0 +1,113 @@
+#ifndef PPU_H
+#define PPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mmu.h"
+
+#define PPU_WIDTH 240
+#define PPU_HEIGHT 160
+#define PPU_LINES 228
+#define PPU_HDRAW_CYCLES 960
+#define PPU_HBLANK_CYCLES 272
+#define PPU_LINE_CYCLES (PPU_HDRAW_CYCLES + PPU_HBLANK_CYCLES)
+#define PPU_VRAM_SIZE 0x18000
+#define PPU_IO_SIZE 0x58 /* display registers, up to BLDY */
+
+/* DISPCNT */
+#define PPU_DISPCNT_MODE(v) ((v) & 7)
+#define PPU_DISPCNT_PAGE (1u << 4)
+#define PPU_DISPCNT_OBJ_1D (1u << 6)
+#define PPU_DISPCNT_BLANK (1u << 7)
+#define PPU_DISPCNT_BG(n) (1u << (8 + (n)))
+#define PPU_DISPCNT_OBJ (1u << 12)
+#define PPU_DISPCNT_WIN(n) (1u << (13 + (n)))
+#define PPU_DISPCNT_WINOBJ (1u << 15)
+
+/* BGxCNT */
+#define PPU_BGCNT_PRIO(v) ((v) & 3)
+
+/* BLDCNT */
+#define PPU_BLDCNT_MODE(v) (((v) >> 6) & 3u)
+
+/* Layer line buffers hold BGR555 colors, this bit marks opaque pixels. */
+#define PPU_OPAQUE 0x8000
+
+/* OBJ line flags, the priority is in the low bits. */
+#define PPU_OBJ_PRIO(f) ((f) & 3u)
+#define PPU_OBJ_BLEND (1u << 2)  /* semi-transparent */
+#define PPU_OBJ_WINDOW (1u << 3) /* inside the OBJ window */
+
+/* DISPSTAT */
+#define PPU_STAT_VBLANK (1u << 0)
+#define PPU_STAT_HBLANK (1u << 1)
+#define PPU_STAT_VCOUNT (1u << 2)
+#define PPU_STAT_VBLANK_IRQ (1u << 3)
+#define PPU_STAT_HBLANK_IRQ (1u << 4)
+#define PPU_STAT_VCOUNT_IRQ (1u << 5)
+#define PPU_STAT_LYC(v) ((v) >> 8)
+
+typedef struct {
+    uint32_t line;
+    uint64_t frames;
+    /* Internal affine reference points of BG2 and BG3, 20.8 fixed point. */
+    struct {
+        int32_t x;
+        int32_t y;
+    } affine[2];
+
+    /* Saved states stop here, the rest is host side. Memory the
+     * renderer reads: the MMU's, or the render thread's copy while it
+     * runs. */
+    struct {
+        uint8_t *io;
+        uint8_t *pal;
+        uint8_t *vram;
+        uint8_t *oam;
+    } mem;
+    bool threaded;
+    /* The current frame is drawn, a host choice that does not change how
+     * the machine runs. */
+    bool render;
+    uint32_t host_pal[512]; /* palette RAM converted to the frame format */
+    uint32_t frame[PPU_HEIGHT * PPU_WIDTH]; /* RGBA8888 */
+} ppu_t;
+
+extern ppu_t ppu;
+
+/* Display register as the renderer sees it. */
+#define PPU_REG(offset) (*(uint16_t *)&ppu.mem.io[(offset)])
+
+typedef struct {
+    uint16_t color[PPU_WIDTH];
+    uint8_t flags[PPU_WIDTH];
+} ppu_obj_line_t;
+
+void ppu_init(void);
+void ppu_render_line(uint32_t y);
+void ppu_scanline(uint32_t y);
+void ppu_vblank(void);
+void ppu_video_changed(void);
+void ppu_mem_write(mmu_region_t region, uint32_t offset, uint32_t len);
+void ppu_mem_changed(mmu_region_t region, uint32_t offset, uint32_t len);
+void ppu_affine_latch(int bg);
+void ppu_color_correction(const uint8_t *lut);
+void ppu_vram_write(uint32_t offset, uint32_t len);
+void ppu_bg_init(void);
+void ppu_bg_text(int bg, uint32_t y, uint16_t *line);
+void ppu_bg_affine(int bg, uint16_t *line);
+void ppu_bg_bitmap(uint16_t dispcnt, uint16_t *line);
+const uint8_t *ppu_tile_4bpp(uint32_t t);
+void ppu_oam_write(uint32_t offset, uint32_t len);
+void ppu_obj_init(void);
+void ppu_obj_update(void);
+bool ppu_obj_line(uint32_t y, uint16_t dispcnt, ppu_obj_line_t *out);
+void ppu_thread_start(void);
+void ppu_thread_stop(void);
+void ppu_thread_sync(void);
+void ppu_log_write(mmu_region_t region, uint32_t offset, uint32_t len);
+void ppu_log_line(uint32_t y);
+void ppu_log_vblank(void);
+
+#endif /* !PPU_H */
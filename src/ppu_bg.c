@@ -0,0 +1,157 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "io.h"
+#include "ppu.h"
+
+#define PPU_TILES (PPU_VRAM_SIZE / 32)
+
+/* 4bpp tiles expanded to one palette index per byte, so that a tile row
+ * is a single 64-bit load. Tiles are decoded on first use after VRAM
+ * under them was written. 8bpp tiles are already in that form. The cache
+ * covers the OBJ tiles as well. */
+static struct {
+    uint8_t tiles[PPU_TILES][64];
+    uint32_t dirty[PPU_TILES / 32];
+} cache;
+
+void ppu_bg_init(void)
+{
+    memset(cache.dirty, 0xff, sizeof(cache.dirty));
+}
+
+void ppu_vram_write(uint32_t offset, uint32_t len)
+{
+    for (uint32_t t = offset / 32; t <= (offset + len - 1) / 32; ++t)
+        cache.dirty[t / 32] |= 1u << (t % 32);
+}
+
+const uint8_t *ppu_tile_4bpp(uint32_t t)
+{
+    if (cache.dirty[t / 32] & (1u << (t % 32))) {
+        const uint8_t *src = &ppu.mem.vram[t * 32];
+        for (int i = 0; i < 32; ++i) {
+            cache.tiles[t][i * 2] = src[i] & 0xf;
+            cache.tiles[t][i * 2 + 1] = src[i] >> 4;
+        }
+        cache.dirty[t / 32] &= ~(1u << (t % 32));
+    }
+    return cache.tiles[t];
+}
+
+/* Write 8 pixels of a tile row, palette indices in byte order. */
+static void ppu_put_row(uint16_t *out, uint64_t row, const uint16_t *pal)
+{
+    if (row == 0) {
+        memset(out, 0, 8 * sizeof(*out));
+        return;
+    }
+    for (int i = 0; i < 8; ++i) {
+        uint8_t idx = (uint8_t)(row >> (i * 8));
+        out[i] = idx ? (uint16_t)(pal[idx] | PPU_OPAQUE) : 0;
+    }
+}
+
+/* Text background line, drawn a tile row at a time from the map. */
+void ppu_bg_text(int bg, uint32_t y, uint16_t *line)
+{
+    uint16_t cnt = PPU_REG(IO_BG0CNT + (uint32_t)bg * 2);
+    uint32_t hofs = PPU_REG(IO_BG0HOFS + (uint32_t)bg * 4) & 0x1ff;
+    uint32_t vofs = PPU_REG(IO_BG0VOFS + (uint32_t)bg * 4) & 0x1ff;
+    uint32_t size = cnt >> 14;
+    uint32_t width = size & 1 ? 64 : 32; /* in tiles */
+    uint32_t height = size & 2 ? 64 : 32;
+    uint32_t char_base = ((cnt >> 2) & 3) * 0x4000;
+    uint32_t screen_base = ((cnt >> 8) & 0x1f) * 0x800;
+    bool bpp8 = cnt & 0x80;
+    const uint16_t *pal = (const uint16_t *)ppu.mem.pal;
+    uint32_t sy = (y + vofs) & (height * 8 - 1);
+    uint32_t my = sy >> 3;
+    uint16_t buf[PPU_WIDTH + 8];
+
+    for (uint32_t i = 0; i <= PPU_WIDTH / 8; ++i) {
+        uint32_t mx = ((hofs >> 3) + i) & (width - 1);
+        uint32_t block = (mx >> 5) + (my >> 5) * (width >> 5);
+        uint32_t entry_addr =
+            screen_base + block * 0x800 + ((my & 31) * 32 + (mx & 31)) * 2;
+        uint16_t entry = *(const uint16_t *)&ppu.mem.vram[entry_addr];
+        uint32_t tile = entry & 0x3ff;
+        uint32_t row = entry & 0x800 ? 7 - (sy & 7) : sy & 7;
+        uint32_t addr = char_base + tile * (bpp8 ? 64 : 32);
+        uint64_t pixels = 0;
+        const uint16_t *tile_pal = pal;
+        /* Tiles past the BG area read as transparent. */
+        if (addr < 0x10000 && bpp8) {
+            memcpy(&pixels, &ppu.mem.vram[addr + row * 8], 8);
+        } else if (addr < 0x10000) {
+            memcpy(&pixels, &ppu_tile_4bpp(addr / 32)[row * 8], 8);
+            tile_pal = &pal[(entry >> 12) * 16];
+        }
+        if (entry & 0x400)
+            pixels = __builtin_bswap64(pixels);
+        ppu_put_row(&buf[i * 8], pixels, tile_pal);
+    }
+    memcpy(line, &buf[hofs & 7], PPU_WIDTH * sizeof(*line));
+}
+
+/* Affine background line, stepping the reference point by PA and PC per
+ * pixel. Maps are one byte per entry and tiles are always 8bpp. */
+void ppu_bg_affine(int bg, uint16_t *line)
+{
+    uint32_t regs = (uint32_t)(bg - 2) * IO_BG_AFFINE_STRIDE;
+    uint16_t cnt = PPU_REG(IO_BG0CNT + (uint32_t)bg * 2);
+    int32_t pa = (int16_t)PPU_REG(IO_BG2PA + regs);
+    int32_t pc = (int16_t)PPU_REG(IO_BG2PC + regs);
+    int32_t x = ppu.affine[bg - 2].x, y = ppu.affine[bg - 2].y;
+    uint32_t size = 128u << (cnt >> 14);
+    uint32_t char_base = ((cnt >> 2) & 3) * 0x4000;
+    uint32_t screen_base = ((cnt >> 8) & 0x1f) * 0x800;
+    bool wrap = cnt & (1u << 13);
+    const uint8_t *vram = ppu.mem.vram;
+    const uint16_t *pal = (const uint16_t *)ppu.mem.pal;
+
+    for (uint32_t i = 0; i < PPU_WIDTH; ++i, x += pa, y += pc) {
+        uint32_t px = (uint32_t)(x >> 8), py = (uint32_t)(y >> 8);
+        if (wrap) {
+            px &= size - 1;
+            py &= size - 1;
+        } else if (px >= size || py >= size) {
+            line[i] = 0;
+            continue;
+        }
+        uint8_t tile = vram[screen_base + (py >> 3) * (size >> 3) + (px >> 3)];
+        uint32_t addr = char_base + tile * 64u + (py & 7) * 8 + (px & 7);
+        uint8_t idx = addr < 0x10000 ? vram[addr] : 0;
+        line[i] = idx ? (uint16_t)(pal[idx] | PPU_OPAQUE) : 0;
+    }
+}
+
+/* Bitmap BG2 line for modes 3 to 5, through the affine transform like
+ * the rotation backgrounds. Bitmaps do not wrap, and mode 3 has no
+ * transparent color. */
+void ppu_bg_bitmap(uint16_t dispcnt, uint16_t *line)
+{
+    int32_t pa = (int16_t)PPU_REG(IO_BG2PA);
+    int32_t pc = (int16_t)PPU_REG(IO_BG2PC);
+    int32_t x = ppu.affine[0].x, y = ppu.affine[0].y;
+    uint32_t mode = PPU_DISPCNT_MODE(dispcnt);
+    uint32_t width = mode == 5 ? 160 : PPU_WIDTH;
+    uint32_t height = mode == 5 ? 128 : PPU_HEIGHT;
+    const uint8_t *vram = ppu.mem.vram;
+    const uint16_t *pal = (const uint16_t *)ppu.mem.pal;
+
+    if (mode != 3 && (dispcnt & PPU_DISPCNT_PAGE))
+        vram += 0xa000;
+    for (uint32_t i = 0; i < PPU_WIDTH; ++i, x += pa, y += pc) {
+        uint32_t px = (uint32_t)(x >> 8), py = (uint32_t)(y >> 8);
+        if (px >= width || py >= height || mode > 5) {
+            line[i] = 0;
+        } else if (mode == 4) {
+            uint8_t idx = vram[py * width + px];
+            line[i] = idx ? (uint16_t)(pal[idx] | PPU_OPAQUE) : 0;
+        } else {
+            const uint16_t *src = (const uint16_t *)vram;
+            line[i] = src[py * width + px] | PPU_OPAQUE;
+        }
+    }
+}
@@ -0,0 +1,295 @@
+#include "ppu_blend.h"
+
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PPU_X86 1
+#endif
+
+ppu_stack_fn ppu_blend_stack = ppu_blend_stack_scalar;
+ppu_effects_fn ppu_blend_effects = ppu_blend_effects_scalar;
+
+/* Keep the two frontmost pixels of each column. */
+void ppu_blend_stack_scalar(uint32_t *top, uint32_t *below,
+                            const uint32_t *layer, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t v = layer[i];
+        if (v < top[i]) {
+            below[i] = top[i];
+            top[i] = v;
+        } else if (v < below[i]) {
+            below[i] = v;
+        }
+    }
+}
+
+static uint32_t ppu_channel_min(uint32_t v)
+{
+    return v > 31 ? 31 : v;
+}
+
+void ppu_blend_effects_scalar(uint16_t *dst, const uint32_t *top,
+                              const uint32_t *below, const uint8_t *win,
+                              const ppu_blend_t *b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t a = top[i] & 0x7fff, c = below[i] & 0x7fff;
+        bool fx = win[i] & PPU_WIN_EFFECTS;
+        bool first = (top[i] >> 16) & b->first;
+        bool second = (below[i] >> 16) & b->second;
+        uint32_t out = a;
+
+        if (!fx) {
+            dst[i] = (uint16_t)out;
+            continue;
+        }
+        if (second && ((top[i] & PPU_LAYER_SEMI) || (b->mode == 1 && first))) {
+            out = 0;
+            for (uint32_t s = 0; s < 15; s += 5) {
+                uint32_t v = (((a >> s) & 0x1f) * b->eva +
+                              ((c >> s) & 0x1f) * b->evb) >> 4;
+                out |= ppu_channel_min(v) << s;
+            }
+        } else if (first && b->mode == 2) {
+            out = 0;
+            for (uint32_t s = 0; s < 15; s += 5) {
+                uint32_t v = (a >> s) & 0x1f;
+                out |= (v + (((31 - v) * b->evy) >> 4)) << s;
+            }
+        } else if (first && b->mode == 3) {
+            out = 0;
+            for (uint32_t s = 0; s < 15; s += 5) {
+                uint32_t v = (a >> s) & 0x1f;
+                out |= (v - ((v * b->evy) >> 4)) << s;
+            }
+        }
+        dst[i] = (uint16_t)out;
+    }
+}
+
+#if defined(PPU_X86) && defined(__SSE2__)
+/* Packed pixels are below 0x80000000, so signed compares order them. */
+static inline __m128i ppu_select_sse2(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void ppu_blend_stack_sse2(uint32_t *top, uint32_t *below,
+                                 const uint32_t *layer, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&layer[i]);
+        __m128i t = _mm_loadu_si128((const __m128i *)&top[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&below[i]);
+        __m128i lt_top = _mm_cmpgt_epi32(t, v);
+        __m128i lt_below = _mm_cmpgt_epi32(b, v);
+        b = ppu_select_sse2(lt_top, t, ppu_select_sse2(lt_below, v, b));
+        t = ppu_select_sse2(lt_top, v, t);
+        _mm_storeu_si128((__m128i *)&top[i], t);
+        _mm_storeu_si128((__m128i *)&below[i], b);
+    }
+    ppu_blend_stack_scalar(&top[i], &below[i], &layer[i], n - i);
+}
+
+/* Channels sit in the low halfword of each 32-bit lane, so the 16-bit
+ * multiplies and minimums leave the high halfwords at zero. */
+static inline __m128i ppu_channel_sse2(__m128i c, int shift)
+{
+    return _mm_and_si128(_mm_srli_epi32(c, shift), _mm_set1_epi32(0x1f));
+}
+
+static inline __m128i ppu_effects4_sse2(__m128i t, __m128i b, __m128i w,
+                                        const ppu_blend_t *p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi32(31);
+    __m128i eva = _mm_set1_epi32((int)p->eva), evb = _mm_set1_epi32((int)p->evb);
+    __m128i evy = _mm_set1_epi32((int)p->evy);
+    __m128i alpha = zero, bright = zero, dark = zero;
+
+    for (int s = 0; s < 15; s += 5) {
+        __m128i x = ppu_channel_sse2(t, s), y = ppu_channel_sse2(b, s);
+        __m128i v = _mm_add_epi16(_mm_mullo_epi16(x, eva),
+                                  _mm_mullo_epi16(y, evb));
+        v = _mm_min_epi16(_mm_srli_epi32(v, 4), max);
+        alpha = _mm_or_si128(alpha, _mm_slli_epi32(v, s));
+        v = _mm_srli_epi32(_mm_mullo_epi16(_mm_sub_epi32(max, x), evy), 4);
+        bright = _mm_or_si128(bright, _mm_slli_epi32(_mm_add_epi32(x, v), s));
+        v = _mm_srli_epi32(_mm_mullo_epi16(x, evy), 4);
+        dark = _mm_or_si128(dark, _mm_slli_epi32(_mm_sub_epi32(x, v), s));
+    }
+
+    __m128i fx = _mm_cmpeq_epi32(
+        _mm_and_si128(w, _mm_set1_epi32(PPU_WIN_EFFECTS)), zero);
+    __m128i first = _mm_cmpeq_epi32(
+        _mm_and_si128(_mm_srli_epi32(t, 16), _mm_set1_epi32((int)p->first)),
+        zero);
+    __m128i second = _mm_cmpeq_epi32(
+        _mm_and_si128(_mm_srli_epi32(b, 16), _mm_set1_epi32((int)p->second)),
+        zero);
+    __m128i semi = _mm_cmpeq_epi32(
+        _mm_and_si128(t, _mm_set1_epi32(PPU_LAYER_SEMI)), zero);
+    /* The compares above are all ones where the condition is false. */
+    fx = _mm_andnot_si128(fx, _mm_set1_epi32(-1));
+    first = _mm_andnot_si128(first, fx);
+    second = _mm_andnot_si128(second, fx);
+    semi = _mm_andnot_si128(semi, _mm_set1_epi32(-1));
+
+    __m128i use_alpha = p->mode == 1 ? _mm_or_si128(semi, first) : semi;
+    use_alpha = _mm_and_si128(use_alpha, second);
+    __m128i out = _mm_and_si128(t, _mm_set1_epi32(0x7fff));
+    if (p->mode == 2)
+        out = ppu_select_sse2(first, bright, out);
+    else if (p->mode == 3)
+        out = ppu_select_sse2(first, dark, out);
+    return ppu_select_sse2(use_alpha, alpha, out);
+}
+
+static void ppu_blend_effects_sse2(uint16_t *dst, const uint32_t *top,
+                                   const uint32_t *below, const uint8_t *win,
+                                   const ppu_blend_t *b, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i w = _mm_loadl_epi64((const __m128i *)&win[i]);
+        w = _mm_unpacklo_epi8(w, zero);
+        __m128i lo = ppu_effects4_sse2(
+            _mm_loadu_si128((const __m128i *)&top[i]),
+            _mm_loadu_si128((const __m128i *)&below[i]),
+            _mm_unpacklo_epi16(w, zero), b);
+        __m128i hi = ppu_effects4_sse2(
+            _mm_loadu_si128((const __m128i *)&top[i + 4]),
+            _mm_loadu_si128((const __m128i *)&below[i + 4]),
+            _mm_unpackhi_epi16(w, zero), b);
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_packs_epi32(lo, hi));
+    }
+    ppu_blend_effects_scalar(&dst[i], &top[i], &below[i], &win[i], b, n - i);
+}
+#endif
+
+#if defined(PPU_X86) && defined(__GNUC__)
+#define PPU_AVX2 __attribute__((target("avx2")))
+
+PPU_AVX2 static inline __m256i ppu_select_avx2(__m256i mask, __m256i a,
+                                               __m256i b)
+{
+    return _mm256_blendv_epi8(b, a, mask);
+}
+
+PPU_AVX2 static void ppu_blend_stack_avx2(uint32_t *top, uint32_t *below,
+                                          const uint32_t *layer, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&layer[i]);
+        __m256i t = _mm256_loadu_si256((const __m256i *)&top[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i *)&below[i]);
+        __m256i lt_top = _mm256_cmpgt_epi32(t, v);
+        b = ppu_select_avx2(lt_top, t, _mm256_min_epu32(b, v));
+        t = _mm256_min_epu32(t, v);
+        _mm256_storeu_si256((__m256i *)&top[i], t);
+        _mm256_storeu_si256((__m256i *)&below[i], b);
+    }
+    ppu_blend_stack_scalar(&top[i], &below[i], &layer[i], n - i);
+}
+
+PPU_AVX2 static inline __m256i ppu_channel_avx2(__m256i c, int shift)
+{
+    return _mm256_and_si256(_mm256_srli_epi32(c, shift),
+                            _mm256_set1_epi32(0x1f));
+}
+
+PPU_AVX2 static inline __m256i ppu_test_avx2(__m256i v, uint32_t bits)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i clear =
+        _mm256_cmpeq_epi32(_mm256_and_si256(v, _mm256_set1_epi32((int)bits)),
+                           zero);
+    return _mm256_xor_si256(clear, _mm256_set1_epi32(-1));
+}
+
+PPU_AVX2 static inline __m256i ppu_effects8_avx2(__m256i t, __m256i b,
+                                                 __m256i w,
+                                                 const ppu_blend_t *p)
+{
+    const __m256i max = _mm256_set1_epi32(31);
+    __m256i eva = _mm256_set1_epi32((int)p->eva);
+    __m256i evb = _mm256_set1_epi32((int)p->evb);
+    __m256i evy = _mm256_set1_epi32((int)p->evy);
+    __m256i alpha = _mm256_setzero_si256(), bright = alpha, dark = alpha;
+
+    for (int s = 0; s < 15; s += 5) {
+        __m256i x = ppu_channel_avx2(t, s), y = ppu_channel_avx2(b, s);
+        __m256i v = _mm256_add_epi16(_mm256_mullo_epi16(x, eva),
+                                     _mm256_mullo_epi16(y, evb));
+        v = _mm256_min_epi16(_mm256_srli_epi32(v, 4), max);
+        alpha = _mm256_or_si256(alpha, _mm256_slli_epi32(v, s));
+        v = _mm256_srli_epi32(
+            _mm256_mullo_epi16(_mm256_sub_epi32(max, x), evy), 4);
+        bright = _mm256_or_si256(bright,
+                                 _mm256_slli_epi32(_mm256_add_epi32(x, v), s));
+        v = _mm256_srli_epi32(_mm256_mullo_epi16(x, evy), 4);
+        dark = _mm256_or_si256(dark,
+                               _mm256_slli_epi32(_mm256_sub_epi32(x, v), s));
+    }
+
+    __m256i fx = ppu_test_avx2(w, PPU_WIN_EFFECTS);
+    __m256i first = _mm256_and_si256(
+        fx, ppu_test_avx2(_mm256_srli_epi32(t, 16), p->first));
+    __m256i second = _mm256_and_si256(
+        fx, ppu_test_avx2(_mm256_srli_epi32(b, 16), p->second));
+    __m256i semi = ppu_test_avx2(t, PPU_LAYER_SEMI);
+    __m256i use_alpha = p->mode == 1 ? _mm256_or_si256(semi, first) : semi;
+    use_alpha = _mm256_and_si256(use_alpha, second);
+    __m256i out = _mm256_and_si256(t, _mm256_set1_epi32(0x7fff));
+    if (p->mode == 2)
+        out = ppu_select_avx2(first, bright, out);
+    else if (p->mode == 3)
+        out = ppu_select_avx2(first, dark, out);
+    return ppu_select_avx2(use_alpha, alpha, out);
+}
+
+PPU_AVX2 static void ppu_blend_effects_avx2(uint16_t *dst,
+                                            const uint32_t *top,
+                                            const uint32_t *below,
+                                            const uint8_t *win,
+                                            const ppu_blend_t *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i w = _mm_loadu_si128((const __m128i *)&win[i]);
+        __m256i lo = ppu_effects8_avx2(
+            _mm256_loadu_si256((const __m256i *)&top[i]),
+            _mm256_loadu_si256((const __m256i *)&below[i]),
+            _mm256_cvtepu8_epi32(w), b);
+        __m256i hi = ppu_effects8_avx2(
+            _mm256_loadu_si256((const __m256i *)&top[i + 8]),
+            _mm256_loadu_si256((const __m256i *)&below[i + 8]),
+            _mm256_cvtepu8_epi32(_mm_srli_si128(w, 8)), b);
+        /* packs works per 128-bit half, put the quarters back in order. */
+        __m256i out = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi),
+                                               0xd8);
+        _mm256_storeu_si256((__m256i *)&dst[i], out);
+    }
+    ppu_blend_effects_scalar(&dst[i], &top[i], &below[i], &win[i], b, n - i);
+}
+#endif
+
+void ppu_blend_init(void)
+{
+#if defined(PPU_X86) && defined(__SSE2__)
+    ppu_blend_stack = ppu_blend_stack_sse2;
+    ppu_blend_effects = ppu_blend_effects_sse2;
+#endif
+#if defined(PPU_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        ppu_blend_stack = ppu_blend_stack_avx2;
+        ppu_blend_effects = ppu_blend_effects_avx2;
+    }
+#endif
+}
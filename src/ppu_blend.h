@@ -0,0 +1,47 @@
+#ifndef PPU_BLEND_H
+#define PPU_BLEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Composition works on layer lines of packed pixels: priority, order
+ * within the priority, one bit for the layer as in BLDCNT, then the
+ * BGR555 color. Smaller values are in front, so the visible pixel and the
+ * one below it are the two smallest values over all layers. */
+#define PPU_LAYER(prio, order, id) \
+    ((uint32_t)(prio) << 28 | (uint32_t)(order) << 24 | 1u << (16 + (id)))
+#define PPU_LAYER_SEMI (1u << 22) /* semi-transparent OBJ */
+#define PPU_LAYER_NONE 0x7f000000u
+
+/* Layer ids, matching the BLDCNT and window enable bits. */
+#define PPU_LAYER_OBJ 4
+#define PPU_LAYER_BD 5
+
+/* Window enable bit of color special effects. */
+#define PPU_WIN_EFFECTS (1u << 5)
+
+/* BLDCNT, BLDALPHA and BLDY, coefficients clamped to 16. */
+typedef struct {
+    uint32_t first;  /* first target layer bits */
+    uint32_t second; /* second target layer bits */
+    uint32_t mode;   /* 0 none, 1 alpha, 2 brighten, 3 darken */
+    uint32_t eva, evb, evy;
+} ppu_blend_t;
+
+typedef void (*ppu_stack_fn)(uint32_t *top, uint32_t *below,
+                             const uint32_t *layer, size_t n);
+typedef void (*ppu_effects_fn)(uint16_t *dst, const uint32_t *top,
+                               const uint32_t *below, const uint8_t *win,
+                               const ppu_blend_t *b, size_t n);
+
+extern ppu_stack_fn ppu_blend_stack;
+extern ppu_effects_fn ppu_blend_effects;
+
+void ppu_blend_init(void);
+void ppu_blend_stack_scalar(uint32_t *top, uint32_t *below,
+                            const uint32_t *layer, size_t n);
+void ppu_blend_effects_scalar(uint16_t *dst, const uint32_t *top,
+                              const uint32_t *below, const uint8_t *win,
+                              const ppu_blend_t *b, size_t n);
+
+#endif /* !PPU_BLEND_H */
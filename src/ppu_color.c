@@ -0,0 +1,161 @@
+#include "ppu_color.h"
+
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PPU_X86 1
+#endif
+
+ppu_convert_fn ppu_color_convert = ppu_color_convert_scalar;
+ppu_lookup_fn ppu_color_lookup = ppu_color_lookup_scalar;
+static const char *ppu_isa = "scalar";
+
+/* With color correction every BGR555 value is looked up in a table, the
+ * channels go through the LUT instead of the plain bit expansion. */
+static bool ppu_corrected;
+static uint32_t ppu_color_table[0x8000];
+
+void ppu_color_convert_scalar(uint32_t *dst, const uint16_t *src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = ppu_color(src[i]);
+}
+
+void ppu_color_lookup_scalar(uint32_t *dst, const uint8_t *idx,
+                             const uint32_t *pal, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = pal[idx[i]];
+}
+
+static void ppu_color_convert_table(uint32_t *dst, const uint16_t *src,
+                                    size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = ppu_color_table[src[i] & 0x7fff];
+}
+
+#if defined(PPU_X86) && defined(__SSE2__)
+/* 4 BGR555 values in 32-bit lanes to RGBA8888. */
+static inline __m128i ppu_convert4_sse2(__m128i c)
+{
+    const __m128i mask = _mm_set1_epi32(0x1f);
+    __m128i r = _mm_and_si128(c, mask);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(c, 5), mask);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(c, 10), mask);
+    r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+    g = _mm_or_si128(_mm_slli_epi32(g, 3), _mm_srli_epi32(g, 2));
+    b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+    __m128i out = _mm_or_si128(r, _mm_slli_epi32(g, 8));
+    out = _mm_or_si128(out, _mm_slli_epi32(b, 16));
+    return _mm_or_si128(out, _mm_set1_epi32((int)0xff000000u));
+}
+
+static void ppu_color_convert_sse2(uint32_t *dst, const uint16_t *src,
+                                   size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i c = _mm_loadu_si128((const __m128i *)&src[i]);
+        _mm_storeu_si128((__m128i *)&dst[i],
+                         ppu_convert4_sse2(_mm_unpacklo_epi16(c, zero)));
+        _mm_storeu_si128((__m128i *)&dst[i + 4],
+                         ppu_convert4_sse2(_mm_unpackhi_epi16(c, zero)));
+    }
+    ppu_color_convert_scalar(&dst[i], &src[i], n - i);
+}
+
+#endif
+
+#if defined(PPU_X86) && defined(__GNUC__)
+#define PPU_AVX2 __attribute__((target("avx2")))
+
+PPU_AVX2 static inline __m256i ppu_convert8_avx2(__m256i c)
+{
+    const __m256i mask = _mm256_set1_epi32(0x1f);
+    __m256i r = _mm256_and_si256(c, mask);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(c, 5), mask);
+    __m256i b = _mm256_and_si256(_mm256_srli_epi32(c, 10), mask);
+    r = _mm256_or_si256(_mm256_slli_epi32(r, 3), _mm256_srli_epi32(r, 2));
+    g = _mm256_or_si256(_mm256_slli_epi32(g, 3), _mm256_srli_epi32(g, 2));
+    b = _mm256_or_si256(_mm256_slli_epi32(b, 3), _mm256_srli_epi32(b, 2));
+    __m256i out = _mm256_or_si256(r, _mm256_slli_epi32(g, 8));
+    out = _mm256_or_si256(out, _mm256_slli_epi32(b, 16));
+    return _mm256_or_si256(out, _mm256_set1_epi32((int)0xff000000u));
+}
+
+PPU_AVX2 static void ppu_color_convert_avx2(uint32_t *dst,
+                                            const uint16_t *src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)&src[i]);
+        __m128i hi = _mm_loadu_si128((const __m128i *)&src[i + 8]);
+        _mm256_storeu_si256((__m256i *)&dst[i],
+                            ppu_convert8_avx2(_mm256_cvtepu16_epi32(lo)));
+        _mm256_storeu_si256((__m256i *)&dst[i + 8],
+                            ppu_convert8_avx2(_mm256_cvtepu16_epi32(hi)));
+    }
+    ppu_color_convert_scalar(&dst[i], &src[i], n - i);
+}
+
+PPU_AVX2 static void ppu_color_lookup_avx2(uint32_t *dst, const uint8_t *idx,
+                                           const uint32_t *pal, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i bytes = _mm_loadl_epi64((const __m128i *)&idx[i]);
+        __m256i c = _mm256_i32gather_epi32((const int *)pal,
+                                           _mm256_cvtepu8_epi32(bytes), 4);
+        _mm256_storeu_si256((__m256i *)&dst[i], c);
+    }
+    ppu_color_lookup_scalar(&dst[i], &idx[i], pal, n - i);
+}
+#endif
+
+void ppu_color_init(void)
+{
+    ppu_color_convert = ppu_color_convert_scalar;
+    ppu_color_lookup = ppu_color_lookup_scalar;
+    ppu_isa = "scalar";
+#if defined(PPU_X86) && defined(__SSE2__)
+    ppu_color_convert = ppu_color_convert_sse2;
+    ppu_isa = "sse2";
+#endif
+#if defined(PPU_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        ppu_color_convert = ppu_color_convert_avx2;
+        ppu_color_lookup = ppu_color_lookup_avx2;
+        ppu_isa = "avx2";
+    }
+#endif
+    if (ppu_corrected)
+        ppu_color_convert = ppu_color_convert_table;
+}
+
+/* Map each 5-bit channel through lut[32] to 8 bits, NULL for the plain
+ * expansion. */
+void ppu_color_correct(const uint8_t *lut)
+{
+    ppu_corrected = lut != NULL;
+    for (uint32_t c = 0; lut && c < 0x8000; ++c) {
+        ppu_color_table[c] = lut[c & 0x1f] | (uint32_t)lut[(c >> 5) & 0x1f]
+                                                 << 8 |
+                             (uint32_t)lut[c >> 10] << 16 | 0xff000000u;
+    }
+    ppu_color_init();
+}
+
+/* A BGR555 color in host format. */
+uint32_t ppu_color_host(uint16_t c)
+{
+    return ppu_corrected ? ppu_color_table[c & 0x7fff] : ppu_color(c);
+}
+
+const char *ppu_color_isa(void)
+{
+    return ppu_isa;
+}
@@ -0,0 +1,35 @@
+#ifndef PPU_COLOR_H
+#define PPU_COLOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* BGR555 to RGBA8888, stored as R in the lowest byte. The low bits of
+ * each channel repeat the high ones so that 31 maps to 255. */
+static inline uint32_t ppu_color(uint16_t c)
+{
+    uint32_t r = c & 0x1f, g = (c >> 5) & 0x1f, b = (c >> 10) & 0x1f;
+    r = r << 3 | r >> 2;
+    g = g << 3 | g >> 2;
+    b = b << 3 | b >> 2;
+    return r | g << 8 | b << 16 | 0xff000000u;
+}
+
+/* Kernels picked by ppu_color_init for the host CPU. The lookup reads
+ * colors already in host format. */
+typedef void (*ppu_convert_fn)(uint32_t *dst, const uint16_t *src, size_t n);
+typedef void (*ppu_lookup_fn)(uint32_t *dst, const uint8_t *idx,
+                              const uint32_t *pal, size_t n);
+
+extern ppu_convert_fn ppu_color_convert;
+extern ppu_lookup_fn ppu_color_lookup;
+
+void ppu_color_init(void);
+void ppu_color_correct(const uint8_t *lut);
+uint32_t ppu_color_host(uint16_t c);
+const char *ppu_color_isa(void);
+void ppu_color_convert_scalar(uint32_t *dst, const uint16_t *src, size_t n);
+void ppu_color_lookup_scalar(uint32_t *dst, const uint8_t *idx,
+                             const uint32_t *pal, size_t n);
+
+#endif /* !PPU_COLOR_H */
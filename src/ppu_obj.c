@@ -0,0 +1,197 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "io.h"
+#include "ppu.h"
+
+#define PPU_OBJS 128
+#define PPU_OBJ_VRAM 0x10000
+
+/* Sprite sizes in pixels, [shape][size][width, height]. */
+static const uint8_t ppu_obj_size[4][4][2] = {
+    {{8, 8}, {16, 16}, {32, 32}, {64, 64}},
+    {{16, 8}, {32, 8}, {32, 16}, {64, 32}},
+    {{8, 16}, {8, 32}, {16, 32}, {32, 64}},
+    {{0, 0}, {0, 0}, {0, 0}, {0, 0}},
+};
+
+/* Sprites on each visible line as a bitset in OAM order, so that drawing
+ * a line does not scan all of OAM. A sprite is moved between lines when
+ * its first two attributes were written, the ones that decide where it
+ * is. top and height remember the lines it is currently listed on. */
+static struct {
+    uint64_t lines[PPU_HEIGHT][2];
+    uint8_t top[PPU_OBJS];
+    uint8_t height[PPU_OBJS];
+    uint64_t dirty[2];
+} objs;
+
+void ppu_obj_init(void)
+{
+    memset(&objs, 0, sizeof(objs));
+    memset(objs.dirty, 0xff, sizeof(objs.dirty));
+}
+
+void ppu_oam_write(uint32_t offset, uint32_t len)
+{
+    /* Attribute 2 and the affine parameters do not move sprites. */
+    if (len <= 4 && (offset & 7) >= 4)
+        return;
+    for (uint32_t i = offset / 8; i <= (offset + len - 1) / 8 && i < PPU_OBJS;
+         ++i)
+        objs.dirty[i / 64] |= 1ull << (i % 64);
+}
+
+/* Height of the area a sprite covers, 0 if it is not displayed. */
+static uint32_t ppu_obj_height(const uint16_t *attr)
+{
+    bool affine = attr[0] & 0x100;
+    if (!affine && (attr[0] & 0x200))
+        return 0;
+    uint32_t h = ppu_obj_size[attr[0] >> 14][attr[1] >> 14][1];
+    return affine && (attr[0] & 0x200) ? h * 2 : h;
+}
+
+static void ppu_obj_relist(uint32_t i)
+{
+    const uint16_t *attr = (const uint16_t *)&ppu.mem.oam[i * 8];
+    uint64_t bit = 1ull << (i % 64);
+
+    for (uint32_t k = 0; k < objs.height[i]; ++k) {
+        uint32_t y = (objs.top[i] + k) & 0xff;
+        if (y < PPU_HEIGHT)
+            objs.lines[y][i / 64] &= ~bit;
+    }
+    objs.top[i] = (uint8_t)attr[0];
+    objs.height[i] = (uint8_t)ppu_obj_height(attr);
+    for (uint32_t k = 0; k < objs.height[i]; ++k) {
+        uint32_t y = (objs.top[i] + k) & 0xff;
+        if (y < PPU_HEIGHT)
+            objs.lines[y][i / 64] |= bit;
+    }
+}
+
+/* Bring the lists up to date with OAM writes since the last call. */
+void ppu_obj_update(void)
+{
+    for (uint32_t w = 0; w < 2; ++w) {
+        while (objs.dirty[w]) {
+            uint32_t i = (uint32_t)__builtin_ctzll(objs.dirty[w]);
+            objs.dirty[w] &= objs.dirty[w] - 1;
+            ppu_obj_relist(w * 64 + i);
+        }
+    }
+}
+
+/* Palette index of texel (tx, ty) of a sprite, 0 if transparent. In 2D
+ * mapping the tiles are laid out in rows of 32 tiles. */
+static uint32_t ppu_obj_texel(uint32_t tile, uint32_t tx, uint32_t ty,
+                              uint32_t width, bool bpp8, uint16_t dispcnt)
+{
+    uint32_t units = bpp8 ? 2 : 1;
+    uint32_t stride = dispcnt & PPU_DISPCNT_OBJ_1D ? width / 8 * units : 32;
+    uint32_t t = (tile + (ty / 8) * stride + (tx / 8) * units) & 0x3ff;
+    uint32_t texel = (ty & 7) * 8 + (tx & 7);
+
+    /* The lower half of OBJ tiles holds the bitmap in modes 3 to 5. */
+    if (PPU_DISPCNT_MODE(dispcnt) >= 3 && t < 512)
+        return 0;
+    if (bpp8)
+        return ppu.mem.vram[PPU_OBJ_VRAM + ((t * 32 + texel) & 0x7fff)];
+    return ppu_tile_4bpp((PPU_OBJ_VRAM >> 5) + t)[texel];
+}
+
+static void ppu_obj_put(ppu_obj_line_t *out, uint32_t x, uint32_t idx,
+                        const uint16_t *attr)
+{
+    const uint16_t *pal = (const uint16_t *)&ppu.mem.pal[0x200];
+    uint32_t prio = (attr[2] >> 10) & 3;
+    uint32_t mode = (attr[0] >> 10) & 3;
+
+    if (idx == 0)
+        return;
+    if (mode == 2) {
+        out->flags[x] |= PPU_OBJ_WINDOW;
+        return;
+    }
+    /* The lowest priority value wins, then the lowest OAM index. */
+    if ((out->color[x] & PPU_OPAQUE) && PPU_OBJ_PRIO(out->flags[x]) <= prio)
+        return;
+    if (!(attr[0] & 0x2000))
+        idx |= (uint32_t)(attr[2] >> 12) << 4;
+    out->color[x] = (uint16_t)(pal[idx] | PPU_OPAQUE);
+    out->flags[x] = (uint8_t)((out->flags[x] & PPU_OBJ_WINDOW) | prio |
+                              (mode == 1 ? PPU_OBJ_BLEND : 0));
+}
+
+/* Draw one sprite on line y. Affine sprites map each pixel back into the
+ * texture from the center of their area with the matrix in OAM. */
+static void ppu_obj_draw(uint32_t i, uint32_t y, uint16_t dispcnt,
+                         ppu_obj_line_t *out)
+{
+    const uint16_t *attr = (const uint16_t *)&ppu.mem.oam[i * 8];
+    uint32_t shape = attr[0] >> 14, size = attr[1] >> 14;
+    uint32_t w = ppu_obj_size[shape][size][0], h = ppu_obj_size[shape][size][1];
+    bool affine = attr[0] & 0x100;
+    bool bpp8 = attr[0] & 0x2000;
+    uint32_t tile = attr[2] & 0x3ff;
+    int32_t sx = attr[1] & 0x1ff;
+    uint32_t bw = w, bh = h;
+
+    if (w == 0 || ((attr[0] >> 10) & 3) == 3)
+        return;
+    if (sx >= PPU_WIDTH)
+        sx -= 512;
+    if (affine && (attr[0] & 0x200)) {
+        bw *= 2;
+        bh *= 2;
+    }
+    uint32_t row = (y - attr[0]) & 0xff;
+    int32_t x0 = sx < 0 ? 0 : sx;
+    int32_t x1 = sx + (int32_t)bw > PPU_WIDTH ? PPU_WIDTH : sx + (int32_t)bw;
+
+    if (!affine) {
+        uint32_t ty = attr[1] & 0x2000 ? h - 1 - row : row;
+        for (int32_t x = x0; x < x1; ++x) {
+            uint32_t tx = (uint32_t)(x - sx);
+            if (attr[1] & 0x1000)
+                tx = w - 1 - tx;
+            ppu_obj_put(out, (uint32_t)x,
+                        ppu_obj_texel(tile, tx, ty, w, bpp8, dispcnt), attr);
+        }
+        return;
+    }
+
+    const uint16_t *param =
+        (const uint16_t *)&ppu.mem.oam[((attr[1] >> 9) & 0x1f) * 32];
+    int32_t pa = (int16_t)param[3], pb = (int16_t)param[7];
+    int32_t pc = (int16_t)param[11], pd = (int16_t)param[15];
+    int32_t iy = (int32_t)row - (int32_t)bh / 2;
+    for (int32_t x = x0; x < x1; ++x) {
+        int32_t ix = x - sx - (int32_t)bw / 2;
+        int32_t tx = ((pa * ix + pb * iy) >> 8) + (int32_t)w / 2;
+        int32_t ty = ((pc * ix + pd * iy) >> 8) + (int32_t)h / 2;
+        if (tx < 0 || ty < 0 || tx >= (int32_t)w || ty >= (int32_t)h)
+            continue;
+        ppu_obj_put(out, (uint32_t)x,
+                    ppu_obj_texel(tile, (uint32_t)tx, (uint32_t)ty, w, bpp8,
+                                  dispcnt),
+                    attr);
+    }
+}
+
+/* OBJ layer of line y with the priority and mode of each pixel. Returns
+ * false if no sprite is on the line. */
+bool ppu_obj_line(uint32_t y, uint16_t dispcnt, ppu_obj_line_t *out)
+{
+    ppu_obj_update();
+    if (!(objs.lines[y][0] | objs.lines[y][1]))
+        return false;
+    memset(out, 0, sizeof(*out));
+    for (uint32_t w = 0; w < 2; ++w) {
+        for (uint64_t set = objs.lines[y][w]; set; set &= set - 1)
+            ppu_obj_draw(w * 64 + (uint32_t)__builtin_ctzll(set), y, dispcnt,
+                         out);
+    }
+    return true;
+}
@@ -0,0 +1,234 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "mmu.h"
+#include "ppu.h"
+
+/* Bytes in the write log, a power of two. The largest record is a DMA of
+ * 0x10000 words. */
+#define PPU_LOG_SIZE (1u << 20)
+#define PPU_LOG_MASK (PPU_LOG_SIZE - 1)
+
+enum {
+    PPU_LOG_WRITE,  /* len bytes of new contents follow */
+    PPU_LOG_LINE,   /* end of the visible part of line offset */
+    PPU_LOG_VBLANK,
+};
+
+typedef struct {
+    uint8_t kind;
+    uint8_t region;
+    uint16_t pad;
+    uint32_t offset;
+    uint32_t len;
+} ppu_log_t;
+
+/* The CPU thread appends records to the log as video memory and display
+ * registers are written, and the scanline markers that the renderer acts
+ * on. The render thread replays them in order on its own copy of video
+ * memory, so it draws every line from the same state the single-threaded
+ * PPU would. head is only written by the CPU thread and tail by the
+ * render thread. */
+static struct {
+    uint8_t log[PPU_LOG_SIZE];
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    atomic_bool sleeping;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;    /* the log is not empty, or stop */
+    pthread_cond_t drained; /* the log became empty */
+    pthread_t thread;
+    bool stop;
+
+    uint8_t io[sizeof(mmu.mem.io)];
+    uint8_t pal[sizeof(mmu.mem.pal)];
+    uint8_t vram[sizeof(mmu.mem.vram)];
+    uint8_t oam[sizeof(mmu.mem.oam)];
+} rt = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+};
+
+static void ppu_log_copy_in(size_t pos, const void *src, size_t len)
+{
+    size_t at = pos & PPU_LOG_MASK;
+    size_t first = len < PPU_LOG_SIZE - at ? len : PPU_LOG_SIZE - at;
+    memcpy(&rt.log[at], src, first);
+    memcpy(rt.log, (const uint8_t *)src + first, len - first);
+}
+
+static void ppu_log_copy_out(void *dst, size_t pos, size_t len)
+{
+    size_t at = pos & PPU_LOG_MASK;
+    size_t first = len < PPU_LOG_SIZE - at ? len : PPU_LOG_SIZE - at;
+    memcpy(dst, &rt.log[at], first);
+    memcpy((uint8_t *)dst + first, rt.log, len - first);
+}
+
+static void ppu_log_wake(void)
+{
+    pthread_mutex_lock(&rt.lock);
+    pthread_cond_signal(&rt.wake);
+    pthread_mutex_unlock(&rt.lock);
+}
+
+/* Append a record. If the log is full, wait for the render thread to
+ * catch up with it. */
+static void ppu_log_put(const ppu_log_t *rec, const void *data)
+{
+    size_t size = (sizeof(*rec) + rec->len + 7) & ~(size_t)7;
+    size_t head = atomic_load_explicit(&rt.head, memory_order_relaxed);
+
+    if (PPU_LOG_SIZE - (head - atomic_load(&rt.tail)) < size) {
+        pthread_mutex_lock(&rt.lock);
+        pthread_cond_signal(&rt.wake);
+        while (PPU_LOG_SIZE - (head - atomic_load(&rt.tail)) < size)
+            pthread_cond_wait(&rt.drained, &rt.lock);
+        pthread_mutex_unlock(&rt.lock);
+    }
+    ppu_log_copy_in(head, rec, sizeof(*rec));
+    ppu_log_copy_in(head + sizeof(*rec), data, rec->len);
+    atomic_store(&rt.head, head + size);
+    /* Writes can wait for the line that uses them. */
+    if (rec->kind != PPU_LOG_WRITE && atomic_load(&rt.sleeping))
+        ppu_log_wake();
+}
+
+/* A region of video memory, the MMU's or the render thread's copy. */
+static uint8_t *ppu_region(mmu_region_t region, bool copy)
+{
+    switch (region) {
+        case MMU_REGION_IO:
+            return copy ? rt.io : mmu.mem.io;
+        case MMU_REGION_PAL:
+            return copy ? rt.pal : mmu.mem.pal;
+        case MMU_REGION_VRAM:
+            return copy ? rt.vram : mmu.mem.vram;
+        case MMU_REGION_OAM:
+        default:
+            return copy ? rt.oam : mmu.mem.oam;
+    }
+}
+
+static void ppu_point_mem(bool copy)
+{
+    ppu.mem.io = ppu_region(MMU_REGION_IO, copy);
+    ppu.mem.pal = ppu_region(MMU_REGION_PAL, copy);
+    ppu.mem.vram = ppu_region(MMU_REGION_VRAM, copy);
+    ppu.mem.oam = ppu_region(MMU_REGION_OAM, copy);
+}
+
+/* Log the new contents of [offset, offset + len) of a region. */
+void ppu_log_write(mmu_region_t region, uint32_t offset, uint32_t len)
+{
+    ppu_log_t rec = {PPU_LOG_WRITE, (uint8_t)region, 0, offset, len};
+    ppu_log_put(&rec, &ppu_region(region, false)[offset]);
+}
+
+void ppu_log_line(uint32_t y)
+{
+    ppu_log_t rec = {PPU_LOG_LINE, 0, 0, y, 0};
+    ppu_log_put(&rec, NULL);
+}
+
+void ppu_log_vblank(void)
+{
+    ppu_log_t rec = {PPU_LOG_VBLANK, 0, 0, 0, 0};
+    ppu_log_put(&rec, NULL);
+}
+
+static void ppu_replay(size_t pos)
+{
+    ppu_log_t rec;
+    ppu_log_copy_out(&rec, pos, sizeof(rec));
+    switch (rec.kind) {
+        case PPU_LOG_WRITE: {
+            mmu_region_t region = (mmu_region_t)rec.region;
+            ppu_log_copy_out(&ppu_region(region, true)[rec.offset],
+                             pos + sizeof(rec), rec.len);
+            ppu_mem_changed(region, rec.offset, rec.len);
+            break;
+        }
+        case PPU_LOG_LINE:
+            ppu_scanline(rec.offset);
+            break;
+        case PPU_LOG_VBLANK:
+            ppu_vblank();
+            break;
+        default:
+            break;
+    }
+    atomic_store_explicit(&rt.tail,
+                          pos + ((sizeof(rec) + rec.len + 7) & ~(size_t)7),
+                          memory_order_release);
+}
+
+static void *ppu_thread(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        size_t tail = atomic_load_explicit(&rt.tail, memory_order_relaxed);
+        if (tail != atomic_load_explicit(&rt.head, memory_order_acquire)) {
+            ppu_replay(tail);
+            continue;
+        }
+        pthread_mutex_lock(&rt.lock);
+        pthread_cond_broadcast(&rt.drained);
+        atomic_store(&rt.sleeping, true);
+        while (tail == atomic_load(&rt.head) && !rt.stop)
+            pthread_cond_wait(&rt.wake, &rt.lock);
+        atomic_store(&rt.sleeping, false);
+        bool stop = rt.stop && tail == atomic_load(&rt.head);
+        pthread_mutex_unlock(&rt.lock);
+        if (stop)
+            return NULL;
+    }
+}
+
+/* Hand rendering to a thread of its own. The copy of video memory starts
+ * out equal to the MMU's, which the caches already describe. */
+void ppu_thread_start(void)
+{
+    if (ppu.threaded)
+        return;
+    memcpy(rt.io, mmu.mem.io, sizeof(rt.io));
+    memcpy(rt.pal, mmu.mem.pal, sizeof(rt.pal));
+    memcpy(rt.vram, mmu.mem.vram, sizeof(rt.vram));
+    memcpy(rt.oam, mmu.mem.oam, sizeof(rt.oam));
+    atomic_store(&rt.head, 0);
+    atomic_store(&rt.tail, 0);
+    rt.stop = false;
+    ppu_point_mem(true);
+    if (pthread_create(&rt.thread, NULL, ppu_thread, NULL) != 0) {
+        ppu_point_mem(false);
+        return;
+    }
+    ppu.threaded = true;
+}
+
+/* Wait until every logged line has been drawn. */
+void ppu_thread_sync(void)
+{
+    if (!ppu.threaded)
+        return;
+    pthread_mutex_lock(&rt.lock);
+    pthread_cond_signal(&rt.wake);
+    while (atomic_load(&rt.tail) != atomic_load(&rt.head))
+        pthread_cond_wait(&rt.drained, &rt.lock);
+    pthread_mutex_unlock(&rt.lock);
+}
+
+void ppu_thread_stop(void)
+{
+    if (!ppu.threaded)
+        return;
+    pthread_mutex_lock(&rt.lock);
+    rt.stop = true;
+    pthread_cond_signal(&rt.wake);
+    pthread_mutex_unlock(&rt.lock);
+    pthread_join(rt.thread, NULL);
+    ppu.threaded = false;
+    ppu_point_mem(false);
+}
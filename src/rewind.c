@@ -0,0 +1,204 @@
+#include "rewind.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "state.h"
+
+/* Only the newest capture is kept whole. Each one before it is kept as
+ * its XOR with the next, run length coded over 64-bit words: a run of
+ * unchanged words then a run of changed ones, as two 32-bit counts
+ * followed by the changed words. Going back loads the newest capture and
+ * XORs the newest delta into it. */
+typedef struct {
+    uint64_t pos; /* in the ring */
+    uint32_t len;
+} rewind_entry_t;
+
+static struct {
+    uint8_t *ring;
+    size_t ring_size;
+    uint64_t head; /* end of the newest delta */
+    rewind_entry_t *entry;
+    uint32_t first; /* oldest entry */
+    uint32_t count;
+    uint64_t *last; /* newest capture */
+    uint64_t *cur;
+    uint8_t *packed;
+    size_t words;
+    bool have_last;
+    uint32_t interval;
+    uint32_t frames; /* since the last capture */
+} rw;
+
+static size_t rewind_encode(uint8_t *out, const uint64_t *cur,
+                            const uint64_t *last, size_t n)
+{
+    uint8_t *p = out;
+    size_t i = 0;
+    while (i < n) {
+        size_t start = i;
+        while (i < n && cur[i] == last[i])
+            ++i;
+        if (i == n)
+            break;
+        uint32_t run[2] = {(uint32_t)(i - start), 0};
+        uint8_t *hdr = p;
+        p += sizeof(run);
+        for (; i < n && cur[i] != last[i]; ++i) {
+            uint64_t x = cur[i] ^ last[i];
+            memcpy(p, &x, sizeof(x));
+            p += sizeof(x);
+            run[1]++;
+        }
+        memcpy(hdr, run, sizeof(run));
+    }
+    return (size_t)(p - out);
+}
+
+static void rewind_decode(uint64_t *state, const uint8_t *in, size_t len)
+{
+    const uint8_t *end = in + len;
+    size_t i = 0;
+    while (in < end) {
+        uint32_t run[2];
+        memcpy(run, in, sizeof(run));
+        in += sizeof(run);
+        i += run[0];
+        for (uint32_t k = 0; k < run[1]; ++k) {
+            uint64_t x;
+            memcpy(&x, in, sizeof(x));
+            in += sizeof(x);
+            state[i++] ^= x;
+        }
+    }
+}
+
+static void rewind_copy_in(uint64_t pos, const uint8_t *src, size_t n)
+{
+    size_t at = (size_t)(pos % rw.ring_size);
+    size_t first = n < rw.ring_size - at ? n : rw.ring_size - at;
+    memcpy(&rw.ring[at], src, first);
+    memcpy(rw.ring, &src[first], n - first);
+}
+
+static void rewind_copy_out(uint8_t *dst, uint64_t pos, size_t n)
+{
+    size_t at = (size_t)(pos % rw.ring_size);
+    size_t first = n < rw.ring_size - at ? n : rw.ring_size - at;
+    memcpy(dst, &rw.ring[at], first);
+    memcpy(&dst[first], rw.ring, n - first);
+}
+
+static rewind_entry_t *rewind_entry(uint32_t n)
+{
+    return &rw.entry[(rw.first + n) % REWIND_MAX_ENTRIES];
+}
+
+/* Store the delta in packed, dropping the oldest ones to make room. */
+static void rewind_push(size_t len)
+{
+    if (len > rw.ring_size) {
+        /* The history before it cannot be reached any more. */
+        rw.count = 0;
+        return;
+    }
+    while (rw.count > 0 &&
+           (rw.count == REWIND_MAX_ENTRIES ||
+            rw.head + len - rewind_entry(0)->pos > rw.ring_size)) {
+        rw.first = (rw.first + 1) % REWIND_MAX_ENTRIES;
+        rw.count--;
+    }
+    rewind_copy_in(rw.head, rw.packed, len);
+    *rewind_entry(rw.count) = (rewind_entry_t){rw.head, (uint32_t)len};
+    rw.count++;
+    rw.head += len;
+}
+
+/* Keep bytes of deltas, captured every interval frames. */
+int rewind_init(size_t bytes, uint32_t interval)
+{
+    size_t size = state_size();
+    rewind_free();
+    rw.ring = malloc(bytes);
+    rw.entry = malloc(REWIND_MAX_ENTRIES * sizeof(rw.entry[0]));
+    rw.last = malloc(size);
+    rw.cur = malloc(size);
+    /* Runs of changed words are at least a word apart, so a delta is
+     * never more than a header larger than the state. */
+    rw.packed = malloc(size + 8);
+    if (bytes == 0 || rw.ring == NULL || rw.entry == NULL ||
+        rw.last == NULL || rw.cur == NULL || rw.packed == NULL) {
+        rewind_free();
+        return -1;
+    }
+    rw.ring_size = bytes;
+    rw.words = size / sizeof(uint64_t);
+    rw.interval = interval ? interval : 1;
+    return 0;
+}
+
+void rewind_free(void)
+{
+    free(rw.ring);
+    free(rw.entry);
+    free(rw.last);
+    free(rw.cur);
+    free(rw.packed);
+    memset(&rw, 0, sizeof(rw));
+}
+
+/* Called at the end of every frame. */
+void rewind_frame(void)
+{
+    if (rw.ring == NULL || ++rw.frames < rw.interval)
+        return;
+    rewind_capture();
+}
+
+void rewind_capture(void)
+{
+    if (rw.ring == NULL)
+        return;
+    rw.frames = 0;
+    state_save(rw.cur, rw.words * sizeof(uint64_t));
+    if (rw.have_last)
+        rewind_push(rewind_encode(rw.packed, rw.cur, rw.last, rw.words));
+    uint64_t *swap = rw.last;
+    rw.last = rw.cur;
+    rw.cur = swap;
+    rw.have_last = true;
+}
+
+/* Go back to the newest capture and forget it, so that the next step
+ * goes further back. Returns -1 when there is nothing left. */
+int rewind_step(void)
+{
+    if (!rw.have_last ||
+        state_load(rw.last, rw.words * sizeof(uint64_t)) != 0)
+        return -1;
+    rw.frames = 0;
+    if (rw.count == 0) {
+        rw.have_last = false;
+        return 0;
+    }
+    rewind_entry_t *e = rewind_entry(rw.count - 1);
+    rewind_copy_out(rw.packed, e->pos, e->len);
+    rewind_decode(rw.last, rw.packed, e->len);
+    rw.head = e->pos;
+    rw.count--;
+    return 0;
+}
+
+/* Steps that can be taken back. */
+uint32_t rewind_count(void)
+{
+    return rw.count + rw.have_last;
+}
+
+/* Bytes of deltas held. */
+size_t rewind_used(void)
+{
+    return rw.count ? (size_t)(rw.head - rewind_entry(0)->pos) : 0;
+}
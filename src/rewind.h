@@ -0,0 +1,18 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most deltas kept, whatever their size. */
+#define REWIND_MAX_ENTRIES 0x10000
+
+int rewind_init(size_t bytes, uint32_t interval);
+void rewind_free(void);
+void rewind_frame(void);
+void rewind_capture(void);
+int rewind_step(void);
+uint32_t rewind_count(void);
+size_t rewind_used(void);
+
+#endif /* !REWIND_H */
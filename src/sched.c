@@ -0,0 +1,63 @@
+#include "sched.h"
+
+#include <string.h>
+
+#include "arm.h"
+
+sched_t sched;
+
+void sched_init(void)
+{
+    memset(&sched, 0, sizeof(sched));
+    for (int ev = 0; ev < SCHED_NUM; ++ev)
+        sched.when[ev] = SCHED_IDLE;
+    sched.next = SCHED_IDLE;
+}
+
+void sched_set_handler(sched_event_t ev, sched_handler_t handler)
+{
+    sched.handler[ev] = handler;
+}
+
+static void sched_update(void)
+{
+    sched.next = SCHED_IDLE;
+    for (int ev = 0; ev < SCHED_NUM; ++ev) {
+        if (sched.when[ev] < sched.next)
+            sched.next = sched.when[ev];
+    }
+}
+
+void sched_schedule(sched_event_t ev, uint64_t when)
+{
+    uint64_t old = sched.when[ev];
+    sched.when[ev] = when;
+    if (when < sched.next)
+        sched.next = when;
+    else if (old == sched.next)
+        sched_update();
+}
+
+void sched_cancel(sched_event_t ev)
+{
+    uint64_t old = sched.when[ev];
+    sched.when[ev] = SCHED_IDLE;
+    if (old == sched.next)
+        sched_update();
+}
+
+/* Run the events that are due, earliest first. */
+void sched_dispatch(void)
+{
+    while (sched.next <= arm.cycles) {
+        int first = 0;
+        for (int ev = 1; ev < SCHED_NUM; ++ev) {
+            if (sched.when[ev] < sched.when[first])
+                first = ev;
+        }
+        uint64_t when = sched.when[first];
+        sched.when[first] = SCHED_IDLE;
+        sched_update();
+        sched.handler[first](when);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+#define SCHED_IDLE UINT64_MAX
+
+/* One slot per event source, each pending at most once. */
+typedef enum {
+    SCHED_PPU,
+    SCHED_IRQ,
+    SCHED_TIMER0,
+    SCHED_TIMER1,
+    SCHED_TIMER2,
+    SCHED_TIMER3,
+    SCHED_PSG,
+    SCHED_NUM,
+} sched_event_t;
+
+/* Called with the cycle the event was due, which may be in the past. */
+typedef void (*sched_handler_t)(uint64_t when);
+
+typedef struct {
+    uint64_t when[SCHED_NUM];
+    uint64_t next; /* earliest pending event */
+    sched_handler_t handler[SCHED_NUM]; /* set once, not saved */
+} sched_t;
+
+extern sched_t sched;
+
+void sched_init(void);
+void sched_set_handler(sched_event_t ev, sched_handler_t handler);
+void sched_schedule(sched_event_t ev, uint64_t when);
+void sched_cancel(sched_event_t ev);
+void sched_dispatch(void);
+
+#endif /* !SCHED_H */
@@ -0,0 +1,223 @@
+#include "state.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apu.h"
+#include "arm.h"
+#include "backup.h"
+#include "dma.h"
+#include "gba.h"
+#include "mmu.h"
+#include "ppu.h"
+#include "sched.h"
+#include "timer.h"
+
+/* Each module keeps what a state needs at one end of its struct, so the
+ * whole machine is a handful of copies. Derived and host side data is
+ * left out and rebuilt on load. */
+typedef struct {
+    void *data;
+    size_t size;
+    void (*restore)(const void *src); /* instead of a plain copy */
+    bool shared; /* kept by instances apart from the core */
+} state_block_t;
+
+/* Work RAM and VRAM have blocks of their own, instances share them in
+ * pages and the backup as a whole. */
+static const state_block_t state_blocks[] = {
+    {&gba, offsetof(gba_t, video), NULL, false},
+    {&arm, sizeof(arm_t), NULL, false},
+    {&sched, offsetof(sched_t, handler), NULL, false},
+    {mmu.mem.ewram, sizeof(mmu.mem.ewram) + sizeof(mmu.mem.iwram), NULL,
+     true},
+    {mmu.mem.io, sizeof(mmu.mem.io) + sizeof(mmu.mem.pal), NULL, false},
+    {mmu.mem.vram, sizeof(mmu.mem.vram), NULL, true},
+    {mmu.mem.oam, sizeof(mmu.mem.oam), NULL, false},
+    {mmu.wait, sizeof(mmu_t) - offsetof(mmu_t, wait), NULL, false},
+    {&dma, offsetof(dma_t, fast), NULL, false},
+    {&timers, sizeof(timers_t), NULL, false},
+    {&ppu, offsetof(ppu_t, mem), NULL, false},
+    {&apu, offsetof(apu_t, in), NULL, false},
+    {&backup, BACKUP_STATE_SIZE, backup_restore, true},
+};
+
+#define STATE_NUM_BLOCKS (sizeof(state_blocks) / sizeof(state_blocks[0]))
+
+/* Blocks start on 8 bytes in the buffer. */
+static size_t state_align(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+size_t state_size(void)
+{
+    size_t size = state_align(sizeof(state_header_t));
+    for (size_t i = 0; i < STATE_NUM_BLOCKS; ++i)
+        size += state_align(state_blocks[i].size);
+    return size;
+}
+
+static void state_header(state_header_t *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->magic = STATE_MAGIC;
+    h->version = STATE_VERSION;
+    h->size = (uint32_t)state_size();
+    h->rom_size = mmu.rom_size;
+    if (mmu.rom != NULL && mmu.rom_size >= 0xb0)
+        memcpy(h->rom_id, &mmu.rom[0xa0], sizeof(h->rom_id));
+}
+
+/* Copy out every block, or only the core ones. */
+static void state_copy_out(uint8_t *p, bool core)
+{
+    /* The render thread updates the affine reference points. */
+    ppu_thread_sync();
+    for (size_t i = 0; i < STATE_NUM_BLOCKS; ++i) {
+        size_t n = state_blocks[i].size;
+        if (core && state_blocks[i].shared)
+            continue;
+        memcpy(p, state_blocks[i].data, n);
+        memset(p + n, 0, state_align(n) - n);
+        p += state_align(n);
+    }
+}
+
+/* The other way, with the render thread stopped. */
+static void state_copy_in(const uint8_t *p, bool core)
+{
+    for (size_t i = 0; i < STATE_NUM_BLOCKS; ++i) {
+        if (core && state_blocks[i].shared)
+            continue;
+        if (state_blocks[i].restore)
+            state_blocks[i].restore(p);
+        else
+            memcpy(state_blocks[i].data, p, state_blocks[i].size);
+        p += state_align(state_blocks[i].size);
+    }
+    /* The display registers are left alone, relatching BGxX and BGxY
+     * would lose the reference points just loaded. */
+    ppu_mem_changed(MMU_REGION_PAL, 0, sizeof(mmu.mem.pal));
+    ppu_mem_changed(MMU_REGION_OAM, 0, sizeof(mmu.mem.oam));
+}
+
+/* Returns -1 if buf is smaller than state_size(). */
+int state_save(void *buf, size_t size)
+{
+    uint8_t *p = buf;
+    if (size < state_size())
+        return -1;
+    state_header((state_header_t *)buf);
+    state_copy_out(p + state_align(sizeof(state_header_t)), false);
+    return 0;
+}
+
+/* States are only taken back by the build and the ROM that saved them. */
+int state_load(const void *buf, size_t size)
+{
+    const uint8_t *p = buf;
+    state_header_t want, h;
+    if (size < sizeof(h))
+        return -1;
+    memcpy(&h, buf, sizeof(h));
+    state_header(&want);
+    if (size < state_size() || memcmp(&h, &want, sizeof(h)) != 0)
+        return -1;
+
+    bool threaded = ppu.threaded;
+    ppu_thread_stop();
+    state_copy_in(p + state_align(sizeof(state_header_t)), false);
+    ppu_mem_changed(MMU_REGION_VRAM, 0, sizeof(mmu.mem.vram));
+    /* Nothing is known about the memory any more. */
+    mmu_protect(0);
+    if (threaded)
+        ppu_thread_start();
+    return 0;
+}
+
+/* The blocks instances do not share, without a header. */
+size_t state_core_size(void)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < STATE_NUM_BLOCKS; ++i)
+        if (!state_blocks[i].shared)
+            size += state_align(state_blocks[i].size);
+    return size;
+}
+
+void state_core_save(void *buf)
+{
+    state_copy_out(buf, true);
+}
+
+/* With the render thread stopped, the caller brings the shared blocks in
+ * line. */
+void state_core_load(const void *buf)
+{
+    state_copy_in(buf, true);
+}
+
+static uint64_t state_mix(uint64_t h, uint64_t w)
+{
+    h = (h ^ w) * 0x9e3779b97f4a7c15u;
+    return h ^ h >> 32;
+}
+
+/* 64-bit hash of what a state would hold, read in place. It is not meant
+ * to resist anything, only to tell two runs apart. */
+uint64_t state_hash(void)
+{
+    uint64_t h = STATE_MAGIC | (uint64_t)STATE_VERSION << 32;
+    ppu_thread_sync();
+    for (size_t i = 0; i < STATE_NUM_BLOCKS; ++i) {
+        const uint8_t *p = state_blocks[i].data;
+        size_t n = state_blocks[i].size;
+        uint64_t w;
+        for (; n >= sizeof(w); n -= sizeof(w), p += sizeof(w)) {
+            memcpy(&w, p, sizeof(w));
+            h = state_mix(h, w);
+        }
+        w = 0;
+        memcpy(&w, p, n);
+        h = state_mix(h, w);
+    }
+    return h;
+}
+
+int state_save_file(const char *path)
+{
+    size_t size = state_size();
+    uint8_t *buf = malloc(size);
+    if (buf == NULL)
+        return -1;
+    state_save(buf, size);
+    int ret = -1;
+    FILE *f = fopen(path, "wb");
+    if (f != NULL) {
+        size_t n = fwrite(buf, 1, size, f);
+        if (fclose(f) == 0 && n == size)
+            ret = 0;
+    }
+    free(buf);
+    return ret;
+}
+
+int state_load_file(const char *path)
+{
+    size_t size = state_size();
+    uint8_t *buf = malloc(size);
+    if (buf == NULL)
+        return -1;
+    int ret = -1;
+    FILE *f = fopen(path, "rb");
+    if (f != NULL) {
+        if (fread(buf, 1, size, f) == size)
+            ret = state_load(buf, size);
+        fclose(f);
+    }
+    free(buf);
+    return ret;
+}
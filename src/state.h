@@ -0,0 +1,32 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATE_MAGIC 0x54534753u /* "GSST" */
+/* Bump whenever a saved struct changes layout, or the blocks hashed by
+ * state_hash() change. */
+#define STATE_VERSION 4
+
+/* A saved state is this header followed by the saved part of each
+ * module's state, copied as is in host byte order. */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;     /* header included */
+    uint32_t rom_size;
+    uint8_t rom_id[16]; /* title and game code from the cartridge header */
+} state_header_t;
+
+size_t state_size(void);
+int state_save(void *buf, size_t size);
+int state_load(const void *buf, size_t size);
+int state_save_file(const char *path);
+int state_load_file(const char *path);
+uint64_t state_hash(void);
+size_t state_core_size(void);
+void state_core_save(void *buf);
+void state_core_load(const void *buf);
+
+#endif /* !STATE_H */
@@ -0,0 +1,120 @@
+#include "stats.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define STATS_MAX_THREADS 16
+
+_Thread_local stats_acc_t *stats_acc;
+_Thread_local stats_scope_t *stats_current;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key; /* releases the slot on thread exit */
+static stats_acc_t stats_threads[STATS_MAX_THREADS];
+static stats_acc_t stats_shared = {.shared = true};
+/* Totals of the threads that have exited. */
+static uint64_t stats_exited_ticks[STATS_NUM];
+static uint64_t stats_exited_calls[STATS_NUM];
+/* Totals at the previous poll. */
+static uint64_t stats_last_ticks[STATS_NUM];
+static uint64_t stats_last_calls[STATS_NUM];
+static uint64_t stats_last_poll;
+static struct timespec stats_last_time;
+
+static void stats_release(void *arg)
+{
+    stats_acc_t *acc = arg;
+    pthread_mutex_lock(&stats_lock);
+    for (int id = 0; id < STATS_NUM; ++id) {
+        stats_exited_ticks[id] += atomic_load(&acc->ticks[id]);
+        stats_exited_calls[id] += atomic_load(&acc->calls[id]);
+        atomic_store(&acc->ticks[id], 0);
+        atomic_store(&acc->calls[id], 0);
+    }
+    acc->used = false;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void stats_key_create(void)
+{
+    pthread_key_create(&stats_key, stats_release);
+}
+
+/* Give the calling thread a free slot, which goes back when the thread
+ * exits. Threads beyond the limit share one slot with atomic adds. */
+stats_acc_t *stats_register(void)
+{
+    pthread_once(&stats_once, stats_key_create);
+    pthread_mutex_lock(&stats_lock);
+    stats_acc = &stats_shared;
+    for (int i = 0; i < STATS_MAX_THREADS; ++i) {
+        if (!stats_threads[i].used) {
+            stats_threads[i].used = true;
+            stats_acc = &stats_threads[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+    if (stats_acc != &stats_shared)
+        pthread_setspecific(stats_key, stats_acc);
+    return stats_acc;
+}
+
+static void stats_add(stats_t *out, stats_acc_t *acc)
+{
+    for (int id = 0; id < STATS_NUM; ++id) {
+        out->ticks[id] +=
+            atomic_load_explicit(&acc->ticks[id], memory_order_relaxed);
+        out->calls[id] +=
+            atomic_load_explicit(&acc->calls[id], memory_order_relaxed);
+    }
+}
+
+static double stats_diff_ns(struct timespec *a, struct timespec *b)
+{
+    return (double)(b->tv_sec - a->tv_sec) * 1e9 +
+           (double)(b->tv_nsec - a->tv_nsec);
+}
+
+void stats_poll(stats_t *out)
+{
+    uint64_t now = stats_ticks();
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&stats_lock);
+    for (int i = 0; i < STATS_MAX_THREADS; ++i)
+        if (stats_threads[i].used)
+            stats_add(out, &stats_threads[i]);
+    stats_add(out, &stats_shared);
+    for (int id = 0; id < STATS_NUM; ++id) {
+        out->ticks[id] += stats_exited_ticks[id];
+        out->calls[id] += stats_exited_calls[id];
+    }
+    for (int id = 0; id < STATS_NUM; ++id) {
+        uint64_t ticks = out->ticks[id], calls = out->calls[id];
+        out->ticks[id] -= stats_last_ticks[id];
+        out->calls[id] -= stats_last_calls[id];
+        stats_last_ticks[id] = ticks;
+        stats_last_calls[id] = calls;
+    }
+    if (stats_last_poll) {
+        out->elapsed = now - stats_last_poll;
+        out->ns_per_tick =
+            stats_diff_ns(&stats_last_time, &ts) / (double)out->elapsed;
+    }
+    stats_last_poll = now;
+    stats_last_time = ts;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+const char *stats_name(stats_id_t id)
+{
+    static const char *names[STATS_NUM] = {
+        [STATS_CPU] = "cpu", [STATS_MMU] = "mmu", [STATS_PPU] = "ppu",
+        [STATS_APU] = "apu", [STATS_DMA] = "dma",
+    };
+    return names[id];
+}
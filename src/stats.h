@@ -0,0 +1,114 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* Instrumented subsystems. */
+typedef enum {
+    STATS_CPU,
+    STATS_MMU, /* MMU slow path */
+    STATS_PPU,
+    STATS_APU,
+    STATS_DMA,
+    STATS_NUM,
+} stats_id_t;
+
+/* Totals since the previous poll, times are exclusive of nested scopes. */
+typedef struct {
+    uint64_t ticks[STATS_NUM];
+    uint64_t calls[STATS_NUM];
+    uint64_t elapsed; /* wall clock ticks */
+    double ns_per_tick;
+} stats_t;
+
+/* Per-thread accumulator, only written by its owner thread unless it is
+ * the one shared by the threads that found no free slot. */
+typedef struct {
+    _Atomic uint64_t ticks[STATS_NUM];
+    _Atomic uint64_t calls[STATS_NUM];
+    bool used;
+    bool shared;
+} stats_acc_t;
+
+typedef struct stats_scope {
+    stats_id_t id;
+    uint64_t start;
+    uint64_t nested;
+    struct stats_scope *parent;
+} stats_scope_t;
+
+extern _Thread_local stats_acc_t *stats_acc;
+extern _Thread_local stats_scope_t *stats_current;
+
+stats_acc_t *stats_register(void);
+void stats_poll(stats_t *out);
+const char *stats_name(stats_id_t id);
+
+/* Host clock ticks, TSC cycles where available. */
+static inline uint64_t stats_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static inline void stats_begin(stats_scope_t *s, stats_id_t id)
+{
+    s->id = id;
+    s->nested = 0;
+    s->parent = stats_current;
+    stats_current = s;
+    s->start = stats_ticks();
+}
+
+static inline void stats_end(stats_scope_t *s)
+{
+    uint64_t elapsed = stats_ticks() - s->start;
+    stats_acc_t *acc = stats_acc ? stats_acc : stats_register();
+    stats_current = s->parent;
+    if (s->parent)
+        s->parent->nested += elapsed;
+    if (acc->shared) {
+        atomic_fetch_add_explicit(&acc->ticks[s->id], elapsed - s->nested,
+                                  memory_order_relaxed);
+        atomic_fetch_add_explicit(&acc->calls[s->id], 1,
+                                  memory_order_relaxed);
+        return;
+    }
+    /* Single writer, no need for a locked read-modify-write. */
+    atomic_store_explicit(&acc->ticks[s->id],
+                          atomic_load_explicit(&acc->ticks[s->id],
+                                               memory_order_relaxed) +
+                              elapsed - s->nested,
+                          memory_order_relaxed);
+    atomic_store_explicit(
+        &acc->calls[s->id],
+        atomic_load_explicit(&acc->calls[s->id], memory_order_relaxed) + 1,
+        memory_order_relaxed);
+}
+
+/* Time the rest of the enclosing block, in TIMING_STATS builds. */
+#ifdef TIMING_STATS
+#define STATS_SCOPE_NAME2(line) stats_scope_##line
+#define STATS_SCOPE_NAME(line) STATS_SCOPE_NAME2(line)
+#define STATS_SCOPE(id)                                                     \
+    stats_scope_t STATS_SCOPE_NAME(__LINE__)                                \
+        __attribute__((cleanup(stats_end)));                                \
+    stats_begin(&STATS_SCOPE_NAME(__LINE__), (id))
+#else
+#define STATS_SCOPE(id) \
+    do {                \
+    } while (0)
+#endif
+
+#endif /* !STATS_H */
@@ -0,0 +1,146 @@
+#include "timer.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "apu.h"
+#include "arm.h"
+#include "io.h"
+#include "irq.h"
+#include "mmu.h"
+#include "sched.h"
+
+timers_t timers;
+
+static const uint32_t timer_shift[4] = {0, 6, 8, 10};
+
+static uint16_t timer_cnt(int n)
+{
+    return IO_REG(IO_TM0CNT_H + (uint32_t)n * IO_TM_STRIDE);
+}
+
+/* Counting on its own prescaler, as opposed to stopped or counting up. */
+static bool timer_running(int n)
+{
+    uint16_t cnt = timer_cnt(n);
+    return (cnt & TIMER_CNT_ENABLE) && (n == 0 || !(cnt & TIMER_CNT_CASCADE));
+}
+
+/* The counter at now. Events are dispatched between instructions, so a
+ * read can land a few cycles after an overflow that has not been handled
+ * yet and has to wrap on its own. */
+static uint16_t timer_counter(int n, uint64_t now)
+{
+    timer_channel_t *t = &timers.ch[n];
+    if (!timer_running(n) || now <= t->start)
+        return t->counter;
+    uint64_t ticks = (now - t->start) >> t->shift;
+    uint64_t left = 0x10000 - (uint64_t)t->counter;
+    if (ticks < left)
+        return (uint16_t)(t->counter + ticks);
+    return (uint16_t)(t->reload + (ticks - left) % (0x10000 - t->reload));
+}
+
+static void timer_schedule(int n)
+{
+    timer_channel_t *t = &timers.ch[n];
+    sched_event_t ev = (sched_event_t)(SCHED_TIMER0 + n);
+    if (timer_running(n))
+        sched_schedule(ev, t->start + ((0x10000 - (uint64_t)t->counter)
+                                       << t->shift));
+    else
+        sched_cancel(ev);
+}
+
+static void timer_overflow(int n, uint64_t when)
+{
+    timer_channel_t *t = &timers.ch[n];
+    t->counter = t->reload;
+    t->start = when;
+    if (timer_cnt(n) & TIMER_CNT_IRQ)
+        irq_raise((irq_t)(IRQ_TIMER0 + n));
+    if (n < 2)
+        apu_timer_overflow(n, when);
+    if (n < 3) {
+        uint16_t up = timer_cnt(n + 1);
+        if ((up & TIMER_CNT_ENABLE) && (up & TIMER_CNT_CASCADE) &&
+            ++timers.ch[n + 1].counter == 0)
+            timer_overflow(n + 1, when);
+    }
+}
+
+static void timer_event(int n, uint64_t when)
+{
+    timer_overflow(n, when);
+    timer_schedule(n);
+}
+
+static void timer_event0(uint64_t when)
+{
+    timer_event(0, when);
+}
+
+static void timer_event1(uint64_t when)
+{
+    timer_event(1, when);
+}
+
+static void timer_event2(uint64_t when)
+{
+    timer_event(2, when);
+}
+
+static void timer_event3(uint64_t when)
+{
+    timer_event(3, when);
+}
+
+void timer_init(void)
+{
+    static const sched_handler_t handler[4] = {timer_event0, timer_event1,
+                                               timer_event2, timer_event3};
+    memset(&timers, 0, sizeof(timers));
+    for (int n = 0; n < 4; ++n) {
+        sched_set_handler((sched_event_t)(SCHED_TIMER0 + n), handler[n]);
+        sched_cancel((sched_event_t)(SCHED_TIMER0 + n));
+    }
+}
+
+/* Load from TMxCNT_L. */
+uint16_t timer_read(int n)
+{
+    return timer_counter(n, arm.cycles);
+}
+
+/* Store to TMxCNT_L, the value loaded on start and on overflow. */
+void timer_write_reload(int n, uint16_t val)
+{
+    timers.ch[n].reload = val;
+}
+
+/* Store to TMxCNT_H. Overflows already due are handled and the counter
+ * is settled at the old settings before the new ones take effect. */
+void timer_write_cnt(int n, uint16_t val)
+{
+    timer_channel_t *t = &timers.ch[n];
+    sched_event_t ev = (sched_event_t)(SCHED_TIMER0 + n);
+    uint32_t reg = IO_TM0CNT_H + (uint32_t)n * IO_TM_STRIDE;
+    uint16_t old = IO_REG(reg);
+    uint64_t now = arm.cycles;
+    bool running = timer_running(n);
+
+    while (running && sched.when[ev] <= now)
+        timer_event(n, sched.when[ev]);
+    t->counter = timer_counter(n, now);
+    /* A timer that keeps running on the same prescaler keeps its phase. */
+    if (running && (val & TIMER_CNT_ENABLE) && now > t->start &&
+        TIMER_CNT_PRESCALER(old) == TIMER_CNT_PRESCALER(val))
+        t->start = now - ((now - t->start) & ((1u << t->shift) - 1));
+    else
+        t->start = now;
+    IO_REG(reg) = val;
+    t->shift = timer_shift[TIMER_CNT_PRESCALER(val)];
+    if ((val & TIMER_CNT_ENABLE) && !(old & TIMER_CNT_ENABLE))
+        t->counter = t->reload;
+    timer_schedule(n);
+}
@@ -0,0 +1,33 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* TMxCNT_H */
+#define TIMER_CNT_PRESCALER(v) ((v) & 3) /* 1, 64, 256 or 1024 cycles */
+#define TIMER_CNT_CASCADE (1u << 2)
+#define TIMER_CNT_IRQ (1u << 6)
+#define TIMER_CNT_ENABLE (1u << 7)
+
+/* A running timer is never ticked: its counter is worked out from the
+ * cycle it last had a known value, and its overflow is a scheduler
+ * event. Count-up timers only move when the timer below overflows. */
+typedef struct {
+    uint16_t reload;  /* TMxCNT_L as written */
+    uint16_t counter; /* value at start */
+    uint32_t shift;   /* log2 of the prescaler */
+    uint64_t start;
+} timer_channel_t;
+
+typedef struct {
+    timer_channel_t ch[4];
+} timers_t;
+
+extern timers_t timers;
+
+void timer_init(void);
+uint16_t timer_read(int n);
+void timer_write_reload(int n, uint16_t val);
+void timer_write_cnt(int n, uint16_t val);
+
+#endif /* !TIMER_H */
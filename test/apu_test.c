@@ -0,0 +1,310 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apu.h"
+#include "apu_ring.h"
+#include "arm.h"
+#include "dma.h"
+#include "gba.h"
+#include "io.h"
+#include "mmu.h"
+#include "sched.h"
+#include "test.h"
+#include "timer.h"
+#include "ut.h"
+
+static void apu_setup(void)
+{
+    sched_init();
+    mmu_init();
+    dma_init();
+    timer_init();
+    apu_init();
+    gba.audio = true;
+    /* FIFO A at 100% on the left, played at timer 0 overflows. */
+    mmu_write_half_word(0x04000000 + IO_SOUNDCNT_X, APU_CNTX_ENABLE);
+    mmu_write_half_word(0x04000000 + IO_SOUNDCNT_H,
+                        APU_CNT_DS_VOLUME(0) | APU_CNT_DS_LEFT(0) |
+                            APU_CNT_DS_RESET(0));
+}
+
+static void run_until(uint64_t cycles)
+{
+    while (arm.cycles < cycles) {
+        arm.cycles += 64;
+        sched_dispatch();
+    }
+}
+
+static int fifo_dma(void)
+{
+    apu_setup();
+    for (uint32_t i = 0; i < 16; ++i)
+        mmu_write_word(0x02000000 + i * 4, 0x04030201u + i * 0x04040404u);
+    /* Repeating sound DMA on channel 1. */
+    mmu_write_word(0x04000000 + IO_DMA0SAD + IO_DMA_STRIDE, 0x02000000);
+    mmu_write_word(0x04000000 + IO_DMA0DAD + IO_DMA_STRIDE,
+                   0x04000000 + IO_FIFO_A);
+    mmu_write_word(0x04000000 + IO_DMA0CNT_L + IO_DMA_STRIDE,
+                   4 | (uint32_t)(DMA_CNT_ENABLE | DMA_SPECIAL << 12 |
+                                  DMA_CNT_WORD | DMA_CNT_REPEAT)
+                           << 16);
+    ASSERT_EQ(0, apu.fifo[0].count);
+    /* An overflow every 256 cycles. */
+    uint64_t start = arm.cycles;
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_L, 0xff00);
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_H, TIMER_CNT_ENABLE);
+    /* The empty FIFO asks for data. */
+    run_until(start + 256);
+    ASSERT_EQ(16, apu.fifo[0].count);
+    ASSERT_EQ(0, apu.fifo[0].sample);
+    run_until(start + 512);
+    ASSERT_EQ(31, apu.fifo[0].count);
+    ASSERT_EQ(1, apu.fifo[0].sample);
+    ASSERT_EQ(16, apu.level[0]);
+    ASSERT_EQ(0, apu.level[1]);
+    ASSERT_EQ(0x02000020, dma.ch[1].src);
+    run_until(start + 256 * 4);
+    ASSERT_EQ(3, apu.fifo[0].sample);
+    /* Timer 1 does not clock FIFO A. */
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_H, 0);
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_H + IO_TM_STRIDE,
+                        TIMER_CNT_ENABLE);
+    run_until(arm.cycles + 0x20000);
+    ASSERT_EQ(3, apu.fifo[0].sample);
+    return 0;
+}
+
+static int frame_mix(void)
+{
+    apu_setup();
+    for (uint32_t i = 0; i < 4; ++i)
+        mmu_write_word(0x04000000 + IO_FIFO_A, 0x40404040);
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_L, 0xfe00);
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_H, TIMER_CNT_ENABLE);
+    run_until(arm.cycles + GBA_CYCLES_PER_FRAME);
+    apu.out_len = 0;
+    apu_end_frame();
+    /* 548 native samples less the filter length, at 48 kHz. */
+    ASSERT(apu.out_len > 780 && apu.out_len < 805);
+    /* The FIFO ran dry and holds its last sample. */
+    ASSERT_EQ(64 * 4 * 64, apu.out[apu.out_len * 2 - 2]);
+    ASSERT_EQ(0, apu.out[apu.out_len * 2 - 1]);
+    return 0;
+}
+
+static void psg_write(uint32_t offset, uint16_t val)
+{
+    mmu_write_half_word(0x04000000 + offset, val);
+}
+
+static int psg_square(void)
+{
+    int32_t max = 0, min = 0;
+    uint32_t edges = 0, flat = 0;
+    apu_setup();
+    psg_write(IO_SOUNDCNT_H, 2);
+    /* Square 2 on the left at full volume, 50% duty at 256 Hz. */
+    psg_write(IO_SOUNDCNT_L, 7 << 4 | 1 << 13);
+    psg_write(IO_SOUND2CNT_L, 15 << 12 | 2 << 6);
+    psg_write(IO_SOUND2CNT_H, 0x8000 | 1024);
+    ASSERT_EQ(2, IO_REG(IO_SOUNDCNT_X) & 0xf);
+    ASSERT_EQ(15, apu.psg[1].out);
+    /* Nothing to clock, the channel is left alone until the mix. */
+    ASSERT(sched.when[SCHED_PSG] == SCHED_IDLE);
+    run_until(arm.cycles + GBA_CYCLES_PER_FRAME);
+    apu.out_len = 0;
+    apu_end_frame();
+    for (uint32_t i = 1; i < apu.out_len; ++i) {
+        int32_t s = apu.out[i * 2];
+        max = s > max ? s : max;
+        min = s < min ? s : min;
+        edges += (s < 0) != (apu.out[i * 2 - 2] < 0);
+        flat += abs(s) == 15 * 8 * 4 * 16;
+        ASSERT_EQ(0, apu.out[i * 2 + 1]);
+    }
+    /* Exact levels between the band-limited edges, which overshoot. */
+    ASSERT(flat > apu.out_len * 8 / 10);
+    ASSERT(max < 15 * 8 * 4 * 16 * 5 / 4 && min > -15 * 8 * 4 * 16 * 5 / 4);
+    ASSERT(edges >= 3 && edges <= 5);
+    return 0;
+}
+
+static int psg_sequencer(void)
+{
+    apu_setup();
+    psg_write(IO_SOUNDCNT_L, 7 << 4 | 7 | 1 << 8 | 1 << 12);
+    /* Envelope going down every 64th of a second, length 4/256 s. */
+    psg_write(IO_SOUND1CNT_H, 15 << 12 | 1 << 8 | 60);
+    psg_write(IO_SOUND1CNT_X, 0xc000 | 1024);
+    ASSERT(sched.when[SCHED_PSG] != SCHED_IDLE);
+    run_until(arm.cycles + 3 * 65536);
+    ASSERT_EQ(1, IO_REG(IO_SOUNDCNT_X) & 0xf);
+    run_until(arm.cycles + 2 * 65536);
+    ASSERT_EQ(0, IO_REG(IO_SOUNDCNT_X) & 0xf);
+    ASSERT(sched.when[SCHED_PSG] == SCHED_IDLE);
+    ASSERT_EQ(0, apu.psg_level[0]);
+    /* Without a length, the envelope runs down to 0. */
+    psg_write(IO_SOUND1CNT_X, 0x8000 | 1024);
+    run_until(arm.cycles + 2 * 262144);
+    ASSERT(apu.psg[0].volume == 13 || apu.psg[0].volume == 14);
+    run_until(arm.cycles + 16 * 262144);
+    ASSERT_EQ(0, apu.psg[0].volume);
+    return 0;
+}
+
+static int psg_wave(void)
+{
+    apu_setup();
+    psg_write(IO_SOUNDCNT_L, 7 << 4 | 1 << 14);
+    /* Bank 1 is selected, so the CPU writes bank 0. */
+    psg_write(IO_SOUND3CNT_L, 0x40);
+    for (uint32_t i = 0; i < 16; i += 2)
+        psg_write(IO_WAVE_RAM + i, 0x3cf0);
+    psg_write(IO_SOUND3CNT_L, 0x80);
+    psg_write(IO_SOUND3CNT_H, 1 << 13);
+    psg_write(IO_SOUND3CNT_X, 0x8000 | 2047);
+    ASSERT_EQ(15, apu.psg[2].out);
+    apu_psg_run(arm.cycles + 8);
+    ASSERT_EQ(-15, apu.psg[2].out);
+    apu_psg_run(arm.cycles + 16);
+    ASSERT_EQ(-9, apu.psg[2].out);
+    /* 25% volume */
+    psg_write(IO_SOUND3CNT_H, 3 << 13);
+    ASSERT_EQ(-2, apu.psg[2].out);
+    return 0;
+}
+
+static int resample_kernels(void)
+{
+    static float left[2000], right[2000];
+    static int16_t expected[4000], actual[4000];
+    apu_init();
+    apu_set_rate(44100);
+    srand(1);
+    for (uint32_t i = 0; i < 2000; ++i) {
+        left[i] = (float)(rand() % 65536 - 32768);
+        right[i] = (float)(rand() % 4096);
+    }
+    uint64_t pos1 = 0x12345678, pos2 = 0x12345678;
+    size_t n1 = apu_resample_scalar(expected, 2000, left, right, 1000, &pos1,
+                                    apu.step);
+    size_t n2 = apu_resample(actual, 2000, left, right, 1000, &pos2, apu.step);
+    ASSERT_EQ(n1, n2);
+    ASSERT(pos1 == pos2);
+    ASSERT(n1 > 1300);
+    /* Sums in another order round differently at most by one. */
+    for (size_t i = 0; i < n1 * 2; ++i)
+        ASSERT(abs(expected[i] - actual[i]) <= 1);
+    return 0;
+}
+
+static int ring(void)
+{
+    apu_ring_t r;
+    int16_t in[40], out[40];
+    for (int16_t i = 0; i < 40; ++i)
+        in[i] = i;
+    ASSERT(apu_ring_init(&r, 6) != 0);
+    ASSERT(apu_ring_init(&r, 8) == 0);
+    ASSERT_EQ(6, apu_ring_write(&r, in, 6));
+    ASSERT_EQ(4, apu_ring_read(&r, out, 4));
+    ASSERT(memcmp(out, in, 4 * 4) == 0);
+    /* Wraps around, and drops what does not fit. */
+    ASSERT_EQ(6, apu_ring_write(&r, &in[12], 7));
+    ASSERT_EQ(1, r.dropped);
+    ASSERT_EQ(8, apu_ring_used(&r));
+    ASSERT_EQ(8, apu_ring_read(&r, out, 10));
+    ASSERT(memcmp(out, &in[8], 2 * 4) == 0);
+    ASSERT(memcmp(&out[4], &in[12], 6 * 4) == 0);
+    ASSERT_EQ(0, apu_ring_read(&r, out, 10));
+    apu_ring_free(&r);
+    return 0;
+}
+
+static int16_t lossless_out[400];
+
+static void *ring_reader(void *arg)
+{
+    apu_ring_t *r = arg;
+    size_t got = 0;
+    while (got < 200)
+        got += apu_ring_read(r, &lossless_out[got * 2], 3);
+    return NULL;
+}
+
+static int ring_lossless(void)
+{
+    apu_ring_t r;
+    pthread_t thread;
+    int16_t in[400];
+    for (int16_t i = 0; i < 400; ++i)
+        in[i] = i;
+    ASSERT(apu_ring_init(&r, 8) == 0);
+    r.lossless = true;
+    ASSERT(pthread_create(&thread, NULL, ring_reader, &r) == 0);
+    /* Far more than fits, the writer waits for the reader. */
+    for (size_t i = 0; i < 200; i += 5)
+        ASSERT_EQ(5, apu_ring_write(&r, &in[i * 2], 5));
+    pthread_join(thread, NULL);
+    ASSERT_EQ(0, r.dropped);
+    ASSERT(memcmp(lossless_out, in, sizeof(in)) == 0);
+    apu_ring_free(&r);
+    return 0;
+}
+
+static int wav_sink(void)
+{
+    static int16_t expected[APU_OUT_MAX * 2 * 3], actual[APU_OUT_MAX * 2 * 3];
+    char path[] = "/tmp/gusgba_wav_XXXXXX";
+    uint8_t header[44];
+    uint32_t n = 0;
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    apu_setup();
+    ASSERT(apu_sink_open(path, apu.rate) == 0);
+    psg_write(IO_SOUNDCNT_H, 2);
+    psg_write(IO_SOUNDCNT_L, 7 << 4 | 7 | 2 << 8 | 2 << 12);
+    psg_write(IO_SOUND2CNT_L, 12 << 12 | 1 << 6);
+    psg_write(IO_SOUND2CNT_H, 0x8000 | 1800);
+    for (int frame = 0; frame < 3; ++frame) {
+        run_until(arm.cycles + GBA_CYCLES_PER_FRAME);
+        apu.out_len = 0;
+        apu_end_frame();
+        memcpy(&expected[n * 2], apu.out, apu.out_len * 4);
+        n += apu.out_len;
+    }
+    ASSERT_EQ(0, apu_sink_close());
+
+    FILE *f = fopen(path, "rb");
+    ASSERT(f != NULL);
+    ASSERT_EQ(sizeof(header), fread(header, 1, sizeof(header), f));
+    size_t size = fread(actual, 4, APU_OUT_MAX * 3, f);
+    fclose(f);
+    unlink(path);
+    ASSERT(memcmp(header, "RIFF", 4) == 0);
+    ASSERT(memcmp(&header[36], "data", 4) == 0);
+    ASSERT_EQ(n * 4, header[40] | header[41] << 8 | header[42] << 16);
+    ASSERT_EQ(48000, header[24] | header[25] << 8 | header[26] << 16);
+    ASSERT_EQ(n, size);
+    ASSERT(memcmp(expected, actual, n * 4) == 0);
+    return 0;
+}
+
+void apu_test(void)
+{
+    ut_run(fifo_dma);
+    ut_run(frame_mix);
+    ut_run(psg_square);
+    ut_run(psg_sequencer);
+    ut_run(psg_wave);
+    ut_run(ring);
+    ut_run(ring_lossless);
+    ut_run(wav_sink);
+    ut_run(resample_kernels);
+}
@@ -0,0 +1,91 @@
+#include <string.h>
+
+#include "arm.h"
+#include "arm_isa.h"
+#include "arm_prof.h"
+#include "test.h"
+#include "ut.h"
+
+static int prof_dump(void (*dump)(FILE *f), char *buf, size_t size)
+{
+    memset(buf, 0, size);
+    FILE *f = fmemopen(buf, size, "w");
+    ASSERT(f != NULL);
+    dump(f);
+    fclose(f);
+    return 0;
+}
+
+static int call_tree(void)
+{
+    char buf[256];
+    arm.r[PC] = 0x08000000;
+    arm.cycles = 0;
+    arm_prof_start();
+    arm.cycles = 10;
+    arm_prof_call(0x08000100, 0x08000004);
+    arm.cycles = 15;
+    arm_prof_call(0x08000200, 0x08000104);
+    arm.cycles = 35;
+    arm_prof_return(0x08000104);
+    arm.cycles = 40;
+    arm_prof_return(0x08000004);
+    arm.cycles = 50;
+    arm_prof_stop();
+    ASSERT(prof_dump(arm_prof_dump_folded, buf, sizeof(buf)) == 0);
+    ASSERT(strcmp(buf, "0x08000000 20\n"
+                       "0x08000000;0x08000100 10\n"
+                       "0x08000000;0x08000100;0x08000200 20\n") == 0);
+    return 0;
+}
+
+static int recursion(void)
+{
+    char buf[256];
+    arm.r[PC] = 0x08000000;
+    arm.cycles = 0;
+    arm_prof_start();
+    arm_prof_call(0x08000100, 0x08000004);
+    arm.cycles = 10;
+    arm_prof_call(0x08000100, 0x08000104);
+    arm.cycles = 30;
+    arm_prof_return(0x08000104);
+    arm_prof_return(0x08000004);
+    arm_prof_stop();
+    ASSERT(prof_dump(arm_prof_dump_flat, buf, sizeof(buf)) == 0);
+    unsigned int calls;
+    unsigned long incl, excl;
+    char *line = strstr(buf, "0x08000100 ");
+    ASSERT(line != NULL);
+    ASSERT(sscanf(line, "0x08000100 %u %lu %lu", &calls, &incl, &excl) == 3);
+    ASSERT_EQ(2, calls);
+    ASSERT_EQ(30, incl);
+    ASSERT_EQ(30, excl);
+    return 0;
+}
+
+static int branch_hooks(void)
+{
+    char buf[256];
+    arm.r[PC] = 0x08000004;
+    arm.cycles = 0;
+    arm_prof_start();
+    /* bl #0x10 */
+    arm_instr[0xb00](0xeb000002);
+    arm.cycles += 7;
+    /* bx lr */
+    arm_instr[0x121](0xe12fff1e);
+    arm_prof_stop();
+    ASSERT_EQ(0x08000004, arm.r[PC]);
+    ASSERT(prof_dump(arm_prof_dump_folded, buf, sizeof(buf)) == 0);
+    ASSERT(strcmp(buf, "0x08000004 4\n"
+                       "0x08000004;0x08000010 7\n") == 0);
+    return 0;
+}
+
+void arm_prof_test(void)
+{
+    ut_run(call_tree);
+    ut_run(recursion);
+    ut_run(branch_hooks);
+}
@@ -2,6 +2,8 @@
 
 #include "arm.h"
 #include "asm/asm.h"
+#include "gba.h"
+#include "io.h"
 #include "mmu.h"
 #include "test.h"
 #include "ut.h"
@@ -11,33 +13,27 @@
 #define Z ARM_PSR_ZERO
 #define N ARM_PSR_NEGATIVE
 
-static uint8_t memory[0x10];
-static int mem_pos;
 static uint32_t default_flags =
     ARM_PSR_IRQ_DISABLE | ARM_PSR_FIQ_DISABLE | ARM_PSR_SVC_MODE;
 
-uint32_t mmu_read_word(uint32_t addr)
+/* Place the opcode at PC, writing through to ROM and BIOS pages. */
+static int test_arm_opcode(uint32_t opcode)
 {
-    (void)addr;
-    uint32_t val = *(uint32_t *)&memory[mem_pos];
-    mem_pos += 4;
-    return val;
-}
-
-uint16_t mmu_read_half_word(uint32_t addr)
-{
-    (void)addr;
-    uint16_t val = *(uint16_t *)&memory[mem_pos];
-    mem_pos += 2;
-    return val;
+    uint32_t pc = arm.r[PC];
+    uint8_t *page = mmu.read_page[pc >> MMU_PAGE_SHIFT];
+    ASSERT(page != NULL);
+    memcpy(page + (pc & MMU_PAGE_MASK), &opcode, sizeof(opcode));
+    arm_step();
+    return 0;
 }
 
 static int test_arm_rd(const char *src, int rd, uint32_t rd_val, uint32_t flags)
 {
     arm_psr_t f = {.psr = (flags | default_flags)};
-    mem_pos = 0;
-    ASSERT(asm_to_opcode(src, memory, sizeof(memory)) == 0);
-    arm_step();
+    uint32_t opcode[4];
+    ASSERT(asm_to_opcode(src, opcode, sizeof(opcode)) == 0);
+    arm.r[PC] = 0x03000000;
+    ASSERT(test_arm_opcode(opcode[0]) == 0);
     ASSERT_EQ(rd_val, arm.r[rd]);
     ASSERT_EQ(f.mode, arm.cpsr.mode);
     ASSERT_EQ(f.t, arm.cpsr.t);
@@ -343,8 +339,84 @@ static int arm_mvn_test(void)
     return 0;
 }
 
+static int arm_branch_test(void)
+{
+    arm_reset();
+    /* B */
+    arm.r[PC] = 0x08000000;
+    ASSERT(test_arm_opcode(0xea000000) == 0);
+    ASSERT_EQ(0x08000008, arm.r[PC]);
+    arm.r[PC] = 0x08000100;
+    ASSERT(test_arm_opcode(0xeafffffe) == 0);
+    ASSERT_EQ(0x08000100, arm.r[PC]);
+    /* BL */
+    arm.r[PC] = 0x08000000;
+    ASSERT(test_arm_opcode(0xeb000002) == 0);
+    ASSERT_EQ(0x08000010, arm.r[PC]);
+    ASSERT_EQ(0x08000004, arm.r[LR]);
+    /* BX */
+    ASSERT(test_arm_opcode(0xe12fff1e) == 0);
+    ASSERT_EQ(0x08000004, arm.r[PC]);
+    ASSERT_EQ(0, arm.cpsr.t);
+    arm.r[R0] = 0x08000101;
+    ASSERT(test_arm_opcode(0xe12fff10) == 0);
+    ASSERT_EQ(0x08000100, arm.r[PC]);
+    ASSERT_EQ(1, arm.cpsr.t);
+    return 0;
+}
+
+/* The BIOS handler's work around a game handler that only counts. */
+static int arm_irq_test(void)
+{
+    static uint32_t rom[0x80];
+    rom[0x40] = 0xe2855001; /* handler: add r5, r5, #1 */
+    rom[0x41] = 0xe12fff1e; /* bx lr */
+    gba_init();
+    mmu_load_rom(rom, sizeof(rom));
+    arm.r13_irq = 0x03007fa0;
+    arm_set_mode(ARM_PSR_SYS_MODE);
+    arm.cpsr.i = 0;
+    arm.r[SP] = 0x03007f00;
+    for (int i = 0; i < 15; ++i)
+        arm.r[i] = i == SP ? arm.r[SP] : 0x100u + (uint32_t)i;
+    arm.r[PC] = 0x08000020;
+    mmu_write_word(0x03007ffc, 0x08000100);
+
+    arm_irq();
+    ASSERT_EQ(ARM_PSR_IRQ_MODE, arm.cpsr.mode);
+    ASSERT_EQ(1, arm.cpsr.i);
+    ASSERT_EQ(ARM_PSR_SYS_MODE, arm.spsr_irq.mode);
+    ASSERT_EQ(0x08000100, arm.r[PC]);
+    ASSERT_EQ(ARM_BIOS_IRQ_RETURN, arm.r[LR]);
+    ASSERT_EQ(0x04000000, arm.r[R0]);
+    ASSERT_EQ(0x03007fa0 - 24, arm.r[SP]);
+    ASSERT_EQ(0x03007f00, arm.r13_usr);
+    /* r0-r3, r12 and the return address on the IRQ stack. */
+    ASSERT_EQ(0x100, mmu_read_word(0x03007fa0 - 24));
+    ASSERT_EQ(0x10c, mmu_read_word(0x03007fa0 - 8));
+    ASSERT_EQ(0x08000024, mmu_read_word(0x03007fa0 - 4));
+
+    arm_step();
+    arm_step();
+    ASSERT_EQ(ARM_BIOS_IRQ_RETURN, arm.r[PC]);
+    arm_step();
+    ASSERT_EQ(ARM_PSR_SYS_MODE, arm.cpsr.mode);
+    ASSERT_EQ(0, arm.cpsr.i);
+    ASSERT_EQ(0x08000020, arm.r[PC]);
+    ASSERT_EQ(0x03007f00, arm.r[SP]);
+    ASSERT_EQ(0x03007fa0, arm.r13_irq);
+    for (int i = 0; i < 15; ++i) {
+        if (i != SP)
+            ASSERT_EQ(i == R5 ? 0x106u : 0x100u + (uint32_t)i, arm.r[i]);
+    }
+    return 0;
+}
+
 void arm_test(void)
 {
+    static const uint8_t rom[0x200];
+    mmu_init();
+    mmu_load_rom(rom, sizeof(rom));
     arm_init();
     arm.r[1] = 0x01;
     arm.r[2] = 0x02;
@@ -372,4 +444,6 @@ void arm_test(void)
     ut_run(arm_mov_test);
     ut_run(arm_bic_test);
     ut_run(arm_mvn_test);
+    ut_run(arm_branch_test);
+    ut_run(arm_irq_test);
 }
@@ -82,8 +82,31 @@ static int dp_and(void)
     return 0;
 }
 
+static int branch(void)
+{
+    uint32_t buf[4];
+    ASSERT(asm_test("bx lr", 0xe12fff1e) == PARSER_OK);
+    ASSERT(asm_test("bx r0", 0xe12fff10) == PARSER_OK);
+    ASSERT(asm_test("l: b l", 0xeafffffe) == PARSER_OK);
+    ASSERT(asm_test("l: bl l", 0xebfffffe) == PARSER_OK);
+    ASSERT(asm_to_opcode("b x", buf, sizeof(buf)) == PARSER_ERR_LABEL);
+    ASSERT(asm_to_opcode("l: l:", buf, sizeof(buf)) == PARSER_ERR_LABEL);
+    /* Forward reference across lines with comments */
+    memset(buf, 0, sizeof(buf));
+    ASSERT(asm_to_opcode("bl f @ call\n"
+                         "mov r0, r1\n"
+                         "\n"
+                         "f: bx lr ; return\n",
+                         buf, sizeof(buf)) == PARSER_OK);
+    ASSERT_EQ(0xeb000000, buf[0]);
+    ASSERT_EQ(0xe1a00001, buf[1]);
+    ASSERT_EQ(0xe12fff1e, buf[2]);
+    return 0;
+}
+
 void parser_test(void)
 {
     ut_run(registers);
     ut_run(dp_and);
+    ut_run(branch);
 }
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backup.h"
+#include "test.h"
+#include "ut.h"
+
+static int detect(void)
+{
+    static uint8_t rom[64];
+    memset(rom, 0, sizeof(rom));
+    ASSERT_EQ(BACKUP_NONE, backup_detect(rom, sizeof(rom)));
+    memcpy(&rom[32], "FLASH1M_V103", 12);
+    ASSERT_EQ(BACKUP_FLASH_128K, backup_detect(rom, sizeof(rom)));
+    memcpy(&rom[32], "FLASH512_V13", 12);
+    ASSERT_EQ(BACKUP_FLASH_64K, backup_detect(rom, sizeof(rom)));
+    memcpy(&rom[32], "EEPROM_V124\0", 12);
+    ASSERT_EQ(BACKUP_EEPROM, backup_detect(rom, sizeof(rom)));
+    /* Library strings are word aligned. */
+    memset(rom, 0, sizeof(rom));
+    memcpy(&rom[33], "SRAM_V113\0\0\0", 12);
+    ASSERT_EQ(BACKUP_NONE, backup_detect(rom, sizeof(rom)));
+    return 0;
+}
+
+static void flash_cmd(uint8_t cmd)
+{
+    backup_write(0x0e005555, 0xaa);
+    backup_write(0x0e002aaa, 0x55);
+    backup_write(0x0e005555, cmd);
+}
+
+static int flash(void)
+{
+    ASSERT(backup_open(BACKUP_FLASH_128K, NULL) == 0);
+    flash_cmd(0x90);
+    ASSERT_EQ(0x62, backup_read(0x0e000000));
+    ASSERT_EQ(0x13, backup_read(0x0e000001));
+    flash_cmd(0xf0);
+    ASSERT_EQ(0xff, backup_read(0x0e000000));
+
+    flash_cmd(0xa0);
+    backup_write(0x0e001234, 0x42);
+    ASSERT_EQ(0x42, backup_read(0x0e001234));
+    flash_cmd(0xb0);
+    backup_write(0x0e000000, 1);
+    ASSERT_EQ(0xff, backup_read(0x0e001234));
+    flash_cmd(0xa0);
+    backup_write(0x0e001234, 0x24);
+    ASSERT_EQ(0x24, backup.data[0x11234]);
+
+    /* Sector erase only clears the 4KiB sector in the current bank. */
+    flash_cmd(0x80);
+    backup_write(0x0e005555, 0xaa);
+    backup_write(0x0e002aaa, 0x55);
+    backup_write(0x0e001000, 0x30);
+    ASSERT_EQ(0xff, backup.data[0x11234]);
+    ASSERT_EQ(0x42, backup.data[0x01234]);
+    flash_cmd(0x80);
+    flash_cmd(0x10);
+    ASSERT_EQ(0xff, backup.data[0x01234]);
+    backup_close();
+    return 0;
+}
+
+static void eeprom_send(uint32_t val, int bits)
+{
+    for (int i = bits - 1; i >= 0; --i)
+        backup_eeprom_write((uint16_t)((val >> i) & 1));
+}
+
+static int eeprom(void)
+{
+    ASSERT(backup_open(BACKUP_EEPROM, NULL) == 0);
+    ASSERT_EQ(0, backup.size);
+    /* Write block 3 of a 512 byte EEPROM, the size comes from the
+     * 6-bit address. */
+    eeprom_send(2, 2);
+    eeprom_send(3, 6);
+    eeprom_send(0x01234567, 32);
+    eeprom_send(0x89abcdef, 32);
+    eeprom_send(0, 1);
+    ASSERT_EQ(1, backup_eeprom_read());
+    ASSERT_EQ(BACKUP_EEPROM_512, backup.size);
+    ASSERT_EQ(0x01, backup.data[24]);
+    ASSERT_EQ(0xef, backup.data[31]);
+
+    eeprom_send(3, 2);
+    eeprom_send(3, 6);
+    eeprom_send(0, 1);
+    uint32_t hi = 0, lo = 0;
+    for (int i = 0; i < 4; ++i)
+        ASSERT_EQ(0, backup_eeprom_read());
+    for (int i = 0; i < 32; ++i)
+        hi = hi << 1 | backup_eeprom_read();
+    for (int i = 0; i < 32; ++i)
+        lo = lo << 1 | backup_eeprom_read();
+    ASSERT_EQ(0x01234567, hi);
+    ASSERT_EQ(0x89abcdef, lo);
+    ASSERT_EQ(1, backup_eeprom_read());
+    backup_close();
+    return 0;
+}
+
+static int persist(void)
+{
+    char path[] = "/tmp/gusgba_sav_XXXXXX";
+    uint8_t buf[BACKUP_SRAM_SIZE + 1];
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+    ASSERT(backup_open(BACKUP_SRAM, path) == 0);
+    backup_write(0x0e000010, 0x5a);
+    backup_write(0x0e008011, 0xa5);
+    backup_close();
+
+    FILE *f = fopen(path, "rb");
+    ASSERT(f != NULL);
+    size_t size = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    ASSERT_EQ(BACKUP_SRAM_SIZE, size);
+    ASSERT_EQ(0x5a, buf[0x10]);
+    ASSERT_EQ(0xa5, buf[0x11]);
+
+    /* Saves are loaded back on open. */
+    ASSERT(backup_open(BACKUP_SRAM, path) == 0);
+    ASSERT_EQ(0x5a, backup_read(0x0e000010));
+    backup_close();
+    unlink(path);
+    return 0;
+}
+
+static int read_save(const char *path, uint8_t *buf, size_t size)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return -1;
+    size_t n = fread(buf, 1, size, f);
+    fclose(f);
+    return n == size ? 0 : -1;
+}
+
+/* The flush thread saves on its own once writes stop, also while the
+ * emulation thread flushes. */
+static int settle(void)
+{
+    char path[] = "/tmp/gusgba_sav_XXXXXX";
+    static uint8_t buf[BACKUP_SRAM_SIZE];
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+    ASSERT(backup_open(BACKUP_SRAM, path) == 0);
+    for (uint32_t i = 0; i < 64; ++i) {
+        backup_write(0x0e000000 + i, (uint8_t)i);
+        if (i % 8 == 0)
+            ASSERT_EQ(0, backup_flush());
+        usleep(1000);
+    }
+    backup_write(0x0e000100, 0x77);
+    int saved = 0;
+    for (int i = 0; i < 300 && !saved; ++i) {
+        usleep(10000);
+        saved = read_save(path, buf, sizeof(buf)) == 0 && buf[0x100] == 0x77;
+    }
+    ASSERT(saved);
+    ASSERT_EQ(63, buf[63]);
+    ASSERT_EQ(0, backup_flush());
+    backup_close();
+    unlink(path);
+    return 0;
+}
+
+static int restore_in_memory(void)
+{
+    char path[] = "/tmp/gusgba_sav_XXXXXX";
+    static uint8_t state[BACKUP_STATE_SIZE], buf[BACKUP_SRAM_SIZE];
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+    ASSERT(backup_open(BACKUP_SRAM, path) == 0);
+    backup_write(0x0e000000, 0x11);
+    ASSERT_EQ(0, backup_flush());
+    memcpy(state, &backup, sizeof(state));
+    backup_write(0x0e000000, 0x22);
+    ASSERT_EQ(0, backup_flush());
+
+    /* Going back to a state does not touch the file. */
+    backup_restore(state);
+    ASSERT_EQ(0x11, backup_read(0x0e000000));
+    ASSERT_EQ(0, backup_flush());
+    ASSERT(read_save(path, buf, sizeof(buf)) == 0);
+    ASSERT_EQ(0x22, buf[0]);
+    /* The game's next write saves what it sees. */
+    backup_write(0x0e000001, 0x33);
+    ASSERT_EQ(0, backup_flush());
+    ASSERT(read_save(path, buf, sizeof(buf)) == 0);
+    ASSERT_EQ(0x11, buf[0]);
+    ASSERT_EQ(0x33, buf[1]);
+    backup_close();
+    unlink(path);
+    return 0;
+}
+
+void backup_test(void)
+{
+    ut_run(detect);
+    ut_run(flash);
+    ut_run(eeprom);
+    ut_run(persist);
+    ut_run(settle);
+    ut_run(restore_in_memory);
+}
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cart.h"
+#include "mmu.h"
+#include "test.h"
+#include "ut.h"
+
+static int write_rom(char *path, size_t size)
+{
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    FILE *f = fdopen(fd, "wb");
+    ASSERT(f != NULL);
+    for (size_t i = 0; i < size; ++i)
+        fputc((int)(i & 0xff) | 1, f);
+    fclose(f);
+    return 0;
+}
+
+static int shared_mapping(void)
+{
+    char path[] = "/tmp/gusgba_cart_XXXXXX";
+    size_t size = MMU_PAGE_SIZE + 100;
+    ASSERT(write_rom(path, size) == 0);
+    cart_t *a = cart_open(path);
+    cart_t *b = cart_open(path);
+    unlink(path);
+    ASSERT(a != NULL);
+    ASSERT(a == b);
+    ASSERT_EQ(2, a->refs);
+    ASSERT_EQ(size, a->size);
+    ASSERT_EQ(2 * MMU_PAGE_SIZE, a->map_size);
+    ASSERT_EQ(0x01, a->data[0]);
+    ASSERT_EQ(0x63, a->data[size - 1]);
+    /* The page-rounded tail reads as zero. */
+    ASSERT_EQ(0, a->data[size]);
+    ASSERT_EQ(0, a->data[a->map_size - 1]);
+    cart_close(b);
+    ASSERT_EQ(1, a->refs);
+    cart_close(a);
+    return 0;
+}
+
+static int invalid_size(void)
+{
+    char path[] = "/tmp/gusgba_cart_XXXXXX";
+    ASSERT(write_rom(path, 0) == 0);
+    cart_t *cart = cart_open(path);
+    unlink(path);
+    ASSERT(cart == NULL);
+    return 0;
+}
+
+void cart_test(void)
+{
+    ut_run(shared_mapping);
+    ut_run(invalid_size);
+}
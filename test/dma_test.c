@@ -0,0 +1,88 @@
+#include "arm.h"
+#include "dma.h"
+#include "io.h"
+#include "irq.h"
+#include "mmu.h"
+#include "test.h"
+#include "ut.h"
+
+static void dma_start(int ch, uint32_t src, uint32_t dst, uint32_t cnt)
+{
+    uint32_t base = 0x04000000 + IO_DMA0SAD + (uint32_t)ch * IO_DMA_STRIDE;
+    mmu_write_word(base, src);
+    mmu_write_word(base + 4, dst);
+    mmu_write_word(base + 8, cnt);
+}
+
+static int copy(void)
+{
+    mmu_init();
+    dma_init();
+    for (uint32_t i = 0; i < 256; ++i)
+        mmu_write_word(0x02000000 + i * 4, 0x1000 + i);
+    uint32_t start = (uint32_t)arm.cycles;
+    dma_start(3, 0x02000000, 0x06000000, 256 | 0x84000000u);
+    /* 2 internal cycles, 2 per unit and 32-bit EWRAM/VRAM waitstates. */
+    ASSERT_EQ(2 + 512 + (5 + 1) * 256, (uint32_t)arm.cycles - start);
+    ASSERT_EQ(1, dma.fast);
+    ASSERT_EQ(0x1000, mmu_read_word(0x06000000));
+    ASSERT_EQ(0x10ff, mmu_read_word(0x060003fc));
+    ASSERT_EQ(0, IO_REG(IO_DMA3CNT_H) & DMA_CNT_ENABLE);
+    return 0;
+}
+
+static int fill(void)
+{
+    mmu_init();
+    dma_init();
+    mmu_write_word(0x03000000, 0xabcd1234);
+    dma_start(3, 0x03000000, 0x05000000, 0x200 | 0x81000000u);
+    ASSERT_EQ(1, dma.fast);
+    ASSERT_EQ(0x12341234, mmu_read_word(0x05000000));
+    ASSERT_EQ(0x12341234, mmu_read_word(0x050003fc));
+    return 0;
+}
+
+static int slow_path(void)
+{
+    mmu_init();
+    dma_init();
+    for (uint32_t i = 0; i < 4; ++i)
+        mmu_write_half_word(0x02000000 + i * 2, (uint16_t)(i + 1));
+    /* Decrementing source, into OAM with an IRQ at the end. */
+    IO_REG(IO_IE) = 1 << IRQ_DMA0;
+    IO_REG(IO_IME) = 1;
+    dma_start(0, 0x02000006, 0x07000000, 4 | 0xc0800000u);
+    ASSERT_EQ(1, dma.slow);
+    ASSERT_EQ(0x00030004, mmu_read_word(0x07000000));
+    ASSERT_EQ(0x00010002, mmu_read_word(0x07000004));
+    ASSERT(irq_pending());
+    mmu_write_half_word(0x04000000 + IO_IF, 1 << IRQ_DMA0);
+    ASSERT(!irq_pending());
+    return 0;
+}
+
+static int vblank(void)
+{
+    mmu_init();
+    dma_init();
+    mmu_write_word(0x02000000, 0x55aa55aa);
+    /* Repeat with a reloaded destination, waiting for VBlank. */
+    dma_start(1, 0x02000000, 0x03000100, 1 | 0x96600000u);
+    ASSERT_EQ(0, mmu_read_word(0x03000100));
+    dma_trigger(DMA_VBLANK);
+    ASSERT_EQ(0x55aa55aa, mmu_read_word(0x03000100));
+    mmu_write_word(0x02000004, 0x12345678);
+    dma_trigger(DMA_VBLANK);
+    ASSERT_EQ(0x12345678, mmu_read_word(0x03000100));
+    ASSERT(IO_REG(IO_DMA0CNT_H + IO_DMA_STRIDE) & DMA_CNT_ENABLE);
+    return 0;
+}
+
+void dma_test(void)
+{
+    ut_run(copy);
+    ut_run(fill);
+    ut_run(slow_path);
+    ut_run(vblank);
+}
@@ -0,0 +1,103 @@
+#include <stdlib.h>
+
+#include "arm.h"
+#include "gba.h"
+#include "instance.h"
+#include "mmu.h"
+#include "state.h"
+#include "test.h"
+#include "ut.h"
+
+static int fork_switch(void)
+{
+    size_t size = state_size();
+    uint8_t *sa = malloc(size), *sb = malloc(size);
+    ASSERT(sa != NULL && sb != NULL);
+    test_boot("INSTANCE");
+    gba_run_frame();
+    mmu_write_word(0x02000000, 0x11111111);
+    mmu_write_half_word(0x06000000, 0x1234);
+    state_save(sa, size);
+    instance_t *a = instance_fork();
+    ASSERT(a != NULL);
+
+    /* Taken away until the page is first written. */
+    ASSERT(mmu.write_page[0x02000000 >> MMU_PAGE_SHIFT] == NULL);
+    mmu_write_word(0x02000000, 0x22222222);
+    ASSERT(mmu.write_page[0x02000000 >> MMU_PAGE_SHIFT] != NULL);
+    ASSERT(mmu.write_page[0x02040000 >> MMU_PAGE_SHIFT] != NULL);
+    ASSERT(mmu.write_page[0x02004000 >> MMU_PAGE_SHIFT] == NULL);
+    for (int i = 0; i < 3; ++i)
+        gba_run_frame();
+    mmu_write_half_word(0x06000000, 0x5678);
+    state_save(sb, size);
+    instance_t *b = instance_fork();
+    ASSERT(b != NULL);
+
+    mmu_write_word(0x03007f00, 0xffffffff);
+    ASSERT(instance_switch(a) == 0);
+    ASSERT(test_same_state(sa));
+    ASSERT_EQ(0x11, mmu.mem.ewram[0]);
+    gba_run_frame();
+    ASSERT(instance_switch(b) == 0);
+    ASSERT(test_same_state(sb));
+    ASSERT_EQ(0x78, mmu.mem.vram[0]);
+
+    /* A loaded state leaves nothing in common with the instances. */
+    ASSERT(state_load(sa, size) == 0);
+    ASSERT(instance_switch(b) == 0);
+    ASSERT(test_same_state(sb));
+    ASSERT(instance_switch(a) == 0);
+    ASSERT(test_same_state(sa));
+
+    instance_free(a);
+    instance_free(b);
+    ASSERT_EQ(0, instance_bytes());
+    free(sa);
+    free(sb);
+    return 0;
+}
+
+static int shared(void)
+{
+    test_boot("INSTANCE");
+    gba_run_frame();
+    instance_t *a = instance_fork();
+    ASSERT(a != NULL);
+    size_t bytes = instance_bytes();
+    size_t core = state_core_size();
+    ASSERT(core < state_size() / 8);
+    ASSERT(bytes > MMU_COW_PAGES * MMU_PAGE_SIZE);
+
+    /* Nothing written, nothing copied but the core. */
+    gba_run_frame();
+    instance_t *b = instance_fork();
+    ASSERT(b != NULL);
+    ASSERT(instance_bytes() - bytes < core + 1024);
+    bytes = instance_bytes();
+
+    /* One page written through a mirror. */
+    mmu_write_byte(0x02040001, 1);
+    instance_t *c = instance_fork();
+    ASSERT(c != NULL);
+    ASSERT(instance_bytes() - bytes >= MMU_PAGE_SIZE);
+    ASSERT(instance_bytes() - bytes < MMU_PAGE_SIZE + core + 1024);
+
+    /* The page is still shared by a and b. */
+    ASSERT(instance_switch(a) == 0);
+    ASSERT_EQ(0, mmu.mem.ewram[1]);
+    ASSERT(instance_switch(c) == 0);
+    ASSERT_EQ(1, mmu.mem.ewram[1]);
+
+    instance_free(b);
+    instance_free(c);
+    instance_free(a);
+    ASSERT_EQ(0, instance_bytes());
+    return 0;
+}
+
+void instance_test(void)
+{
+    ut_run(fork_switch);
+    ut_run(shared);
+}
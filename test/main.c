@@ -8,6 +8,18 @@ int main(void)
     lex_test();
     parser_test();
     arm_test();
+    arm_prof_test();
+    backup_test();
+    cart_test();
+    mmu_test();
+    dma_test();
+    ppu_test();
+    apu_test();
+    timer_test();
+    state_test();
+    rewind_test();
+    movie_test();
+    instance_test();
     ut_result();
     return 0;
 }
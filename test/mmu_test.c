@@ -0,0 +1,148 @@
+#include <string.h>
+
+#include "arm.h"
+#include "gba.h"
+#include "io.h"
+#include "irq.h"
+#include "mmu.h"
+#include "test.h"
+#include "timer.h"
+#include "ut.h"
+
+static int mirrors(void)
+{
+    mmu_init();
+    mmu_write_word(0x02000010, 0x12345678);
+    ASSERT_EQ(0x12345678, mmu_read_word(0x02040010));
+    ASSERT_EQ(0x5678, mmu_read_half_word(0x02000010));
+    ASSERT_EQ(0x56, mmu_read_byte(0x02000011));
+    mmu_write_half_word(0x03008002, 0xbeef);
+    ASSERT_EQ(0xbeef0000, mmu_read_word(0x03000000));
+    /* Unaligned word reads are aligned down. */
+    ASSERT_EQ(0xbeef0000, mmu_read_word(0x03000003));
+    return 0;
+}
+
+static int video_writes(void)
+{
+    mmu_init();
+    /* 8-bit writes go to both bytes of palette and BG VRAM halfwords,
+     * and are dropped for OBJ VRAM and OAM. */
+    mmu_write_byte(0x05000001, 0x7c);
+    ASSERT_EQ(0x7c7c, mmu_read_half_word(0x05000000));
+    mmu_write_byte(0x06000004, 0x11);
+    ASSERT_EQ(0x1111, mmu_read_half_word(0x06000004));
+    mmu_write_byte(0x06010000, 0x11);
+    ASSERT_EQ(0, mmu_read_half_word(0x06010000));
+    mmu_write_byte(0x07000000, 0x11);
+    ASSERT_EQ(0, mmu_read_half_word(0x07000000));
+    /* The upper 32KiB of a VRAM mirror repeat the OBJ tiles. */
+    mmu_write_half_word(0x06010002, 0x4321);
+    ASSERT_EQ(0x4321, mmu_read_half_word(0x06018002));
+    return 0;
+}
+
+static int rom(void)
+{
+    static const uint8_t data[] = {0x01, 0x02, 0x03, 0x04};
+    mmu_init();
+    ASSERT(mmu_load_rom(data, sizeof(data)) == 0);
+    ASSERT_EQ(0x04030201, mmu_read_word(0x08000000));
+    ASSERT_EQ(0x04030201, mmu_read_word(0x0a000000));
+    /* Reads past the end of the cartridge return the address bus. */
+    ASSERT_EQ(0x2000, mmu_read_half_word(0x08004000));
+    return 0;
+}
+
+static int waitstates(void)
+{
+    static const uint8_t data[16];
+    mmu_init();
+    ASSERT(mmu_load_rom(data, sizeof(data)) == 0);
+    arm.cycles = 0;
+    mmu_read_word(0x02000000);
+    ASSERT_EQ(5, arm.cycles);
+    /* WS0 defaults to 4 nonsequential and 2 sequential cycles. */
+    arm.cycles = 0;
+    mmu_read_half_word(0x08000000);
+    mmu_read_half_word(0x08000002);
+    ASSERT_EQ(4 + 2, arm.cycles);
+    /* 3/1 cycles once WAITCNT is written. */
+    mmu_write_half_word(0x04000000 + IO_WAITCNT, 0x0014);
+    arm.cycles = 0;
+    mmu_read_half_word(0x08000000);
+    mmu_read_half_word(0x08000002);
+    ASSERT_EQ(3 + 1, arm.cycles);
+    arm.cycles = 0;
+    mmu_read_word(0x03000000);
+    ASSERT_EQ(0, arm.cycles);
+    return 0;
+}
+
+static int prefetch(void)
+{
+    static const uint8_t data[64];
+    mmu_init();
+    ASSERT(mmu_load_rom(data, sizeof(data)) == 0);
+    /* WS0 at 3/1 cycles with the prefetch buffer, 2 cycles a halfword. */
+    mmu_write_half_word(0x04000000 + IO_WAITCNT, 0x4014);
+    arm.cycles = 0;
+    mmu_fetch_word(0x08000000);
+    ASSERT_EQ(3 + 1 + 1, arm.cycles);
+    /* Nothing buffered yet, a plain sequential access. */
+    mmu_fetch_word(0x08000004);
+    ASSERT_EQ(5 + 3, arm.cycles);
+    /* Two halfwords buffered in 4 cycles, the fetch is free. */
+    arm.cycles += 4;
+    mmu_fetch_word(0x08000008);
+    ASSERT_EQ(12, arm.cycles);
+    /* One halfword buffered, waits for the other. */
+    arm.cycles += 2;
+    mmu_fetch_word(0x0800000c);
+    ASSERT_EQ(15, arm.cycles);
+    /* A cartridge data read stops the prefetcher. */
+    arm.cycles += 16;
+    mmu_read_word(0x08000020);
+    arm.cycles = 0;
+    mmu_fetch_word(0x08000010);
+    ASSERT_EQ(5, arm.cycles);
+    /* Disabled, every fetch waits, the first one is nonsequential after
+     * the WAITCNT write. */
+    mmu_write_half_word(0x04000000 + IO_WAITCNT, 0x0014);
+    arm.cycles = 0;
+    mmu_fetch_word(0x08000014);
+    arm.cycles += 16;
+    mmu_fetch_word(0x08000018);
+    ASSERT_EQ(5 + 16 + 3, arm.cycles);
+    return 0;
+}
+
+/* Byte stores to I/O only act on the byte written. */
+static int io_bytes(void)
+{
+    gba_init();
+    IO_REG(IO_IF) = 1 << IRQ_VBLANK | 1 << IRQ_DMA0 | 1 << IRQ_KEYPAD;
+    mmu_write_byte(0x04000000 + IO_IF, 1 << IRQ_VBLANK);
+    ASSERT_EQ(1 << IRQ_DMA0 | 1 << IRQ_KEYPAD, IO_REG(IO_IF));
+    mmu_write_byte(0x04000000 + IO_IF + 1, 1 << (IRQ_DMA0 - 8));
+    ASSERT_EQ(1 << IRQ_KEYPAD, IO_REG(IO_IF));
+
+    /* The other byte of the reload is kept, not the counter read last. */
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_L, 0x1234);
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_H, TIMER_CNT_ENABLE);
+    arm.cycles += 0x100;
+    ASSERT(mmu_read_half_word(0x04000000 + IO_TM0CNT_L) != 0x1234);
+    mmu_write_byte(0x04000000 + IO_TM0CNT_L + 1, 0xab);
+    ASSERT_EQ(0xab34, timers.ch[0].reload);
+    return 0;
+}
+
+void mmu_test(void)
+{
+    ut_run(mirrors);
+    ut_run(video_writes);
+    ut_run(rom);
+    ut_run(waitstates);
+    ut_run(prefetch);
+    ut_run(io_bytes);
+}
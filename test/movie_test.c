@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "arm.h"
+#include "gba.h"
+#include "io.h"
+#include "irq.h"
+#include "mmu.h"
+#include "movie.h"
+#include "test.h"
+#include "ut.h"
+
+static int keypad(void)
+{
+    test_boot("MOVIE");
+    ASSERT_EQ(GBA_KEY_ALL, IO_REG(IO_KEYINPUT));
+    gba_set_keys(GBA_KEY_A | GBA_KEY_UP);
+    ASSERT_EQ(GBA_KEY_ALL & ~(GBA_KEY_A | GBA_KEY_UP), IO_REG(IO_KEYINPUT));
+    /* Read-only to the CPU. */
+    mmu_write_half_word(0x04000000 + IO_KEYINPUT, 0);
+    ASSERT_EQ(GBA_KEY_ALL & ~(GBA_KEY_A | GBA_KEY_UP), IO_REG(IO_KEYINPUT));
+
+    mmu_write_half_word(0x04000000 + IO_KEYCNT, GBA_KEYCNT_IRQ |
+                                                    GBA_KEYCNT_AND |
+                                                    GBA_KEY_A | GBA_KEY_B);
+    gba_set_keys(GBA_KEY_A);
+    ASSERT_EQ(0, IO_REG(IO_IF));
+    gba_set_keys(GBA_KEY_A | GBA_KEY_B);
+    ASSERT_EQ(1 << IRQ_KEYPAD, IO_REG(IO_IF));
+    return 0;
+}
+
+static int replay(void)
+{
+    char path[] = "/tmp/gusgba_movie_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    test_boot("MOVIE");
+    for (int i = 0; i < 3; ++i)
+        gba_run_frame();
+    ASSERT(movie_record(path, 5) == 0);
+    for (uint16_t i = 0; i < 20; ++i) {
+        gba_set_keys(i % 3 ? GBA_KEY_RIGHT : GBA_KEY_A);
+        gba_run_frame();
+    }
+    ASSERT(movie_stop() == 0);
+    uint32_t count = arm.r[0];
+
+    /* From anywhere, playing goes back to where the recording began. */
+    test_boot("MOVIE");
+    ASSERT(movie_play(path) == 0);
+    ASSERT_EQ(20, movie_length());
+    ASSERT_EQ(3, gba.frame);
+    for (int i = 0; i < 20; ++i)
+        gba_run_frame();
+    ASSERT(!movie_active());
+    ASSERT_EQ(count, arm.r[0]);
+    ASSERT_EQ(GBA_KEY_ALL & ~GBA_KEY_RIGHT, IO_REG(IO_KEYINPUT));
+    ASSERT_EQ(-1, movie_divergence());
+    movie_stop();
+
+    /* A state that goes wrong in frame 12 shows at the next hash. */
+    ASSERT(movie_play(path) == 0);
+    for (int i = 0; i < 20; ++i) {
+        if (i == 11)
+            mmu.mem.iwram[0x100] ^= 1;
+        gba_run_frame();
+    }
+    ASSERT_EQ(15, movie_divergence());
+    movie_stop();
+    unlink(path);
+    return 0;
+}
+
+/* Rewrite the frame count in the header of the movie at path. */
+static int set_frames(const char *path, uint32_t frames)
+{
+    FILE *f = fopen(path, "r+b");
+    ASSERT(f != NULL);
+    movie_header_t h;
+    ASSERT(fread(&h, sizeof(h), 1, f) == 1);
+    h.frames = frames;
+    rewind(f);
+    ASSERT(fwrite(&h, sizeof(h), 1, f) == 1);
+    ASSERT(fclose(f) == 0);
+    return 0;
+}
+
+static int bad_header(void)
+{
+    char path[] = "/tmp/gusgba_movie_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    test_boot("MOVIE");
+    ASSERT(movie_record(path, 4) == 0);
+    for (int i = 0; i < 8; ++i)
+        gba_run_frame();
+    ASSERT(movie_stop() == 0);
+    /* Counts that do not add up to the file are turned away before
+     * anything is allocated from them. */
+    ASSERT(set_frames(path, 0xffffffff) == 0);
+    ASSERT(movie_play(path) == -1);
+    ASSERT(set_frames(path, 9) == 0);
+    ASSERT(movie_play(path) == -1);
+    ASSERT(!movie_active());
+    ASSERT(set_frames(path, 8) == 0);
+    ASSERT(movie_play(path) == 0);
+    ASSERT_EQ(8, movie_length());
+    movie_stop();
+    unlink(path);
+    return 0;
+}
+
+static int held_key_irq(void)
+{
+    char path[] = "/tmp/gusgba_movie_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    /* The frontend sets the keys once, playback sets them every frame.
+     * With the keypad IRQ acked after each frame, as a handler would,
+     * a key held down has to raise it once either way. */
+    test_boot("MOVIE");
+    mmu_write_half_word(0x04000000 + IO_KEYCNT, GBA_KEYCNT_IRQ | GBA_KEY_A);
+    ASSERT(movie_record(path, 1) == 0);
+    gba_set_keys(GBA_KEY_A);
+    for (int i = 0; i < 5; ++i) {
+        gba_run_frame();
+        mmu_write_half_word(0x04000000 + IO_IF, 1 << IRQ_KEYPAD);
+    }
+    ASSERT(movie_stop() == 0);
+
+    test_boot("MOVIE");
+    ASSERT(movie_play(path) == 0);
+    for (int i = 0; i < 5; ++i) {
+        gba_run_frame();
+        mmu_write_half_word(0x04000000 + IO_IF, 1 << IRQ_KEYPAD);
+    }
+    ASSERT_EQ(-1, movie_divergence());
+    movie_stop();
+    unlink(path);
+    return 0;
+}
+
+void movie_test(void)
+{
+    ut_run(keypad);
+    ut_run(replay);
+    ut_run(held_key_irq);
+    ut_run(bad_header);
+}
@@ -0,0 +1,554 @@
+#include <string.h>
+
+#include "arm.h"
+#include "gba.h"
+#include "io.h"
+#include "irq.h"
+#include "mmu.h"
+#include "ppu.h"
+#include "ppu_blend.h"
+#include "ppu_color.h"
+#include "sched.h"
+#include "test.h"
+#include "ut.h"
+
+static int color_kernels(void)
+{
+    static uint16_t src[0x8000 + 1];
+    static uint32_t expected[0x8000], actual[0x8000];
+    static uint8_t idx[PPU_WIDTH + 3];
+    static uint32_t pal[0x8000];
+    ppu_color_init();
+    ASSERT_EQ(0xff000000, ppu_color(0x0000));
+    ASSERT_EQ(0xffffffff, ppu_color(0x7fff));
+    ASSERT_EQ(0xff0000ff, ppu_color(0x001f));
+    for (uint32_t i = 0; i < 0x8000; ++i) {
+        src[i] = (uint16_t)i;
+        pal[i] = i * 0x9e3779b9u;
+    }
+    /* Odd lengths exercise the scalar tails. */
+    ppu_color_convert_scalar(expected, src, 0x8000 - 3);
+    ppu_color_convert(actual, src, 0x8000 - 3);
+    ASSERT(memcmp(expected, actual, (0x8000 - 3) * 4) == 0);
+    for (uint32_t i = 0; i < sizeof(idx); ++i)
+        idx[i] = (uint8_t)(i * 37 + 255);
+    ppu_color_lookup_scalar(expected, idx, &pal[0x1234], sizeof(idx));
+    ppu_color_lookup(actual, idx, &pal[0x1234], sizeof(idx));
+    ASSERT(memcmp(expected, actual, sizeof(idx) * 4) == 0);
+    return 0;
+}
+
+/* Stores, kept out of line: inlining every mmu_write() into the larger
+ * tests runs into GCC's function growth limit under -Winline. */
+static __attribute__((noinline)) void mem_write(uint32_t addr, uint32_t val,
+                                                mmu_width_t width)
+{
+    mmu_write(addr, val, width);
+}
+
+/* Render line y with the BG2 reference point where the scanlines
+ * would have stepped it. */
+static void bitmap_line(uint32_t y)
+{
+    ppu.affine[0].x = 0;
+    ppu.affine[0].y = (int32_t)(y << 8);
+    ppu_render_line(y);
+}
+
+static int bitmap_modes(void)
+{
+    uint16_t *vram = (uint16_t *)mmu.mem.vram;
+    mmu_init();
+    ppu_init();
+    mem_write(0x05000000, 0x001f, MMU_WIDTH_16);
+    mem_write(0x05000000 + 7 * 2, 0x7c00, MMU_WIDTH_16);
+    /* Mode 3 */
+    vram[10 * PPU_WIDTH + 5] = 0x03e0;
+    IO_REG(IO_DISPCNT) = 3 | PPU_DISPCNT_BG(2);
+    bitmap_line(10);
+    ASSERT_EQ(0xff00ff00, ppu.frame[10 * PPU_WIDTH + 5]);
+    ASSERT_EQ(0xff000000, ppu.frame[10 * PPU_WIDTH + 6]);
+    /* Mode 4, second page */
+    mmu.mem.vram[0xa000 + 20 * PPU_WIDTH + 239] = 7;
+    IO_REG(IO_DISPCNT) = 4 | PPU_DISPCNT_PAGE | PPU_DISPCNT_BG(2);
+    bitmap_line(20);
+    ASSERT_EQ(0xffff0000, ppu.frame[20 * PPU_WIDTH + 239]);
+    ASSERT_EQ(0xff0000ff, ppu.frame[20 * PPU_WIDTH + 238]);
+    /* Mode 5 is 160 pixels wide, the rest is backdrop. */
+    IO_REG(IO_DISPCNT) = 5 | PPU_DISPCNT_BG(2);
+    vram[0] = 0x7fff;
+    bitmap_line(0);
+    ASSERT_EQ(0xffffffff, ppu.frame[0]);
+    ASSERT_EQ(0xff0000ff, ppu.frame[160]);
+    bitmap_line(130);
+    ASSERT_EQ(0xff0000ff, ppu.frame[130 * PPU_WIDTH]);
+    /* Scaled by two and moved, mode 5 samples every other pixel. */
+    vram[3 * 160 + 100] = 0x03e0;
+    IO_REG(IO_BG2PA) = 0x80;
+    ppu.affine[0].x = 100 << 8;
+    ppu.affine[0].y = 3 << 8;
+    ppu_render_line(50);
+    ASSERT_EQ(0xff00ff00, ppu.frame[50 * PPU_WIDTH]);
+    ASSERT_EQ(0xff00ff00, ppu.frame[50 * PPU_WIDTH + 1]);
+    ASSERT_EQ(0xff000000, ppu.frame[50 * PPU_WIDTH + 2]);
+    /* Past the bitmap's 160 pixels, at 100 + 120 / 2, is backdrop. */
+    ASSERT_EQ(0xff000000, ppu.frame[50 * PPU_WIDTH + 119]);
+    ASSERT_EQ(0xff0000ff, ppu.frame[50 * PPU_WIDTH + 120]);
+    /* Rotated a quarter turn, screen x walks down a VRAM column. */
+    IO_REG(IO_BG2PA) = 0;
+    IO_REG(IO_BG2PC) = 0x100;
+    ppu.affine[0].x = 100 << 8;
+    ppu.affine[0].y = 0;
+    ppu_render_line(60);
+    ASSERT_EQ(0xff00ff00, ppu.frame[60 * PPU_WIDTH + 3]);
+    ASSERT_EQ(0xff000000, ppu.frame[60 * PPU_WIDTH + 4]);
+    ASSERT_EQ(0xff0000ff, ppu.frame[60 * PPU_WIDTH + 128]);
+    IO_REG(IO_BG2PA) = 0x100;
+    IO_REG(IO_BG2PC) = 0;
+    /* Forced blank is white. */
+    IO_REG(IO_DISPCNT) = 3 | PPU_DISPCNT_BG(2) | PPU_DISPCNT_BLANK;
+    ppu_render_line(0);
+    ASSERT_EQ(0xffffffff, ppu.frame[1]);
+    return 0;
+}
+
+static uint32_t px(uint32_t y, uint32_t x)
+{
+    return ppu.frame[y * PPU_WIDTH + x];
+}
+
+static int palette_cache(void)
+{
+    static uint8_t lut[32];
+    mmu_init();
+    ppu_init();
+    mem_write(0x05000000 + 7 * 2, 0x7c00, MMU_WIDTH_16);
+    mem_write(0x05000000 + 0x200, 0x03e0001f, MMU_WIDTH_32);
+    ASSERT_EQ(0xffff0000, ppu.host_pal[7]);
+    ASSERT_EQ(0xff0000ff, ppu.host_pal[256]);
+    ASSERT_EQ(0xff00ff00, ppu.host_pal[257]);
+    /* Byte writes store both halves. */
+    mem_write(0x05000000 + 8 * 2 + 1, 0x1f, MMU_WIDTH_8);
+    ASSERT_EQ(ppu_color(0x1f1f), ppu.host_pal[8]);
+    /* Corrected colors, in the cache and in converted lines. */
+    for (uint32_t i = 0; i < 32; ++i)
+        lut[i] = (uint8_t)(i * 2);
+    ppu_color_correction(lut);
+    ASSERT_EQ(0xff3e0000, ppu.host_pal[7]);
+    mmu.mem.vram[0] = 7;
+    IO_REG(IO_DISPCNT) = 4 | PPU_DISPCNT_BG(2);
+    ppu_render_line(0);
+    ASSERT_EQ(0xff3e0000, px(0, 0));
+    IO_REG(IO_DISPCNT) = 0;
+    mem_write(0x05000000, 0x001f, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(0xff00003e, px(0, 0));
+    ppu_color_correction(NULL);
+    ASSERT_EQ(0xffff0000, ppu.host_pal[7]);
+    return 0;
+}
+
+static int text_bg(void)
+{
+    mmu_init();
+    ppu_init();
+    /* BG0: 4bpp tiles at char block 0, map at screen block 8. */
+    mem_write(0x04000000 + IO_BG0CNT, 8 << 8, MMU_WIDTH_16);
+    IO_REG(IO_DISPCNT) = 0 | PPU_DISPCNT_BG(0);
+    mem_write(0x05000000 + (2 * 16 + 1) * 2, 0x001f, MMU_WIDTH_16);
+    mem_write(0x05000000 + (2 * 16 + 2) * 2, 0x03e0, MMU_WIDTH_16);
+    /* Tile 1, row 0: pixel 0 is color 1, pixel 7 color 2. */
+    mem_write(0x06000000 + 32, 0x20000001, MMU_WIDTH_32);
+    /* Map entry (1, 0): tile 1, palette bank 2. */
+    mem_write(0x06004000 + 2, 1 | 2 << 12, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(0xff000000, px(0, 7));
+    ASSERT_EQ(0xff0000ff, px(0, 8));
+    ASSERT_EQ(0xff00ff00, px(0, 15));
+    /* The cached tile follows VRAM writes. */
+    mem_write(0x06000000 + 32, 0x10000002, MMU_WIDTH_32);
+    ppu_render_line(0);
+    ASSERT_EQ(0xff00ff00, px(0, 8));
+    ASSERT_EQ(0xff0000ff, px(0, 15));
+    /* Horizontal flip and scrolling. */
+    mem_write(0x06004000 + 2, 1 | 1 << 10 | 2 << 12, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BG0HOFS, 3, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(0xff0000ff, px(0, 5));
+    ASSERT_EQ(0xff00ff00, px(0, 12));
+    return 0;
+}
+
+static int affine_bg(void)
+{
+    mmu_init();
+    ppu_init();
+    /* BG2 in mode 1, 128x128 map at screen block 2, tiles at block 0. */
+    mem_write(0x04000000 + IO_BG0CNT + 4, 2 << 8, MMU_WIDTH_16);
+    IO_REG(IO_DISPCNT) = 1 | PPU_DISPCNT_BG(2);
+    mem_write(0x05000000 + 5 * 2, 0x7c00, MMU_WIDTH_16);
+    mem_write(0x06001000 + 1, 1, MMU_WIDTH_8);
+    mem_write(0x06000040, 0x0505, MMU_WIDTH_16);
+    IO_REG(IO_BG2PA) = 0x100;
+    IO_REG(IO_BG2PD) = 0x100;
+    ppu_affine_latch(2);
+    ppu_render_line(0);
+    ASSERT_EQ(0xffff0000, px(0, 8));
+    ASSERT_EQ(0xffff0000, px(0, 9));
+    ASSERT_EQ(0xff000000, px(0, 10));
+    /* Outside the map is transparent unless it wraps around. */
+    ASSERT_EQ(0xff000000, px(0, 136));
+    mem_write(0x04000000 + IO_BG0CNT + 4, 2 << 8 | 1 << 13, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(0xffff0000, px(0, 136));
+    /* Half scale through PA, the reference point set through X. */
+    IO_REG(IO_BG2PA) = 0x80;
+    mem_write(0x04000000 + IO_BG2X, 4 << 8, MMU_WIDTH_32);
+    ppu_render_line(0);
+    ASSERT_EQ(0xffff0000, px(0, 8));
+    ASSERT_EQ(0xff000000, px(0, 7));
+    return 0;
+}
+
+static int priority(void)
+{
+    mmu_init();
+    ppu_init();
+    IO_REG(IO_DISPCNT) = 0 | PPU_DISPCNT_BG(0) | PPU_DISPCNT_BG(1);
+    /* BG0 priority 1, BG1 priority 0, both 8bpp with tile 1 everywhere
+     * on the first row of the map, different colors. */
+    mem_write(0x04000000 + IO_BG0CNT, 1 | 1 << 7 | 8 << 8, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BG0CNT + 2, 1 << 7 | 9 << 8, MMU_WIDTH_16);
+    mem_write(0x06004000, 1, MMU_WIDTH_16);
+    mem_write(0x06004800, 1, MMU_WIDTH_16);
+    mem_write(0x06000040, 0x0101, MMU_WIDTH_16);
+    mem_write(0x05000000 + 2, 0x001f, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(0xff0000ff, px(0, 0));
+    /* Transparent BG1 pixels show BG0. */
+    mem_write(0x06004800, 0, MMU_WIDTH_16);
+    mem_write(0x06004000 + 0x40, 0, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(0xff0000ff, px(0, 0));
+    return 0;
+}
+
+static void oam_set(uint32_t i, uint16_t a0, uint16_t a1, uint16_t a2)
+{
+    mem_write(0x07000000 + i * 8, a0, MMU_WIDTH_16);
+    mem_write(0x07000000 + i * 8 + 2, a1, MMU_WIDTH_16);
+    mem_write(0x07000000 + i * 8 + 4, a2, MMU_WIDTH_16);
+}
+
+static int sprites(void)
+{
+    mmu_init();
+    ppu_init();
+    IO_REG(IO_DISPCNT) = 0 | PPU_DISPCNT_OBJ | PPU_DISPCNT_OBJ_1D;
+    mem_write(0x05000000 + 0x200 + (16 + 3) * 2, 0x001f, MMU_WIDTH_16);
+    mem_write(0x06010000 + 2 * 32, 3, MMU_WIDTH_32);
+    mem_write(0x06010000 + 2 * 32 + 28, 3, MMU_WIDTH_32);
+    /* 8x8, 4bpp, tile 2, palette bank 1. */
+    oam_set(5, 20, 30, 2 | 1 << 12);
+    ppu_render_line(20);
+    ASSERT_EQ(0xff0000ff, px(20, 30));
+    ASSERT_EQ(0xff000000, px(20, 31));
+    ppu_render_line(19);
+    ASSERT_EQ(0xff000000, px(19, 30));
+    /* Horizontal flip, attribute writes move the sprite between lines. */
+    mem_write(0x07000000 + 5 * 8 + 2, 30 | 0x1000, MMU_WIDTH_16);
+    mem_write(0x07000000 + 5 * 8, 100, MMU_WIDTH_16);
+    ppu_render_line(20);
+    ASSERT_EQ(0xff000000, px(20, 37));
+    ppu_render_line(100);
+    ASSERT_EQ(0xff0000ff, px(100, 37));
+    /* Sprites wrap from the bottom to the top of the screen. */
+    oam_set(5, 250, 30, 2 | 1 << 12);
+    ppu_render_line(1);
+    ASSERT_EQ(0xff0000ff, px(1, 30));
+    /* Affine, double size: the 16x16 area centers the 8x8 texture. */
+    oam_set(0, 40 | 0x300, 50, 2 | 1 << 12);
+    mem_write(0x07000006, 0x100, MMU_WIDTH_16);
+    mem_write(0x0700001e, 0x100, MMU_WIDTH_16);
+    ppu_render_line(44);
+    ASSERT_EQ(0xff0000ff, px(44, 54));
+    ASSERT_EQ(0xff000000, px(44, 53));
+    /* Half size through PA. */
+    mem_write(0x07000006, 0x200, MMU_WIDTH_16);
+    ppu_render_line(44);
+    ASSERT_EQ(0xff0000ff, px(44, 56));
+    ASSERT_EQ(0xff000000, px(44, 55));
+    return 0;
+}
+
+static int sprite_modes(void)
+{
+    uint16_t *vram = (uint16_t *)mmu.mem.vram;
+    mmu_init();
+    ppu_init();
+    IO_REG(IO_DISPCNT) = 3 | PPU_DISPCNT_BG(2) | PPU_DISPCNT_OBJ |
+                         PPU_DISPCNT_WINOBJ | PPU_DISPCNT_OBJ_1D;
+    for (int x = 0; x < PPU_WIDTH; ++x)
+        vram[x] = 0x7c00;
+    mem_write(0x05000000 + 0x200 + 3 * 2, 0x001f, MMU_WIDTH_16);
+    /* In bitmap modes sprites use tiles from 512. */
+    mem_write(0x06014000, 3, MMU_WIDTH_32);
+    oam_set(0, 0, 0, 512 | 1 << 10);
+    oam_set(1, 0 | 0x800, 16, 512);
+    oam_set(2, 0 | 0x400, 32, 512);
+    mem_write(0x04000000 + IO_WINOUT, 0x3f | 0x30 << 8, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BLDCNT, 1 << 10, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BLDALPHA, 8 | 8 << 8, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BG0CNT + 4, 2, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(0xff0000ff, px(0, 0));
+    ASSERT_EQ(0xff000000, px(0, 16));
+    ASSERT_EQ(0xffff0000, px(0, 17));
+    ASSERT_EQ(0xff7b007b, px(0, 32));
+    /* A background with a lower priority value covers the sprite. */
+    mem_write(0x04000000 + IO_BG0CNT + 4, 0, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(0xffff0000, px(0, 0));
+    return 0;
+}
+
+static int blend_kernels(void)
+{
+    static const uint32_t prio[] = {
+        PPU_LAYER(0, 1, 0), PPU_LAYER(1, 2, 1), PPU_LAYER(2, 0, 4),
+        PPU_LAYER(2, 0, 4) | PPU_LAYER_SEMI, PPU_LAYER(4, 0, 5),
+    };
+    uint32_t top[2][PPU_WIDTH + 3], below[2][PPU_WIDTH + 3];
+    uint32_t layer[PPU_WIDTH + 3];
+    uint16_t expected[PPU_WIDTH + 3], actual[PPU_WIDTH + 3];
+    uint8_t win[PPU_WIDTH + 3];
+    uint32_t seed = 1;
+    ppu_blend_init();
+    for (size_t i = 0; i < PPU_WIDTH + 3; ++i) {
+        top[0][i] = top[1][i] = PPU_LAYER(4, 0, 5);
+        below[0][i] = below[1][i] = PPU_LAYER_NONE;
+    }
+    for (int l = 0; l < 4; ++l) {
+        for (size_t i = 0; i < PPU_WIDTH + 3; ++i) {
+            seed = seed * 1103515245 + 12345;
+            layer[i] = seed & 0x10000 ? PPU_LAYER_NONE
+                                      : prio[(seed >> 20) % 5] |
+                                            (seed >> 1 & 0x7fff);
+        }
+        ppu_blend_stack_scalar(top[0], below[0], layer, PPU_WIDTH + 3);
+        ppu_blend_stack(top[1], below[1], layer, PPU_WIDTH + 3);
+    }
+    ASSERT(memcmp(top[0], top[1], sizeof(top[0])) == 0);
+    ASSERT(memcmp(below[0], below[1], sizeof(below[0])) == 0);
+    for (size_t i = 0; i < PPU_WIDTH + 3; ++i)
+        win[i] = i % 7 ? 0x3f : 0x1f;
+    /* Odd lengths exercise the scalar tails. */
+    for (uint32_t mode = 0; mode < 4; ++mode) {
+        ppu_blend_t b = {0x13, 0x26, mode, 16, 7, 9};
+        ppu_blend_effects_scalar(expected, top[0], below[0], win, &b,
+                                 PPU_WIDTH + 3);
+        ppu_blend_effects(actual, top[0], below[0], win, &b, PPU_WIDTH + 3);
+        ASSERT(memcmp(expected, actual, sizeof(expected)) == 0);
+    }
+    return 0;
+}
+
+static int effects(void)
+{
+    uint16_t *vram = (uint16_t *)mmu.mem.vram;
+    mmu_init();
+    ppu_init();
+    for (int x = 0; x < PPU_WIDTH; ++x)
+        vram[x] = 0x0010;
+    mem_write(0x05000000, 0x7c00, MMU_WIDTH_16);
+    IO_REG(IO_DISPCNT) = 3 | PPU_DISPCNT_BG(2);
+    /* Brighten BG2, darken it. */
+    mem_write(0x04000000 + IO_BLDCNT, 1 << 2 | 2 << 6, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BLDY, 8, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(ppu_color(0x3df7), px(0, 0));
+    mem_write(0x04000000 + IO_BLDCNT, 1 << 2 | 3 << 6, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(ppu_color(0x0008), px(0, 0));
+    /* Alpha with the backdrop as second target. */
+    mem_write(0x04000000 + IO_BLDCNT, 1 << 2 | 1 << 6 | 1 << 13, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BLDALPHA, 16 | 8 << 8, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(ppu_color(0x3c10), px(0, 0));
+    return 0;
+}
+
+static int windows(void)
+{
+    uint16_t *vram = (uint16_t *)mmu.mem.vram;
+    mmu_init();
+    ppu_init();
+    for (int y = 0; y < 2; ++y)
+        for (int x = 0; x < PPU_WIDTH; ++x)
+            vram[y * PPU_WIDTH + x] = 0x001f;
+    IO_REG(IO_DISPCNT) = 3 | PPU_DISPCNT_BG(2) | PPU_DISPCNT_WIN(0) |
+                         PPU_DISPCNT_WIN(1);
+    /* WIN0 [10, 20) on line 0 only shows BG2, WIN1 wraps around from
+     * 230 to 5 and shows nothing, the outside shows BG2. */
+    mem_write(0x04000000 + IO_WIN0H, 10 << 8 | 20, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_WIN0V, 0 << 8 | 1, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_WIN0H + 2, 230 << 8 | 5, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_WIN0V + 2, 0 << 8 | 160, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_WININ, 0x04, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_WINOUT, 0x04, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(0xff000000, px(0, 0));
+    ASSERT_EQ(0xff0000ff, px(0, 5));
+    ASSERT_EQ(0xff0000ff, px(0, 10));
+    ASSERT_EQ(0xff000000, px(0, 239));
+    /* WIN0 covers WIN1 where they overlap. */
+    mem_write(0x04000000 + IO_WIN0H, 0 << 8 | 2, MMU_WIDTH_16);
+    ppu_render_line(0);
+    ASSERT_EQ(0xff0000ff, px(0, 1));
+    ASSERT_EQ(0xff000000, px(0, 2));
+    ppu_render_line(1);
+    ASSERT_EQ(0xff000000, px(1, 1));
+    return 0;
+}
+
+static void run_to(uint64_t cycles)
+{
+    arm.cycles = cycles;
+    sched_dispatch();
+}
+
+static int timing(void)
+{
+    sched_init();
+    mmu_init();
+    irq_init();
+    arm.cycles = 0;
+    ppu_init();
+    IO_REG(IO_DISPSTAT) = PPU_STAT_VBLANK_IRQ | PPU_STAT_VCOUNT_IRQ | 3 << 8;
+    run_to(PPU_HDRAW_CYCLES);
+    ASSERT_EQ(PPU_STAT_HBLANK, IO_REG(IO_DISPSTAT) & 7);
+    run_to(3 * PPU_LINE_CYCLES);
+    ASSERT_EQ(3, IO_REG(IO_VCOUNT));
+    ASSERT_EQ(PPU_STAT_VCOUNT, IO_REG(IO_DISPSTAT) & 7);
+    ASSERT_EQ(1 << IRQ_VCOUNT, IO_REG(IO_IF));
+    run_to(PPU_HEIGHT * PPU_LINE_CYCLES);
+    ASSERT_EQ(PPU_STAT_VBLANK, IO_REG(IO_DISPSTAT) & 7);
+    ASSERT_EQ(1 << IRQ_VCOUNT | 1 << IRQ_VBLANK, IO_REG(IO_IF));
+    ASSERT_EQ(1, ppu.frames);
+    run_to(PPU_LINES * PPU_LINE_CYCLES);
+    ASSERT_EQ(0, IO_REG(IO_VCOUNT));
+    ASSERT_EQ(0, IO_REG(IO_DISPSTAT) & PPU_STAT_VBLANK);
+    return 0;
+}
+
+static int render_skip(void)
+{
+    const uint64_t frame = PPU_LINES * PPU_LINE_CYCLES;
+    sched_init();
+    mmu_init();
+    irq_init();
+    arm.cycles = 0;
+    gba.video = true;
+    ppu_init();
+    /* Set after init, as the frontend does, it covers frame 0 too. */
+    gba_set_video(false, 0);
+    mem_write(0x05000000, 0x001f, MMU_WIDTH_16);
+    memset(ppu.frame, 0, sizeof(ppu.frame));
+    /* Nothing is drawn, the timing goes on. */
+    run_to(frame);
+    ASSERT_EQ(0, px(80, 10));
+    ASSERT_EQ(1, ppu.frames);
+    run_to(frame + 5 * PPU_LINE_CYCLES);
+    ASSERT_EQ(5, IO_REG(IO_VCOUNT));
+    /* Frame 1 has started, a request draws frame 2. */
+    ASSERT_EQ(2, gba_request_frame());
+    run_to(2 * frame);
+    ASSERT_EQ(0, px(80, 10));
+    run_to(3 * frame);
+    ASSERT_EQ(0xff0000ff, px(80, 10));
+    /* Every other frame with a frameskip of 1. */
+    gba_set_video(true, 1);
+    memset(ppu.frame, 0, sizeof(ppu.frame));
+    run_to(4 * frame);
+    ASSERT_EQ(0, px(80, 10));
+    run_to(5 * frame);
+    ASSERT_EQ(0xff0000ff, px(80, 10));
+    gba_set_video(true, 0);
+    return 0;
+}
+
+/* Two frames of a scene that changes between lines, like a game would. */
+static void scene(bool threaded, uint32_t *frame)
+{
+    sched_init();
+    mmu_init();
+    irq_init();
+    arm.cycles = 0;
+    ppu_init();
+    if (threaded)
+        ppu_thread_start();
+    mem_write(0x04000000 + IO_DISPCNT,
+              1 | PPU_DISPCNT_BG(0) | PPU_DISPCNT_BG(2) | PPU_DISPCNT_OBJ |
+                  PPU_DISPCNT_OBJ_1D,
+              MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BG0CNT, 8 << 8, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BG0CNT + 4, 1 | 2 << 8 | 1 << 13, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BG2PA, 0x0f0, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BG2PD, 0x110, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BLDCNT, 1 << 0 | 1 << 6 | 1 << 10, MMU_WIDTH_16);
+    mem_write(0x04000000 + IO_BLDALPHA, 10 | 6 << 8, MMU_WIDTH_16);
+    for (uint32_t i = 0; i < 256; ++i)
+        mem_write(0x05000000 + i * 2, (uint16_t)(i * 0x1357), MMU_WIDTH_16);
+    for (uint32_t i = 0; i < 0x800; ++i)
+        mem_write(0x06000000 + i * 4, i * 0x9e3779b9u, MMU_WIDTH_32);
+    oam_set(3, 8 | 0x300, 40 | 1 << 14, 3);
+    mem_write(0x07000006, 0x0c0, MMU_WIDTH_16);
+    mem_write(0x0700001e, 0x100, MMU_WIDTH_16);
+    for (uint32_t line = 0; line < 2 * PPU_LINES; ++line) {
+        run_to((line + 1) * PPU_LINE_CYCLES);
+        mem_write(0x04000000 + IO_BG0HOFS, (uint16_t)line, MMU_WIDTH_16);
+        mem_write(0x06010000 + 96 + (line % 32) * 4, line * 0x01010101u,
+                  MMU_WIDTH_32);
+        mem_write(0x07000000 + 3 * 8 + 2, (uint16_t)(40 + line), MMU_WIDTH_16);
+        if (line % 50 == 0)
+            mem_write(0x04000000 + IO_BG2X, line << 8, MMU_WIDTH_32);
+    }
+    ppu_thread_sync();
+    memcpy(frame, ppu.frame, sizeof(ppu.frame));
+    ppu_thread_stop();
+}
+
+static int render_thread(void)
+{
+    static uint32_t expected[PPU_HEIGHT * PPU_WIDTH];
+    static uint32_t actual[PPU_HEIGHT * PPU_WIDTH];
+    gba.video = true;
+    scene(false, expected);
+    scene(true, actual);
+    /* Make sure the scene draws more than the backdrop. */
+    uint32_t drawn = 0;
+    for (uint32_t i = 0; i < PPU_HEIGHT * PPU_WIDTH; ++i)
+        drawn += expected[i] != expected[0];
+    ASSERT(drawn > PPU_HEIGHT * PPU_WIDTH / 2);
+    ASSERT(memcmp(expected, actual, sizeof(expected)) == 0);
+    ASSERT(!ppu.threaded);
+    return 0;
+}
+
+void ppu_test(void)
+{
+    ut_run(color_kernels);
+    ut_run(bitmap_modes);
+    ut_run(palette_cache);
+    ut_run(text_bg);
+    ut_run(affine_bg);
+    ut_run(priority);
+    ut_run(sprites);
+    ut_run(sprite_modes);
+    ut_run(blend_kernels);
+    ut_run(effects);
+    ut_run(windows);
+    ut_run(timing);
+    ut_run(render_skip);
+    ut_run(render_thread);
+}
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+
+#include "arm.h"
+#include "gba.h"
+#include "mmu.h"
+#include "rewind.h"
+#include "state.h"
+#include "test.h"
+#include "ut.h"
+
+/* Run a frame, and keep the state when a capture is due. */
+static void rewind_run(uint8_t *states, uint32_t n, uint32_t interval)
+{
+    size_t size = state_size();
+    for (uint32_t i = 1; i <= n * interval; ++i) {
+        gba_run_frame();
+        if (i % interval == 0)
+            state_save(&states[(i / interval - 1) * size], size);
+    }
+}
+
+static int steps(void)
+{
+    size_t size = state_size();
+    uint8_t *states = malloc(size * 5);
+    ASSERT(states != NULL);
+    test_boot("REWIND");
+    ASSERT(rewind_init(1 << 20, 2) == 0);
+    rewind_run(states, 5, 2);
+    ASSERT_EQ(5, rewind_count());
+    /* The deltas are a small part of the states. */
+    ASSERT(rewind_used() < size / 8);
+    gba_run_frame();
+    for (int i = 4; i >= 0; --i) {
+        ASSERT(rewind_step() == 0);
+        ASSERT(test_same_state(&states[(size_t)i * size]));
+    }
+    ASSERT(rewind_step() == -1);
+
+    /* Capturing again after going back. */
+    ASSERT(rewind_step() == -1);
+    rewind_run(states, 2, 2);
+    ASSERT_EQ(2, rewind_count());
+    ASSERT(rewind_step() == 0);
+    ASSERT(test_same_state(&states[size]));
+    rewind_free();
+    free(states);
+    return 0;
+}
+
+static int bounded(void)
+{
+    size_t size = state_size();
+    uint8_t *states = malloc(size * 20);
+    ASSERT(states != NULL);
+    test_boot("REWIND");
+    ASSERT(rewind_init(1 << 20, 1) == 0);
+    rewind_run(states, 2, 1);
+    size_t delta = rewind_used();
+    /* Room for about four deltas, the oldest ones go. */
+    ASSERT(rewind_init(delta * 4 + delta / 2, 1) == 0);
+    rewind_run(states, 20, 1);
+    ASSERT(rewind_count() < 20);
+    ASSERT(rewind_count() >= 3);
+    ASSERT(rewind_used() <= delta * 4 + delta / 2);
+    uint32_t n = rewind_count();
+    for (uint32_t i = 0; i < n; ++i) {
+        ASSERT(rewind_step() == 0);
+        ASSERT(test_same_state(&states[(size_t)(19 - i) * size]));
+    }
+    ASSERT(rewind_step() == -1);
+    rewind_free();
+    free(states);
+    return 0;
+}
+
+void rewind_test(void)
+{
+    ut_run(steps);
+    ut_run(bounded);
+}
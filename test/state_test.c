@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm.h"
+#include "gba.h"
+#include "io.h"
+#include "mmu.h"
+#include "state.h"
+#include "test.h"
+#include "timer.h"
+#include "ut.h"
+
+static void state_boot(const char *title)
+{
+    test_boot(title);
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_L, 0x8000);
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_H, TIMER_CNT_ENABLE | 1);
+    mmu_write_word(0x02000000, 0x12345678);
+}
+
+static int round_trip(void)
+{
+    size_t size = state_size();
+    uint8_t *a = malloc(size), *b = malloc(size), *c = malloc(size);
+    ASSERT(a != NULL && b != NULL && c != NULL);
+    state_boot("ROUNDTRIP");
+    gba_run_frame();
+    gba_run_frame();
+    ASSERT(state_save(a, size) == 0);
+    mmu_write_word(0x02000000, 0);
+    for (int i = 0; i < 3; ++i)
+        gba_run_frame();
+    ASSERT(state_save(b, size) == 0);
+    uint32_t count = arm.r[0];
+
+    /* Going back and running the same frames again ends up in the same
+     * place, down to the last byte. */
+    ASSERT(state_load(a, size) == 0);
+    ASSERT_EQ(2, gba.frame);
+    ASSERT(arm.r[0] < count);
+    /* Looked at directly, a read would take cycles. */
+    ASSERT_EQ(0x78, mmu.mem.ewram[0]);
+    mmu_write_word(0x02000000, 0);
+    for (int i = 0; i < 3; ++i)
+        gba_run_frame();
+    ASSERT(state_save(c, size) == 0);
+    ASSERT_EQ(count, arm.r[0]);
+    ASSERT(memcmp(b, c, size) == 0);
+    free(a);
+    free(b);
+    free(c);
+    return 0;
+}
+
+static int mismatch(void)
+{
+    size_t size = state_size();
+    uint8_t *a = malloc(size);
+    ASSERT(a != NULL);
+    state_boot("FIRST");
+    gba_run_frame();
+    ASSERT(state_save(a, size) == 0);
+    ASSERT(state_save(a, size - 1) == -1);
+    gba_run_frame();
+    uint64_t frame = gba.frame;
+
+    ASSERT(state_load(a, size - 8) == -1);
+    ((state_header_t *)a)->version++;
+    ASSERT(state_load(a, size) == -1);
+    ((state_header_t *)a)->version--;
+    ASSERT_EQ(frame, gba.frame);
+
+    /* Another cartridge. */
+    state_boot("SECOND");
+    ASSERT(state_load(a, size) == -1);
+    ASSERT_EQ(0, gba.frame);
+    free(a);
+    return 0;
+}
+
+void state_test(void)
+{
+    ut_run(round_trip);
+    ut_run(mismatch);
+}
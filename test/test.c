@@ -0,0 +1,45 @@
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm.h"
+#include "gba.h"
+#include "mmu.h"
+#include "state.h"
+
+/* The interpreter has no loads and stores yet, the program only counts. */
+static const uint32_t test_program[] = {
+    0xe2800001, /* loop: add r0, r0, #1 */
+    0xe0811000, /* add r1, r1, r0 */
+    0xeafffffc, /* b loop */
+};
+
+static uint8_t test_rom[0x200];
+
+/* Power on with a ROM that counts in r0 and r1, started from the cart
+ * the way the BIOS would hand over. The title goes in the header. */
+void test_boot(const char *title)
+{
+    memset(test_rom, 0, sizeof(test_rom));
+    memcpy(test_rom, test_program, sizeof(test_program));
+    memcpy(&test_rom[0xa0], title, strlen(title));
+    gba_init();
+    mmu_load_rom(test_rom, sizeof(test_rom));
+    arm.cpsr.mode = ARM_PSR_SYS_MODE;
+    arm.r[PC] = 0x08000000;
+    gba.next_frame_cycles = arm.cycles + GBA_CYCLES_PER_FRAME;
+}
+
+/* Is the machine in the state want, as state_save() would write it. */
+bool test_same_state(const uint8_t *want)
+{
+    size_t size = state_size();
+    uint8_t *now = malloc(size);
+    if (now == NULL)
+        return false;
+    state_save(now, size);
+    bool same = memcmp(now, want, size) == 0;
+    free(now);
+    return same;
+}
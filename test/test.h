@@ -1,8 +1,26 @@
 #ifndef TEST_H
 #define TEST_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 void lex_test(void);
 void parser_test(void);
+void apu_test(void);
 void arm_test(void);
+void arm_prof_test(void);
+void backup_test(void);
+void cart_test(void);
+void dma_test(void);
+void instance_test(void);
+void mmu_test(void);
+void movie_test(void);
+void ppu_test(void);
+void rewind_test(void);
+void state_test(void);
+void timer_test(void);
+
+void test_boot(const char *title);
+bool test_same_state(const uint8_t *want);
 
 #endif /* !TEST_H */
@@ -0,0 +1,158 @@
+#include "arm.h"
+#include "io.h"
+#include "irq.h"
+#include "mmu.h"
+#include "sched.h"
+#include "test.h"
+#include "timer.h"
+#include "ut.h"
+
+static void timer_setup(void)
+{
+    sched_init();
+    mmu_init();
+    irq_init();
+    timer_init();
+}
+
+static void timer_start(int n, uint16_t reload, uint16_t cnt)
+{
+    uint32_t base = 0x04000000 + IO_TM0CNT_L + (uint32_t)n * IO_TM_STRIDE;
+    mmu_write_half_word(base, reload);
+    mmu_write_half_word(base + 2, cnt);
+}
+
+static uint16_t timer_load(int n)
+{
+    return (uint16_t)mmu_read_half_word(0x04000000 + IO_TM0CNT_L +
+                                        (uint32_t)n * IO_TM_STRIDE);
+}
+
+static void run_until(uint64_t cycles)
+{
+    while (arm.cycles < cycles) {
+        arm.cycles += 16;
+        sched_dispatch();
+    }
+}
+
+static int lazy_counter(void)
+{
+    timer_setup();
+    uint64_t start = arm.cycles;
+    /* Prescaler 64, 16 ticks to the overflow. */
+    timer_start(0, 0xfff0, TIMER_CNT_ENABLE | 1);
+    ASSERT_EQ(0xfff0, timer_load(0));
+    ASSERT(sched.when[SCHED_TIMER0] == start + 16 * 64);
+    arm.cycles = start + 5 * 64 + 63;
+    ASSERT_EQ(0xfff5, timer_load(0));
+    /* A new reload only applies from the next overflow. */
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_L, 0xff00);
+    ASSERT_EQ(0xfff5, timer_load(0));
+    /* Stopping freezes the counter and the event. */
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_H, 1);
+    arm.cycles += 0x1000;
+    ASSERT_EQ(0xfff5, timer_load(0));
+    ASSERT(sched.when[SCHED_TIMER0] == SCHED_IDLE);
+    return 0;
+}
+
+static int overflow_irq(void)
+{
+    timer_setup();
+    uint64_t start = arm.cycles;
+    timer_start(1, 0xff00, TIMER_CNT_ENABLE | TIMER_CNT_IRQ);
+    arm.cycles = start + 255;
+    sched_dispatch();
+    ASSERT_EQ(0, IO_REG(IO_IF));
+    arm.cycles = start + 256;
+    sched_dispatch();
+    ASSERT_EQ(1 << IRQ_TIMER1, IO_REG(IO_IF));
+    ASSERT_EQ(0xff00, timer_load(1));
+    ASSERT(sched.when[SCHED_TIMER1] == start + 512);
+    /* Read before a late overflow is handled, the counter has wrapped. */
+    arm.cycles = start + 512 + 3;
+    ASSERT_EQ(0xff03, timer_load(1));
+    return 0;
+}
+
+static int cascade(void)
+{
+    timer_setup();
+    uint64_t start = arm.cycles;
+    timer_start(3, 0xfffe,
+                TIMER_CNT_ENABLE | TIMER_CNT_CASCADE | TIMER_CNT_IRQ);
+    timer_start(2, 0xffff, TIMER_CNT_ENABLE | TIMER_CNT_CASCADE);
+    timer_start(1, 0xff00, TIMER_CNT_ENABLE);
+    /* Counting up costs no events of its own. */
+    ASSERT(sched.when[SCHED_TIMER2] == SCHED_IDLE);
+    ASSERT(sched.when[SCHED_TIMER3] == SCHED_IDLE);
+    run_until(start + 256);
+    ASSERT_EQ(0xffff, timer_load(2));
+    ASSERT_EQ(0xffff, timer_load(3));
+    ASSERT_EQ(0, IO_REG(IO_IF));
+    /* Timer 2 overflows on every overflow of timer 1. */
+    run_until(start + 512);
+    ASSERT_EQ(0xffff, timer_load(2));
+    ASSERT_EQ(0xfffe, timer_load(3));
+    ASSERT_EQ(1 << IRQ_TIMER3, IO_REG(IO_IF));
+    return 0;
+}
+
+static int write_keeps_phase(void)
+{
+    timer_setup();
+    uint64_t start = arm.cycles;
+    timer_start(0, 0xfff0, TIMER_CNT_ENABLE | 1);
+    /* Turning the IRQ on part way through a tick does not restart it. */
+    arm.cycles = start + 5 * 64 + 40;
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_H,
+                        TIMER_CNT_ENABLE | TIMER_CNT_IRQ | 1);
+    arm.cycles = start + 6 * 64 - 1;
+    ASSERT_EQ(0xfff5, timer_load(0));
+    arm.cycles = start + 6 * 64;
+    ASSERT_EQ(0xfff6, timer_load(0));
+    ASSERT(sched.when[SCHED_TIMER0] == start + 16 * 64);
+    return 0;
+}
+
+static int write_prescaler(void)
+{
+    timer_setup();
+    uint64_t start = arm.cycles;
+    timer_start(0, 0xfff0, TIMER_CNT_ENABLE | 3);
+    /* From 1024 to 1 cycle a tick, the partial tick is dropped. */
+    arm.cycles = start + 2 * 1024 + 1000;
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_H, TIMER_CNT_ENABLE);
+    ASSERT_EQ(0xfff2, timer_load(0));
+    arm.cycles += 1;
+    ASSERT_EQ(0xfff3, timer_load(0));
+    ASSERT(sched.when[SCHED_TIMER0] == start + 2 * 1024 + 1000 + 14);
+    return 0;
+}
+
+static int write_after_overflow(void)
+{
+    timer_setup();
+    uint64_t start = arm.cycles;
+    timer_start(0, 0xff00, TIMER_CNT_ENABLE | TIMER_CNT_IRQ);
+    /* Stopped a few cycles after an overflow that is not handled yet. */
+    arm.cycles = start + 256 + 3;
+    mmu_write_half_word(0x04000000 + IO_TM0CNT_H, TIMER_CNT_IRQ);
+    ASSERT_EQ(1 << IRQ_TIMER0, IO_REG(IO_IF));
+    ASSERT_EQ(0xff03, timer_load(0));
+    ASSERT(sched.when[SCHED_TIMER0] == SCHED_IDLE);
+    arm.cycles += 0x1000;
+    ASSERT_EQ(0xff03, timer_load(0));
+    return 0;
+}
+
+void timer_test(void)
+{
+    ut_run(lazy_counter);
+    ut_run(overflow_irq);
+    ut_run(cascade);
+    ut_run(write_keeps_phase);
+    ut_run(write_prescaler);
+    ut_run(write_after_overflow);
+}